@@ -433,8 +433,8 @@ void handler_erase(FirmwareErase *msg)
                 flash_erase_word(i);
             }
 
-            /* Erase unused sectors */
-            flash_erase_word(FLASH_UNUSED0);
+            /* Erase account node cache */
+            flash_erase_word(FLASH_NODE_CACHE);
 
             /* Erase application section */
             flash_erase_word(FLASH_APP);
@@ -458,6 +458,93 @@ void handler_erase(FirmwareErase *msg)
 
 /* --- Raw Message Handlers ------------------------------------------------ */
 
+/*
+ * upload_hash() - Take the firmware hash of a firmware upload
+ *
+ * INPUT
+ *     - field: part of payload hash field
+ * OUTPUT
+ *     none
+ */
+static void upload_hash(const RawField *field)
+{
+    if(field->size != SHA256_DIGEST_LENGTH)
+    {
+        send_failure(FailureType_Failure_FirmwareError, "Not valid firmware");
+        upload_state = RAW_MESSAGE_ERROR;
+        dbg_print("Error: invalid firmware hash... \n\r");
+        return;
+    }
+
+    memcpy(firmware_hash + field->offset, field->data, field->len);
+}
+
+/*
+ * upload_payload() - Write the image of a firmware upload to flash straight
+ * from the report it arrived in
+ *
+ * The KeepKey magic is checked but not written, it is only installed once the
+ * hash of the whole image has been verified.
+ *
+ * INPUT
+ *     - field: part of payload field
+ * OUTPUT
+ *     none
+ */
+static void upload_payload(RawField *field)
+{
+    uint32_t magic_len;
+
+    if(field->offset < META_MAGIC_SIZE)
+    {
+        magic_len = META_MAGIC_SIZE - field->offset;
+
+        if(magic_len > field->len)
+        {
+            magic_len = field->len;
+        }
+
+        /* Check that image is prepared with KeepKey magic */
+        if(field->size <= META_MAGIC_SIZE ||
+                memcmp(field->data, META_MAGIC_STR + field->offset, magic_len) != 0)
+        {
+            send_failure(FailureType_Failure_FirmwareError, "Not valid firmware");
+            upload_state = RAW_MESSAGE_ERROR;
+            dbg_print("Error: invalid Magic Key detected... \n\r");
+            return;
+        }
+
+        field->offset += magic_len;
+        field->data += magic_len;
+        field->len -= magic_len;
+
+        if(field->offset == META_MAGIC_SIZE)
+        {
+            /* Unlock the flash for writing */
+            flash_unlock();
+        }
+    }
+
+    /* Begin writing to flash */
+    if(field->len > 0 && !flash_write_word(FLASH_APP, field->offset, field->len, field->data))
+    {
+        /* Error: flash write error */
+        flash_lock();
+        send_failure(FailureType_Failure_FirmwareError,
+                     "Encountered error while writing to flash");
+        upload_state = RAW_MESSAGE_ERROR;
+        dbg_print("Error: flash write error... \n\r");
+        return;
+    }
+
+    /* Finish firmware update */
+    if(field->offset + field->len == field->size)
+    {
+        flash_lock();
+        upload_state = RAW_MESSAGE_COMPLETE;
+    }
+}
+
 /*
  * raw_handler_upload() - Main firmware upload handler that parses USB message
  * and writes image to flash
@@ -472,7 +559,8 @@ void handler_erase(FirmwareErase *msg)
  */
 void raw_handler_upload(RawMessage *msg, uint32_t frame_length)
 {
-    static uint32_t flash_offset;
+    static RawFieldStream stream;
+    RawField field;
 
     /* Check file size is within allocated space */
     if(frame_length < (FLASH_APP_LEN + FLASH_META_DESC_LEN))
@@ -481,79 +569,36 @@ void raw_handler_upload(RawMessage *msg, uint32_t frame_length)
         if(upload_state == RAW_MESSAGE_NOT_STARTED)
         {
             upload_state = RAW_MESSAGE_STARTED;
-            flash_offset = 0;
-
-            /*
-             * Parse firmware hash
-             */
-            memcpy(firmware_hash, msg->buffer + PROTOBUF_FIRMWARE_HASH_START, SHA256_DIGEST_LENGTH);
-
-            /*
-             * Parse application start
-             */
-            msg->length -= PROTOBUF_FIRMWARE_START;
-            msg->buffer = (uint8_t *)(msg->buffer + PROTOBUF_FIRMWARE_START);
+            memset(firmware_hash, 0, sizeof(firmware_hash));
+            raw_field_init(&stream);
         }
 
         /* Process firmware upload */
-        if(upload_state == RAW_MESSAGE_STARTED)
+        while(upload_state == RAW_MESSAGE_STARTED && raw_field_next(&stream, msg, &field))
         {
-            /* Check if the image is bigger than allocated space */
-            if((flash_offset + msg->length) < (FLASH_APP_LEN + FLASH_META_DESC_LEN))
+            if(field.depth != 0)
             {
-                if(flash_offset == 0)
-                {
-                    /* Check that image is prepared with KeepKey magic */
-                    if(memcmp(msg->buffer, META_MAGIC_STR, META_MAGIC_SIZE) == 0)
-                    {
-                        msg->length -= META_MAGIC_SIZE;
-                        msg->buffer = (uint8_t *)(msg->buffer + META_MAGIC_SIZE);
-                        flash_offset = META_MAGIC_SIZE;
-                        /* Unlock the flash for writing */
-                        flash_unlock();
-                    }
-                    else
-                    {
-                        /* Invalid KeepKey magic detected */
-                        send_failure(FailureType_Failure_FirmwareError, "Not valid firmware");
-                        upload_state = RAW_MESSAGE_ERROR;
-                        dbg_print("Error: invalid Magic Key detected... \n\r");
-                        goto rhu_exit;
-                    }
-
-                }
-
-                /* Begin writing to flash */
-                if(!flash_write(FLASH_APP, flash_offset, msg->length, msg->buffer))
-                {
-                    /* Error: flash write error */
-                    flash_lock();
-                    send_failure(FailureType_Failure_FirmwareError,
-                                 "Encountered error while writing to flash");
-                    upload_state = RAW_MESSAGE_ERROR;
-                    dbg_print("Error: flash write error... \n\r");
-                    goto rhu_exit;
-                }
-
-                flash_offset += msg->length;
+                continue;
             }
-            else
+
+            if(field.number == FirmwareUpload_payload_hash_tag)
             {
-                /* Error: frame overrun detected during the image update */
-                flash_lock();
-                send_failure(FailureType_Failure_FirmwareError, "Firmware too large");
-                upload_state = RAW_MESSAGE_ERROR;
-                dbg_print("Error: frame overrun detected during the image update... \n\r");
-                goto rhu_exit;
+                upload_hash(&field);
             }
-
-            /* Finish firmware update */
-            if(flash_offset >= frame_length - PROTOBUF_FIRMWARE_START)
+            else if(field.number == FirmwareUpload_payload_tag)
             {
-                flash_lock();
-                upload_state = RAW_MESSAGE_COMPLETE;
+                upload_payload(&field);
             }
         }
+
+        if(upload_state == RAW_MESSAGE_STARTED && raw_field_failed(&stream))
+        {
+            /* Error: malformed upload message */
+            flash_lock();
+            send_failure(FailureType_Failure_FirmwareError, "Not valid firmware");
+            upload_state = RAW_MESSAGE_ERROR;
+            dbg_print("Error: malformed firmware upload... \n\r");
+        }
     }
     else
     {
@@ -562,9 +607,6 @@ void raw_handler_upload(RawMessage *msg, uint32_t frame_length)
                   frame_length);
         upload_state = RAW_MESSAGE_ERROR;
     }
-
-rhu_exit:
-    return;
 }
 
 /* --- Debug Message Handlers ---------------------------------------------- */
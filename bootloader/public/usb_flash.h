@@ -32,8 +32,6 @@
 #define RESP_INIT(TYPE) TYPE resp; memset(&resp, 0, sizeof(TYPE));
 
 #define UPLOAD_STATUS_FREQUENCY		    1024
-#define PROTOBUF_FIRMWARE_HASH_START    2
-#define PROTOBUF_FIRMWARE_START	        38
 
 #define FILL_CONFIG_DATA                0xaa
 
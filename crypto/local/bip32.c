@@ -109,13 +109,20 @@ int hdnode_from_seed(const uint8_t *seed, int seed_len, HDNode *out)
 	return failed ? 0 : 1;
 }
 
-int hdnode_private_ckd(HDNode *inout, uint32_t i)
+// public_key[0] == 0 marks a node whose public key has not been computed yet.
+// The parent public key is only needed for non-hardened derivation and for the
+// child fingerprint, so hardened steps in the middle of a path can skip it.
+int hdnode_private_ckd_step(HDNode *inout, uint32_t i, bool need_fingerprint)
 {
 	uint8_t data[1 + 32 + 4];
 	uint8_t I[32 + 32];
 	uint8_t fingerprint[32];
 	bignum256 a, b;
 
+	if (inout->public_key[0] == 0 && (!(i & 0x80000000) || need_fingerprint)) {
+		hdnode_fill_public_key(inout);
+	}
+
 	if (i & 0x80000000) { // private derivation
 		data[0] = 0;
 		memcpy(data + 1, inout->private_key, 32);
@@ -124,9 +131,13 @@ int hdnode_private_ckd(HDNode *inout, uint32_t i)
 	}
 	write_be(data + 33, i);
 
-	sha256_Raw(inout->public_key, 33, fingerprint);
-	ripemd160(fingerprint, 32, fingerprint);
-	inout->fingerprint = (fingerprint[0] << 24) + (fingerprint[1] << 16) + (fingerprint[2] << 8) + fingerprint[3];
+	if (inout->public_key[0] != 0) {
+		sha256_Raw(inout->public_key, 33, fingerprint);
+		ripemd160(fingerprint, 32, fingerprint);
+		inout->fingerprint = (fingerprint[0] << 24) + (fingerprint[1] << 16) + (fingerprint[2] << 8) + fingerprint[3];
+	} else {
+		inout->fingerprint = 0;
+	}
 
 	bn_read_be(inout->private_key, &a);
 
@@ -152,7 +163,7 @@ int hdnode_private_ckd(HDNode *inout, uint32_t i)
 		inout->depth++;
 		inout->child_num = i;
 		bn_write_be(&a, inout->private_key);
-		hdnode_fill_public_key(inout);
+		MEMSET_BZERO(inout->public_key, sizeof(inout->public_key));
 	}
 
 	// making sure to wipe our memory
@@ -164,107 +175,217 @@ int hdnode_private_ckd(HDNode *inout, uint32_t i)
 	return failed ? 0 : 1;
 }
 
-int hdnode_public_ckd(HDNode *inout, uint32_t i)
+int hdnode_private_ckd(HDNode *inout, uint32_t i)
+{
+	if (hdnode_private_ckd_step(inout, i, true) == 0) {
+		return 0;
+	}
+	hdnode_fill_public_key(inout);
+	return 1;
+}
+
+int hdnode_private_ckd_lazy(HDNode *inout, const uint32_t *i, size_t i_count, bool fill_public)
+{
+	size_t k;
+	for (k = 0; k < i_count; k++) {
+		// only the last step needs a fingerprint
+		if (hdnode_private_ckd_step(inout, i[k], k == i_count - 1) == 0) {
+			return 0;
+		}
+	}
+	if (fill_public && inout->public_key[0] == 0) {
+		hdnode_fill_public_key(inout);
+	}
+	return 1;
+}
+
+int hdnode_private_ckd_public_batch(const HDNode *parent, uint32_t first, uint32_t count, uint8_t (*public_keys)[33])
 {
 	uint8_t data[1 + 32 + 4];
 	uint8_t I[32 + 32];
-	uint8_t fingerprint[32];
-	curve_point a, b;
+	bignum256 a, k[SCALAR_MULTIPLY_BATCH_MAX];
+	curve_point pub[SCALAR_MULTIPLY_BATCH_MAX];
+	uint32_t j, n;
+
+	// non-hardened children only, and the range must not run into them
+	if (count == 0 || (first & 0x80000000) || ((first + count - 1) & 0x80000000) || first + count < first) {
+		return 0;
+	}
+
+	if (parent->public_key[0] != 0) {
+		memcpy(data, parent->public_key, 33);
+	} else {
+		ecdsa_get_public_key33(default_curve, parent->private_key, data);
+	}
+	bn_read_be(parent->private_key, &a);
+
+	bool failed = false;
+
+	while (count > 0 && !failed) {
+		n = count < SCALAR_MULTIPLY_BATCH_MAX ? count : SCALAR_MULTIPLY_BATCH_MAX;
+
+		for (j = 0; j < n && !failed; j++) {
+			write_be(data + 33, first + j);
+			hmac_sha512(parent->chain_code, 32, data, sizeof(data), I);
+			bn_read_be(I, &k[j]);
+			if (!bn_is_less(&k[j], &default_curve->order)) { // >= order
+				failed = true;
+				break;
+			}
+			// child private key = parent private key + I_L
+			bn_addmod(&k[j], &a, &default_curve->order);
+			bn_mod(&k[j], &default_curve->order);
+			if (bn_is_zero(&k[j])) {
+				failed = true;
+			}
+		}
+
+		if (!failed) {
+			scalar_multiply_batch(default_curve, k, pub, n);
+			for (j = 0; j < n; j++) {
+				public_keys[j][0] = 0x02 | (pub[j].y.val[0] & 0x01);
+				bn_write_be(&pub[j].x, public_keys[j] + 1);
+			}
+			first += n;
+			public_keys += n;
+			count -= n;
+		}
+	}
+
+	// making sure to wipe our memory
+	MEMSET_BZERO(data, sizeof(data));
+	MEMSET_BZERO(I, sizeof(I));
+	MEMSET_BZERO(&a, sizeof(a));
+	MEMSET_BZERO(k, sizeof(k));
+	MEMSET_BZERO(pub, sizeof(pub));
+	return failed ? 0 : 1;
+}
+
+int hdnode_public_ckd_cp(const ecdsa_curve *curve, const curve_point *parent, const uint8_t *parent_chain_code, uint32_t i, curve_point *child, uint8_t *child_chain_code)
+{
+	uint8_t data[1 + 32 + 4];
+	uint8_t I[32 + 32];
+	curve_point b;
 	bignum256 c;
 
 	if (i & 0x80000000) { // private derivation
 		return 0;
-	} else { // public derivation
-		memcpy(data, inout->public_key, 33);
 	}
-	write_be(data + 33, i);
 
-	sha256_Raw(inout->public_key, 33, fingerprint);
-	ripemd160(fingerprint, 32, fingerprint);
-	inout->fingerprint = (fingerprint[0] << 24) + (fingerprint[1] << 16) + (fingerprint[2] << 8) + fingerprint[3];
-
-	memset(inout->private_key, 0, 32);
+	// compressed parent key straight from the point, no sqrt needed
+	data[0] = 0x02 | (parent->y.val[0] & 0x01);
+	bn_write_be(&parent->x, data + 1);
+	write_be(data + 33, i);
 
 	bool failed = false;
-	if (!ecdsa_read_pubkey(default_curve, inout->public_key, &a)) {
-		failed = true;
-	}
 
-	if (!failed) {
-		hmac_sha512(inout->chain_code, 32, data, sizeof(data), I);
-		memcpy(inout->chain_code, I + 32, 32);
-		bn_read_be(I, &c);
-		if (!bn_is_less(&c, &default_curve->order)) { // >= order
-			failed = true;
-		}
+	hmac_sha512(parent_chain_code, 32, data, sizeof(data), I);
+	bn_read_be(I, &c);
+	if (!bn_is_less(&c, &curve->order)) { // >= order
+		failed = true;
 	}
 
 	if (!failed) {
-		scalar_multiply(default_curve, &c, &b); // b = c * G
-		point_add(default_curve, &a, &b);       // b = a + b
-		if (!ecdsa_validate_pubkey(default_curve, &b)) {
+		scalar_multiply(curve, &c, &b); // b = c * G
+		point_add(curve, parent, &b);   // b = parent + b
+		if (!ecdsa_validate_pubkey(curve, &b)) {
 			failed = true;
 		}
 	}
 
 	if (!failed) {
-		inout->public_key[0] = 0x02 | (b.y.val[0] & 0x01);
-		bn_write_be(&b.x, inout->public_key + 1);
-		inout->depth++;
-		inout->child_num = i;
+		point_copy(&b, child);
+		memcpy(child_chain_code, I + 32, 32);
 	}
 
 	// Wipe all stack data.
 	MEMSET_BZERO(data, sizeof(data));
 	MEMSET_BZERO(I, sizeof(I));
-	MEMSET_BZERO(fingerprint, sizeof(fingerprint));
-	MEMSET_BZERO(&a, sizeof(a));
 	MEMSET_BZERO(&b, sizeof(b));
 	MEMSET_BZERO(&c, sizeof(c));
 
 	return failed ? 0 : 1;
 }
 
+int hdnode_public_ckd(HDNode *inout, uint32_t i)
+{
+	return hdnode_public_ckd_path(inout, &i, 1);
+}
+
+int hdnode_public_ckd_path(HDNode *inout, const uint32_t *i, size_t i_count)
+{
+	uint8_t fingerprint[32];
+	curve_point pub;
+	size_t k;
+
+	if (i_count == 0) {
+		return 1;
+	}
+
+	// the only decompression of the whole chain
+	if (!ecdsa_read_pubkey(default_curve, inout->public_key, &pub)) {
+		return 0;
+	}
+
+	for (k = 0; k < i_count; k++) {
+		if (k == i_count - 1) {
+			inout->public_key[0] = 0x02 | (pub.y.val[0] & 0x01);
+			bn_write_be(&pub.x, inout->public_key + 1);
+			sha256_Raw(inout->public_key, 33, fingerprint);
+			ripemd160(fingerprint, 32, fingerprint);
+			inout->fingerprint = (fingerprint[0] << 24) + (fingerprint[1] << 16) + (fingerprint[2] << 8) + fingerprint[3];
+		}
+		if (hdnode_public_ckd_cp(default_curve, &pub, inout->chain_code, i[k], &pub, inout->chain_code) == 0) {
+			MEMSET_BZERO(&pub, sizeof(pub));
+			return 0;
+		}
+		inout->depth++;
+		inout->child_num = i[k];
+	}
+
+	memset(inout->private_key, 0, 32);
+	inout->public_key[0] = 0x02 | (pub.y.val[0] & 0x01);
+	bn_write_be(&pub.x, inout->public_key + 1);
+
+	MEMSET_BZERO(fingerprint, sizeof(fingerprint));
+	MEMSET_BZERO(&pub, sizeof(pub));
+	return 1;
+}
+
 #if USE_BIP32_CACHE
 
-static bool private_ckd_cache_root_set = false;
-static HDNode private_ckd_cache_root;
-static int private_ckd_cache_index = 0;
+static HDNodeCache private_ckd_cache;
 
-static struct {
-	bool set;
-	size_t depth;
-	uint32_t i[BIP32_CACHE_MAXDEPTH];
-	HDNode node;
-} private_ckd_cache[BIP32_CACHE_SIZE];
+void hdnode_cache_clear(HDNodeCache *cache)
+{
+	MEMSET_BZERO(cache, sizeof(HDNodeCache));
+}
 
-int hdnode_private_ckd_cached(HDNode *inout, const uint32_t *i, size_t i_count)
+int hdnode_private_ckd_cached_ctx(HDNodeCache *cache, HDNode *inout, const uint32_t *i, size_t i_count)
 {
 	if (i_count == 0) {
 		return 1;
 	}
-	if (i_count == 1) {
-		if (hdnode_private_ckd(inout, i[0]) == 0) return 0;
-		return 1;
+	if (i_count == 1 || i_count - 1 > BIP32_CACHE_MAXDEPTH) {
+		return hdnode_private_ckd_lazy(inout, i, i_count, true);
 	}
 
 	bool found = false;
 	// if root is not set or not the same
-	if (!private_ckd_cache_root_set || memcmp(&private_ckd_cache_root, inout, sizeof(HDNode)) != 0) {
+	if (!cache->root_set || memcmp(&cache->root, inout, sizeof(HDNode)) != 0) {
 		// clear the cache
-		private_ckd_cache_index = 0;
-		memset(private_ckd_cache, 0, sizeof(private_ckd_cache));
+		hdnode_cache_clear(cache);
 		// setup new root
-		memcpy(&private_ckd_cache_root, inout, sizeof(HDNode));
-		private_ckd_cache_root_set = true;
+		memcpy(&cache->root, inout, sizeof(HDNode));
+		cache->root_set = true;
 	} else {
 		// try to find parent
 		int j;
 		for (j = 0; j < BIP32_CACHE_SIZE; j++) {
-			if (private_ckd_cache[j].set &&
-			    private_ckd_cache[j].depth == i_count - 1 &&
-			    memcmp(private_ckd_cache[j].i, i, (i_count - 1) * sizeof(uint32_t)) == 0) {
-				memcpy(inout, &(private_ckd_cache[j].node), sizeof(HDNode));
+			if (cache->entries[j].set &&
+			    cache->entries[j].depth == i_count - 1 &&
+			    memcmp(cache->entries[j].i, i, (i_count - 1) * sizeof(uint32_t)) == 0) {
+				memcpy(inout, &(cache->entries[j].node), sizeof(HDNode));
 				found = true;
 				break;
 			}
@@ -273,17 +394,21 @@ int hdnode_private_ckd_cached(HDNode *inout, const uint32_t *i, size_t i_count)
 
 	// else derive parent
 	if (!found) {
+		// the parent fingerprint is never used, only its public key
 		size_t k;
 		for (k = 0; k < i_count - 1; k++) {
-			if (hdnode_private_ckd(inout, i[k]) == 0) return 0;
+			if (hdnode_private_ckd_step(inout, i[k], false) == 0) return 0;
+		}
+		if (inout->public_key[0] == 0) {
+			hdnode_fill_public_key(inout);
 		}
 		// and save it
-		memset(&(private_ckd_cache[private_ckd_cache_index]), 0, sizeof(private_ckd_cache[private_ckd_cache_index]));
-		private_ckd_cache[private_ckd_cache_index].set = true;
-		private_ckd_cache[private_ckd_cache_index].depth = i_count - 1;
-		memcpy(private_ckd_cache[private_ckd_cache_index].i, i, (i_count - 1) * sizeof(uint32_t));
-		memcpy(&(private_ckd_cache[private_ckd_cache_index].node), inout, sizeof(HDNode));
-		private_ckd_cache_index = (private_ckd_cache_index + 1) % BIP32_CACHE_SIZE;
+		memset(&(cache->entries[cache->index]), 0, sizeof(cache->entries[cache->index]));
+		cache->entries[cache->index].set = true;
+		cache->entries[cache->index].depth = i_count - 1;
+		memcpy(cache->entries[cache->index].i, i, (i_count - 1) * sizeof(uint32_t));
+		memcpy(&(cache->entries[cache->index].node), inout, sizeof(HDNode));
+		cache->index = (cache->index + 1) % BIP32_CACHE_SIZE;
 	}
 
 	if (hdnode_private_ckd(inout, i[i_count - 1]) == 0) return 0;
@@ -291,6 +416,11 @@ int hdnode_private_ckd_cached(HDNode *inout, const uint32_t *i, size_t i_count)
 	return 1;
 }
 
+int hdnode_private_ckd_cached(HDNode *inout, const uint32_t *i, size_t i_count)
+{
+	return hdnode_private_ckd_cached_ctx(&private_ckd_cache, inout, i, i_count);
+}
+
 #endif
 
 void hdnode_fill_public_key(HDNode *node)
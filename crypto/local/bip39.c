@@ -31,31 +31,38 @@
 #include "pbkdf2.h"
 #include "bip39_english.h"
 #include "options.h"
+#include "macros.h"
 
-#if USE_BIP39_CACHE
+// number of words, without the terminating null entry
+#define BIP39_WORDS (sizeof(wordlist) / sizeof(wordlist[0]) - 1)
+
+// backs the non-reentrant wrappers
+static char mnemo_static[BIP39_MNEMONIC_MAX_LEN];
 
-static int bip39_cache_index = 0;
+#if USE_BIP39_CACHE
 
-static struct {
-	bool set;
-	char mnemonic[256];
-	char passphrase[64];
-	uint8_t seed[512 / 8];
-} bip39_cache[BIP39_CACHE_SIZE];
+static BIP39Cache bip39_cache;
 
 #endif
 
-const char *mnemonic_generate(int strength)
+const char *mnemonic_generate_r(int strength, char mnemo[BIP39_MNEMONIC_MAX_LEN])
 {
 	if (strength % 32 || strength < 128 || strength > 256) {
 		return 0;
 	}
 	uint8_t data[32];
 	random_buffer(data, 32);
-	return mnemonic_from_data(data, strength / 8);
+	const char *r = mnemonic_from_data_r(data, strength / 8, mnemo);
+	MEMSET_BZERO(data, sizeof(data));
+	return r;
 }
 
-const char *mnemonic_from_data(const uint8_t *data, int len)
+const char *mnemonic_generate(int strength)
+{
+	return mnemonic_generate_r(strength, mnemo_static);
+}
+
+const char *mnemonic_from_data_r(const uint8_t *data, int len, char mnemo[BIP39_MNEMONIC_MAX_LEN])
 {
 	if (len % 4 || len < 16 || len > 32) {
 		return 0;
@@ -70,7 +77,6 @@ const char *mnemonic_from_data(const uint8_t *data, int len)
 	memcpy(bits, data, len);
 
 	int mlen = len * 3 / 4;
-	static char mnemo[24 * 10];
 
 	int i, j, idx;
 	char *p = mnemo;
@@ -85,10 +91,16 @@ const char *mnemonic_from_data(const uint8_t *data, int len)
 		*p = (i < mlen - 1) ? ' ' : 0;
 		p++;
 	}
+	MEMSET_BZERO(bits, sizeof(bits));
 
 	return mnemo;
 }
 
+const char *mnemonic_from_data(const uint8_t *data, int len)
+{
+	return mnemonic_from_data_r(data, len, mnemo_static);
+}
+
 int mnemonic_check(const char *mnemonic)
 {
 	if (!mnemonic) {
@@ -126,21 +138,16 @@ int mnemonic_check(const char *mnemonic)
 		}
 		current_word[j] = 0;
 		if (mnemonic[i] != 0) i++;
-		k = 0;
-		for (;;) {
-			if (!wordlist[k]) { // word not found
-				return 0;
-			}
-			if (strcmp(current_word, wordlist[k]) == 0) { // word found on index k
-				for (ki = 0; ki < 11; ki++) {
-					if (k & (1 << (10 - ki))) {
-						bits[bi / 8] |= 1 << (7 - (bi % 8));
-					}
-					bi++;
-				}
-				break;
+		int idx = mnemonic_find_word(current_word);
+		if (idx < 0) { // word not found
+			return 0;
+		}
+		k = idx; // word found on index k
+		for (ki = 0; ki < 11; ki++) {
+			if (k & (1 << (10 - ki))) {
+				bits[bi / 8] |= 1 << (7 - (bi % 8));
 			}
-			k++;
+			bi++;
 		}
 	}
 	if (bi != n * 11) {
@@ -160,38 +167,59 @@ int mnemonic_check(const char *mnemonic)
 	return 0;
 }
 
-// passphrase must be at most 256 characters or code may crash
-void mnemonic_to_seed(const char *mnemonic, const char *passphrase, uint8_t seed[512 / 8], void (*progress_callback)(uint32_t current, uint32_t total))
+static void mnemonic_to_seed_raw(const char *mnemonic, const char *passphrase, uint8_t seed[512 / 8], void (*progress_callback)(uint32_t current, uint32_t total))
 {
 	int passphraselen = strlen(passphrase);
+	uint8_t salt[8 + 256 + 4];
+	memcpy(salt, "mnemonic", 8);
+	memcpy(salt + 8, passphrase, passphraselen);
+	pbkdf2_hmac_sha512((const uint8_t *)mnemonic, strlen(mnemonic), salt, passphraselen + 8, BIP39_PBKDF2_ROUNDS, seed, 512 / 8, progress_callback);
+}
+
 #if USE_BIP39_CACHE
+
+void mnemonic_cache_clear(BIP39Cache *cache)
+{
+	MEMSET_BZERO(cache, sizeof(BIP39Cache));
+}
+
+// passphrase must be at most 256 characters or code may crash
+void mnemonic_to_seed_ctx(BIP39Cache *cache, const char *mnemonic, const char *passphrase, uint8_t seed[512 / 8], void (*progress_callback)(uint32_t current, uint32_t total))
+{
 	int mnemoniclen = strlen(mnemonic);
+	int passphraselen = strlen(passphrase);
 	// check cache
 	if (mnemoniclen < 256 && passphraselen < 64) {
 		int i;
 		for (i = 0; i < BIP39_CACHE_SIZE; i++) {
-			if (!bip39_cache[i].set) continue;
-			if (strcmp(bip39_cache[i].mnemonic, mnemonic) != 0) continue;
-			if (strcmp(bip39_cache[i].passphrase, passphrase) != 0) continue;
+			if (!cache->entries[i].set) continue;
+			if (strcmp(cache->entries[i].mnemonic, mnemonic) != 0) continue;
+			if (strcmp(cache->entries[i].passphrase, passphrase) != 0) continue;
 			// found the correct entry
-			memcpy(seed, bip39_cache[i].seed, 512 / 8);
+			memcpy(seed, cache->entries[i].seed, 512 / 8);
 			return;
 		}
 	}
-#endif
-	uint8_t salt[8 + 256 + 4];
-	memcpy(salt, "mnemonic", 8);
-	memcpy(salt + 8, passphrase, passphraselen);
-	pbkdf2_hmac_sha512((const uint8_t *)mnemonic, strlen(mnemonic), salt, passphraselen + 8, BIP39_PBKDF2_ROUNDS, seed, 512 / 8, progress_callback);
-#if USE_BIP39_CACHE
+	mnemonic_to_seed_raw(mnemonic, passphrase, seed, progress_callback);
 	// store to cache
 	if (mnemoniclen < 256 && passphraselen < 64) {
-		bip39_cache[bip39_cache_index].set = true;
-		strcpy(bip39_cache[bip39_cache_index].mnemonic, mnemonic);
-		strcpy(bip39_cache[bip39_cache_index].passphrase, passphrase);
-		memcpy(bip39_cache[bip39_cache_index].seed, seed, 512 / 8);
-		bip39_cache_index = (bip39_cache_index + 1) % BIP39_CACHE_SIZE;
+		cache->entries[cache->index].set = true;
+		strcpy(cache->entries[cache->index].mnemonic, mnemonic);
+		strcpy(cache->entries[cache->index].passphrase, passphrase);
+		memcpy(cache->entries[cache->index].seed, seed, 512 / 8);
+		cache->index = (cache->index + 1) % BIP39_CACHE_SIZE;
 	}
+}
+
+#endif
+
+// passphrase must be at most 256 characters or code may crash
+void mnemonic_to_seed(const char *mnemonic, const char *passphrase, uint8_t seed[512 / 8], void (*progress_callback)(uint32_t current, uint32_t total))
+{
+#if USE_BIP39_CACHE
+	mnemonic_to_seed_ctx(&bip39_cache, mnemonic, passphrase, seed, progress_callback);
+#else
+	mnemonic_to_seed_raw(mnemonic, passphrase, seed, progress_callback);
 #endif
 }
 
@@ -199,3 +227,56 @@ const char * const *mnemonic_wordlist(void)
 {
 	return wordlist;
 }
+
+// the wordlist is sorted, so words sharing a prefix are adjacent
+int mnemonic_find_prefix(const char *prefix, int *count)
+{
+	size_t len = strlen(prefix);
+	int lo = 0, hi = BIP39_WORDS, mid, first;
+
+	// first word not less than prefix
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strcmp(wordlist[mid], prefix) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	first = lo;
+
+	// first word past the ones starting with prefix
+	hi = BIP39_WORDS;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strncmp(wordlist[mid], prefix, len) == 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (count) {
+		*count = lo - first;
+	}
+	return first;
+}
+
+int mnemonic_find_word(const char *word)
+{
+	int lo = 0, hi = BIP39_WORDS, mid, cmp;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		cmp = strcmp(wordlist[mid], word);
+		if (cmp == 0) {
+			return mid;
+		}
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return -1;
+}
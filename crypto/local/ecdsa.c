@@ -416,8 +416,9 @@ void point_jacobian_double(jacobian_curve_point *p, const ecdsa_curve *curve) {
 	bn_fast_mod(&p->y, prime);
 }
 
-// res = k * p
-void point_multiply(const ecdsa_curve *curve, const bignum256 *k, const curve_point *p, curve_point *res)
+// jres = k * p in jacobian coordinates
+// returns 0 if the result is the point at infinity (k == 0)
+static int point_multiply_jacobian(const ecdsa_curve *curve, const bignum256 *k, const curve_point *p, jacobian_curve_point *jres)
 {
 	// this algorithm is loosely based on
 	//  Katsuyuki Okeya and Tsuyoshi Takagi, The Width-w NAF Method Provides
@@ -430,7 +431,6 @@ void point_multiply(const ecdsa_curve *curve, const bignum256 *k, const curve_po
 	bignum256 a;
 	uint32_t is_even = (k->val[0] & 1) - 1;
 	uint32_t bits, sign, nsign;
-	jacobian_curve_point jres;
 	curve_point pmult[8];
 	const bignum256 *prime = &curve->prime;
 
@@ -452,8 +452,7 @@ void point_multiply(const ecdsa_curve *curve, const bignum256 *k, const curve_po
 
 	// special case 0*p:  just return zero. We don't care about constant time.
 	if (!is_non_zero) {
-		point_set_infinity(res);
-		return;
+		return 0;
 	}
 
 	// Now a = k + 2^256 (mod curve->order) and a is odd.
@@ -491,15 +490,15 @@ void point_multiply(const ecdsa_curve *curve, const bignum256 *k, const curve_po
 	sign = (bits >> 4) - 1;
 	bits ^= sign;
 	bits &= 15;
-	curve_to_jacobian(&pmult[bits>>1], &jres, prime);
+	curve_to_jacobian(&pmult[bits>>1], jres, prime);
 	for (i = 62; i >= 0; i--) {
 		// sign = sign(a[i+1])  (0xffffffff for negative, 0 for positive)
 		// invariant jres = (-1)^sign sum_{j=i+1..63} (a[j] * 16^{j-i-1} * p)
 
-		point_jacobian_double(&jres, curve);
-		point_jacobian_double(&jres, curve);
-		point_jacobian_double(&jres, curve);
-		point_jacobian_double(&jres, curve);
+		point_jacobian_double(jres, curve);
+		point_jacobian_double(jres, curve);
+		point_jacobian_double(jres, curve);
+		point_jacobian_double(jres, curve);
 
 		// get lowest 5 bits of a >> (i*4).
 		pos = i*4/30; shift = i*4 % 30;
@@ -510,21 +509,33 @@ void point_multiply(const ecdsa_curve *curve, const bignum256 *k, const curve_po
 
 		// negate last result to make signs of this round and the
 		// last round equal.
-		conditional_negate(sign ^ nsign, &jres.z, prime);
+		conditional_negate(sign ^ nsign, &jres->z, prime);
 
 		// add odd factor
-		point_jacobian_add(&pmult[bits >> 1], &jres, curve);
+		point_jacobian_add(&pmult[bits >> 1], jres, curve);
 		sign = nsign;
 	}
-	conditional_negate(sign, &jres.z, prime);
-	jacobian_to_curve(&jres, res, prime);
+	conditional_negate(sign, &jres->z, prime);
+	return 1;
+}
+
+// res = k * p
+void point_multiply(const ecdsa_curve *curve, const bignum256 *k, const curve_point *p, curve_point *res)
+{
+	jacobian_curve_point jres;
+	if (!point_multiply_jacobian(curve, k, p, &jres)) {
+		point_set_infinity(res);
+		return;
+	}
+	jacobian_to_curve(&jres, res, &curve->prime);
 }
 
 #if USE_PRECOMPUTED_CP
 
-// res = k * G
+// jres = k * G in jacobian coordinates
 // k must be a normalized number with 0 <= k < curve->order
-void scalar_multiply(const ecdsa_curve *curve, const bignum256 *k, curve_point *res)
+// returns 0 if the result is the point at infinity (k == 0)
+static int scalar_multiply_jacobian(const ecdsa_curve *curve, const bignum256 *k, jacobian_curve_point *jres)
 {
 	assert (bn_is_less(k, &curve->order));
 
@@ -532,7 +543,6 @@ void scalar_multiply(const ecdsa_curve *curve, const bignum256 *k, curve_point *
 	bignum256 a;
 	uint32_t is_even = (k->val[0] & 1) - 1;
 	uint32_t lowbits;
-	jacobian_curve_point jres;
 	const bignum256 *prime = &curve->prime;
 
 	// is_even = 0xffffffff if k is even, 0 otherwise.
@@ -553,8 +563,7 @@ void scalar_multiply(const ecdsa_curve *curve, const bignum256 *k, curve_point *
 
 	// special case 0*G:  just return zero. We don't care about constant time.
 	if (!is_non_zero) {
-		point_set_infinity(res);
-		return;
+		return 0;
 	}
 
 	// Now a = k + 2^256 (mod curve->order) and a is odd.
@@ -580,7 +589,7 @@ void scalar_multiply(const ecdsa_curve *curve, const bignum256 *k, curve_point *
 	lowbits = a.val[0] & ((1 << 5) - 1);
 	lowbits ^= (lowbits >> 4) - 1;
 	lowbits &= 15;
-	curve_to_jacobian(&curve->cp[0][lowbits >> 1], &jres, prime);
+	curve_to_jacobian(&curve->cp[0][lowbits >> 1], jres, prime);
 	for (i = 1; i < 64; i ++) {
 		// invariant res = sign(a[i-1]) sum_{j=0..i-1} (a[j] * 16^j * G)
 
@@ -597,24 +606,114 @@ void scalar_multiply(const ecdsa_curve *curve, const bignum256 *k, curve_point *
 		lowbits &= 15;
 		// negate last result to make signs of this round and the
 		// last round equal.
-		conditional_negate((lowbits & 1) - 1, &jres.y, prime);
+		conditional_negate((lowbits & 1) - 1, &jres->y, prime);
 
 		// add odd factor
-		point_jacobian_add(&curve->cp[i][lowbits >> 1], &jres, curve);
+		point_jacobian_add(&curve->cp[i][lowbits >> 1], jres, curve);
 	}
-	conditional_negate(((a.val[0] >> 4) & 1) - 1, &jres.y, prime);
-	jacobian_to_curve(&jres, res, prime);
+	conditional_negate(((a.val[0] >> 4) & 1) - 1, &jres->y, prime);
+	return 1;
 }
 
 #else
 
-void scalar_multiply(const ecdsa_curve *curve, const bignum256 *k, curve_point *res)
+static int scalar_multiply_jacobian(const ecdsa_curve *curve, const bignum256 *k, jacobian_curve_point *jres)
 {
-	point_multiply(curve, k, &curve->G, res);
+	return point_multiply_jacobian(curve, k, &curve->G, jres);
 }
 
 #endif
 
+// res = k * G
+// k must be a normalized number with 0 <= k < curve->order
+void scalar_multiply(const ecdsa_curve *curve, const bignum256 *k, curve_point *res)
+{
+	jacobian_curve_point jres;
+	if (!scalar_multiply_jacobian(curve, k, &jres)) {
+		point_set_infinity(res);
+		return;
+	}
+	jacobian_to_curve(&jres, res, &curve->prime);
+}
+
+// res[i] = k[i] * G for 0 <= i < count
+// All results are brought back to affine coordinates with a single field
+// inversion per SCALAR_MULTIPLY_BATCH_MAX points (Montgomery's trick):
+// the z coordinates are multiplied up, the product is inverted once and
+// each z^-1 is recovered by walking the partial products backwards.
+void scalar_multiply_batch(const ecdsa_curve *curve, const bignum256 *k, curve_point *res, size_t count)
+{
+	jacobian_curve_point jres;
+	bignum256 z[SCALAR_MULTIPLY_BATCH_MAX];    // z coordinates
+	bignum256 acc[SCALAR_MULTIPLY_BATCH_MAX];  // acc[i] = z[0] * ... * z[i]
+	bignum256 inv, zinv, zinv2;
+	const bignum256 *prime = &curve->prime;
+	size_t i, n;
+
+	while (count > 0) {
+		n = count < SCALAR_MULTIPLY_BATCH_MAX ? count : SCALAR_MULTIPLY_BATCH_MAX;
+
+		for (i = 0; i < n; i++) {
+			if (scalar_multiply_jacobian(curve, &k[i], &jres)) {
+				res[i].x = jres.x;
+				res[i].y = jres.y;
+				z[i] = jres.z;
+			} else {
+				// point at infinity: keep it out of the product
+				bn_zero(&z[i]);
+				z[i].val[0] = 1;
+			}
+			acc[i] = z[i];
+			if (i > 0) {
+				bn_multiply(&acc[i - 1], &acc[i], prime);
+			}
+		}
+
+		inv = acc[n - 1];
+		bn_inverse(&inv, prime);
+		// inv = (z[0] * ... * z[n-1])^-1
+
+		for (i = n; i-- > 0; ) {
+			if (i > 0) {
+				zinv = acc[i - 1];
+				bn_multiply(&inv, &zinv, prime);
+				// zinv = z[i]^-1
+				bn_multiply(&z[i], &inv, prime);
+				// inv = (z[0] * ... * z[i-1])^-1
+			} else {
+				zinv = inv;
+			}
+
+			if (bn_is_zero(&k[i])) {
+				point_set_infinity(&res[i]);
+				continue;
+			}
+
+			zinv2 = zinv;
+			bn_multiply(&zinv2, &zinv2, prime);
+			// zinv2 = z^-2
+			bn_multiply(&zinv2, &zinv, prime);
+			// zinv = z^-3
+			bn_multiply(&zinv2, &res[i].x, prime);
+			bn_multiply(&zinv, &res[i].y, prime);
+			bn_mod(&res[i].x, prime);
+			bn_mod(&res[i].y, prime);
+		}
+
+		k += n;
+		res += n;
+		count -= n;
+	}
+
+	MEMSET_BZERO(&jres, sizeof(jres));
+	MEMSET_BZERO(z, sizeof(z));
+	MEMSET_BZERO(acc, sizeof(acc));
+	MEMSET_BZERO(&inv, sizeof(inv));
+	MEMSET_BZERO(&zinv, sizeof(zinv));
+	MEMSET_BZERO(&zinv2, sizeof(zinv2));
+}
+
+
 // generate random K for signing
 int generate_k_random(const ecdsa_curve *curve, bignum256 *k) {
 	int i, j;
@@ -706,79 +805,102 @@ int ecdsa_sign_double(const ecdsa_curve *curve, const uint8_t *priv_key, const u
 	return res;
 }
 
-// uses secp256k1 curve
-// priv_key is a 32 byte big endian stored number
-// sig is 64 bytes long array for the signature
-// digest is 32 bytes of digest
-int ecdsa_sign_digest(const ecdsa_curve *curve, const uint8_t *priv_key, const uint8_t *digest, uint8_t *sig, uint8_t *pby)
+// generate the nonce k of a signature of digest and R = k*G
+int ecdsa_sign_nonce(const ecdsa_curve *curve, const uint8_t *priv_key, const uint8_t *digest, bignum256 *k, curve_point *R)
 {
-	uint32_t i;
-	curve_point R;
-	bignum256 k, z;
-	bignum256 *da = &R.y;
-	int result = 0;
-	bn_read_be(digest, &z);
-
 #if USE_RFC6979
 	// generate K deterministically
-	if (generate_k_rfc6979(curve, &k, priv_key, digest) != 0) {
-		result = 1;
+	if (generate_k_rfc6979(curve, k, priv_key, digest) != 0) {
+		return 1;
 	}
 #else
+	(void)priv_key;
+	(void)digest;
 	// generate random number k
-	if (generate_k_random(curve, &k) != 0) {
-		result = 1;
+	if (generate_k_random(curve, k) != 0) {
+		return 1;
 	}
 #endif
 
-	if (result == 0) {
-		// compute k*G
-		scalar_multiply(curve, &k, &R);
-		if (pby) {
-			*pby = R.y.val[0] & 1;
-		}
-		// r = (rx mod n)
-		bn_mod(&R.x, &curve->order);
-		// if r is zero, we fail
-		if (bn_is_zero(&R.x))
-		{
-			result = 2;
-		}
+	// compute k*G
+	scalar_multiply(curve, k, R);
+	return 0;
+}
+
+// sign digest with a nonce k and R = k*G from ecdsa_sign_nonce
+// k and R are cleared
+int ecdsa_sign_digest_nonce(const ecdsa_curve *curve, const uint8_t *priv_key, const uint8_t *digest, bignum256 *k, curve_point *R, uint8_t *sig, uint8_t *pby)
+{
+	uint32_t i;
+	bignum256 z;
+	bignum256 *da = &R->y;
+	int result = 0;
+	bn_read_be(digest, &z);
+
+	if (pby) {
+		*pby = R->y.val[0] & 1;
+	}
+	// r = (rx mod n)
+	bn_mod(&R->x, &curve->order);
+	// if r is zero, we fail
+	if (bn_is_zero(&R->x))
+	{
+		result = 2;
 	}
 
 	if (result == 0) {
-		bn_inverse(&k, &curve->order);
+		bn_inverse(k, &curve->order);
 		bn_read_be(priv_key, da);
-		bn_multiply(&R.x, da, &curve->order);
+		bn_multiply(&R->x, da, &curve->order);
 		for (i = 0; i < 8; i++) {
 			da->val[i] += z.val[i];
 			da->val[i + 1] += (da->val[i] >> 30);
 			da->val[i] &= 0x3FFFFFFF;
 		}
 		da->val[8] += z.val[8];
-		bn_multiply(da, &k, &curve->order);
-		bn_mod(&k, &curve->order);
+		bn_multiply(da, k, &curve->order);
+		bn_mod(k, &curve->order);
 		// if k is zero, we fail
-		if (bn_is_zero(&k)) {
+		if (bn_is_zero(k)) {
 			result = 3;
 		}
 	}
 
 	if (result == 0) {
 		// if S > order/2 => S = -S
-		if (bn_is_less(&curve->order_half, &k)) {
-			bn_subtract(&curve->order, &k, &k);
+		if (bn_is_less(&curve->order_half, k)) {
+			bn_subtract(&curve->order, k, k);
 			if (pby) {
 				*pby = !*pby;
 			}
 		}
 		// we are done, R.x and k is the result signature
-		bn_write_be(&R.x, sig);
-		bn_write_be(&k, sig + 32);
+		bn_write_be(&R->x, sig);
+		bn_write_be(k, sig + 32);
 	}
 
-	MEMSET_BZERO(&k, sizeof(k));
+	MEMSET_BZERO(k, sizeof(bignum256));
 	MEMSET_BZERO(&z, sizeof(z));
+	MEMSET_BZERO(R, sizeof(curve_point));
+	return result;
+}
+
+// uses secp256k1 curve
+// priv_key is a 32 byte big endian stored number
+// sig is 64 bytes long array for the signature
+// digest is 32 bytes of digest
+int ecdsa_sign_digest(const ecdsa_curve *curve, const uint8_t *priv_key, const uint8_t *digest, uint8_t *sig, uint8_t *pby)
+{
+	curve_point R;
+	bignum256 k;
+	int result;
+
+	result = ecdsa_sign_nonce(curve, priv_key, digest, &k, &R);
+	if (result == 0) {
+		result = ecdsa_sign_digest_nonce(curve, priv_key, digest, &k, &R, sig, pby);
+	}
+
+	MEMSET_BZERO(&k, sizeof(k));
 	MEMSET_BZERO(&R, sizeof(R));
 	return result;
 }
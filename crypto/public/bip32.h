@@ -26,6 +26,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include "ecdsa.h"
 #include "options.h"
 
@@ -48,10 +49,46 @@ int hdnode_from_seed(const uint8_t *seed, int seed_len, HDNode *out);
 
 int hdnode_private_ckd(HDNode *inout, uint32_t i);
 
+// single derivation step leaving the child public key zeroed; the parent public
+// key is only computed for non-hardened steps or when need_fingerprint is set
+int hdnode_private_ckd_step(HDNode *inout, uint32_t i, bool need_fingerprint);
+
+// derives a whole path, computing public keys only where the derivation needs
+// them; the final public key is left zeroed unless fill_public is set
+int hdnode_private_ckd_lazy(HDNode *inout, const uint32_t *i, size_t i_count, bool fill_public);
+
+// public keys of the non-hardened children first .. first + count - 1 of a
+// private node, converted to affine coordinates with one shared inversion
+int hdnode_private_ckd_public_batch(const HDNode *parent, uint32_t first, uint32_t count, uint8_t (*public_keys)[33]);
+
 int hdnode_public_ckd(HDNode *inout, uint32_t i);
 
+// public derivation on an affine point, so chained steps skip decompression
+int hdnode_public_ckd_cp(const ecdsa_curve *curve, const curve_point *parent, const uint8_t *parent_chain_code, uint32_t i, curve_point *child, uint8_t *child_chain_code);
+
+// derives a whole public path, decompressing the starting key only once
+int hdnode_public_ckd_path(HDNode *inout, const uint32_t *i, size_t i_count);
+
 #if USE_BIP32_CACHE
 
+// caller-owned private derivation cache, so independent callers share no state
+typedef struct {
+	bool root_set;
+	HDNode root;
+	int index;
+	struct {
+		bool set;
+		size_t depth;
+		uint32_t i[BIP32_CACHE_MAXDEPTH];
+		HDNode node;
+	} entries[BIP32_CACHE_SIZE];
+} HDNodeCache;
+
+void hdnode_cache_clear(HDNodeCache *cache);
+
+int hdnode_private_ckd_cached_ctx(HDNodeCache *cache, HDNode *inout, const uint32_t *i, size_t i_count);
+
+// same as above on a library-wide cache, not reentrant
 int hdnode_private_ckd_cached(HDNode *inout, const uint32_t *i, size_t i_count);
 
 #endif
@@ -25,18 +25,60 @@
 #define __BIP39_H__
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "options.h"
 
 #define BIP39_PBKDF2_ROUNDS 2048
 
+// longest mnemonic, 24 words of up to 8 letters plus separators
+#define BIP39_MNEMONIC_MAX_LEN (24 * 10)
+
+#if USE_BIP39_CACHE
+
+// caller-owned seed cache, so independent callers share no state
+typedef struct {
+	int index;
+	struct {
+		bool set;
+		char mnemonic[256];
+		char passphrase[64];
+		uint8_t seed[512 / 8];
+	} entries[BIP39_CACHE_SIZE];
+} BIP39Cache;
+
+#endif
+
+// the _r variants write into the caller's buffer and return it, the plain
+// ones return a static buffer and are not reentrant
+const char *mnemonic_generate_r(int strength, char mnemo[BIP39_MNEMONIC_MAX_LEN]);	// strength in bits
+
 const char *mnemonic_generate(int strength);	// strength in bits
 
+const char *mnemonic_from_data_r(const uint8_t *data, int len, char mnemo[BIP39_MNEMONIC_MAX_LEN]);
+
 const char *mnemonic_from_data(const uint8_t *data, int len);
 
 int mnemonic_check(const char *mnemonic);
 
+#if USE_BIP39_CACHE
+
+void mnemonic_cache_clear(BIP39Cache *cache);
+
+// passphrase must be at most 256 characters or code may crash
+void mnemonic_to_seed_ctx(BIP39Cache *cache, const char *mnemonic, const char *passphrase, uint8_t seed[512 / 8], void (*progress_callback)(uint32_t current, uint32_t total));
+
+#endif
+
+// same as above on a library-wide cache, not reentrant
 // passphrase must be at most 256 characters or code may crash
 void mnemonic_to_seed(const char *mnemonic, const char *passphrase, uint8_t seed[512 / 8], void (*progress_callback)(uint32_t current, uint32_t total));
 
 const char * const *mnemonic_wordlist(void);
 
+// index of word in the wordlist, -1 if it is not a BIP39 word
+int mnemonic_find_word(const char *word);
+
+// index of the first word starting with prefix, count receives the number of such words
+int mnemonic_find_prefix(const char *prefix, int *count);
+
 #endif
@@ -25,6 +25,7 @@
 #define __ECDSA_H__
 
 #include <stdint.h>
+#include <stddef.h>
 #include "options.h"
 #include "bignum.h"
 
@@ -57,11 +58,14 @@ int point_is_infinity(const curve_point *p);
 int point_is_equal(const curve_point *p, const curve_point *q);
 int point_is_negative_of(const curve_point *p, const curve_point *q);
 void scalar_multiply(const ecdsa_curve *curve, const bignum256 *k, curve_point *res);
+void scalar_multiply_batch(const ecdsa_curve *curve, const bignum256 *k, curve_point *res, size_t count);
 void uncompress_coords(const ecdsa_curve *curve, uint8_t odd, const bignum256 *x, bignum256 *y);
 
 int ecdsa_sign(const ecdsa_curve *curve, const uint8_t *priv_key, const uint8_t *msg, uint32_t msg_len, uint8_t *sig, uint8_t *pby);
 int ecdsa_sign_double(const ecdsa_curve *curve, const uint8_t *priv_key, const uint8_t *msg, uint32_t msg_len, uint8_t *sig, uint8_t *pby);
 int ecdsa_sign_digest(const ecdsa_curve *curve, const uint8_t *priv_key, const uint8_t *digest, uint8_t *sig, uint8_t *pby);
+int ecdsa_sign_nonce(const ecdsa_curve *curve, const uint8_t *priv_key, const uint8_t *digest, bignum256 *k, curve_point *R);
+int ecdsa_sign_digest_nonce(const ecdsa_curve *curve, const uint8_t *priv_key, const uint8_t *digest, bignum256 *k, curve_point *R, uint8_t *sig, uint8_t *pby);
 void ecdsa_get_public_key33(const ecdsa_curve *curve, const uint8_t *priv_key, uint8_t *pub_key);
 void ecdsa_get_public_key65(const ecdsa_curve *curve, const uint8_t *priv_key, uint8_t *pub_key);
 void ecdsa_get_pubkeyhash(const uint8_t *pub_key, uint8_t *pubkeyhash);
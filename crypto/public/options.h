@@ -33,6 +33,11 @@
 #define USE_INVERSE_FAST 1
 #endif
 
+// number of points sharing one field inversion in scalar_multiply_batch
+#ifndef SCALAR_MULTIPLY_BATCH_MAX
+#define SCALAR_MULTIPLY_BATCH_MAX 20
+#endif
+
 // support for printing bignum256 structures via printf
 #ifndef USE_BN_PRINT
 #define USE_BN_PRINT 0
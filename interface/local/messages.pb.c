@@ -4,6 +4,7 @@
 #include "messages.pb.h"
 
 const char GetAddress_coin_name_default[17] = "Bitcoin";
+const char GetAddresses_coin_name_default[17] = "Bitcoin";
 const char LoadDevice_language_default[17] = "english";
 const uint32_t ResetDevice_strength_default = 256u;
 const char ResetDevice_language_default[17] = "english";
@@ -136,6 +137,16 @@ const pb_field_t PublicKey_fields[3] = {
     PB_LAST_FIELD
 };
 
+const pb_field_t GetPublicKeys_fields[2] = {
+    PB_FIELD2(  1, MESSAGE , REPEATED, STATIC  , FIRST, GetPublicKeys, paths, paths, &AddressPathType_fields),
+    PB_LAST_FIELD
+};
+
+const pb_field_t PublicKeys_fields[2] = {
+    PB_FIELD2(  1, MESSAGE , REPEATED, STATIC  , FIRST, PublicKeys, public_keys, public_keys, &PublicKey_fields),
+    PB_LAST_FIELD
+};
+
 const pb_field_t GetAddress_fields[5] = {
     PB_FIELD2(  1, UINT32  , REPEATED, STATIC  , FIRST, GetAddress, address_n, address_n, 0),
     PB_FIELD2(  2, STRING  , OPTIONAL, STATIC  , OTHER, GetAddress, coin_name, address_n, &GetAddress_coin_name_default),
@@ -149,6 +160,19 @@ const pb_field_t Address_fields[2] = {
     PB_LAST_FIELD
 };
 
+const pb_field_t GetAddresses_fields[5] = {
+    PB_FIELD2(  1, UINT32  , REPEATED, STATIC  , FIRST, GetAddresses, address_n, address_n, 0),
+    PB_FIELD2(  2, STRING  , OPTIONAL, STATIC  , OTHER, GetAddresses, coin_name, address_n, &GetAddresses_coin_name_default),
+    PB_FIELD2(  3, UINT32  , OPTIONAL, STATIC  , OTHER, GetAddresses, start_index, coin_name, 0),
+    PB_FIELD2(  4, UINT32  , OPTIONAL, STATIC  , OTHER, GetAddresses, count, start_index, 0),
+    PB_LAST_FIELD
+};
+
+const pb_field_t Addresses_fields[2] = {
+    PB_FIELD2(  1, STRING  , REPEATED, STATIC  , FIRST, Addresses, address, address, 0),
+    PB_LAST_FIELD
+};
+
 const pb_field_t WipeDevice_fields[1] = {
     PB_LAST_FIELD
 };
@@ -394,6 +418,17 @@ const pb_field_t DebugLinkFillConfig_fields[1] = {
     PB_LAST_FIELD
 };
 
+const pb_field_t DebugLinkGetSigningStats_fields[2] = {
+    PB_FIELD2(  1, BOOL    , OPTIONAL, STATIC  , FIRST, DebugLinkGetSigningStats, clear, clear, 0),
+    PB_LAST_FIELD
+};
+
+const pb_field_t DebugLinkSigningStats_fields[3] = {
+    PB_FIELD2(  1, UINT32  , OPTIONAL, STATIC  , FIRST, DebugLinkSigningStats, clock_hz, clock_hz, 0),
+    PB_FIELD2(  2, MESSAGE , REPEATED, STATIC  , OTHER, DebugLinkSigningStats, stats, clock_hz, &SigningStatType_fields),
+    PB_LAST_FIELD
+};
+
 
 /* Check that field information fits in pb_field_t */
 #if !defined(PB_FIELD_32BIT)
@@ -404,7 +439,7 @@ const pb_field_t DebugLinkFillConfig_fields[1] = {
  * numbers or field sizes that are larger than what can fit in 8 or 16 bit
  * field descriptors.
  */
-STATIC_ASSERT((pb_membersize(Features, coins[0]) < 65536 && pb_membersize(PublicKey, node) < 65536 && pb_membersize(GetAddress, multisig) < 65536 && pb_membersize(LoadDevice, node) < 65536 && pb_membersize(SimpleSignTx, inputs[0]) < 65536 && pb_membersize(SimpleSignTx, outputs[0]) < 65536 && pb_membersize(SimpleSignTx, transactions[0]) < 65536 && pb_membersize(TxRequest, details) < 65536 && pb_membersize(TxRequest, serialized) < 65536 && pb_membersize(TxAck, tx) < 65536 && pb_membersize(RawTxAck, tx) < 65536 && pb_membersize(SignIdentity, identity) < 65536 && pb_membersize(DebugLinkState, node) < 65536), YOU_MUST_DEFINE_PB_FIELD_32BIT_FOR_MESSAGES_Initialize_GetFeatures_Features_ClearSession_ApplySettings_ChangePin_Ping_Success_Failure_ButtonRequest_ButtonAck_PinMatrixRequest_PinMatrixAck_Cancel_PassphraseRequest_PassphraseAck_GetEntropy_Entropy_GetPublicKey_PublicKey_GetAddress_Address_WipeDevice_LoadDevice_ResetDevice_EntropyRequest_EntropyAck_RecoveryDevice_WordRequest_WordAck_CharacterRequest_CharacterAck_SignMessage_VerifyMessage_MessageSignature_EncryptMessage_EncryptedMessage_DecryptMessage_DecryptedMessage_CipherKeyValue_CipheredKeyValue_EstimateTxSize_TxSize_SignTx_SimpleSignTx_TxRequest_TxAck_RawTxAck_SignIdentity_SignedIdentity_FirmwareErase_FirmwareUpload_DebugLinkDecision_DebugLinkGetState_DebugLinkState_DebugLinkStop_DebugLinkLog_DebugLinkFillConfig)
+STATIC_ASSERT((pb_membersize(Features, coins[0]) < 65536 && pb_membersize(PublicKey, node) < 65536 && pb_membersize(GetPublicKeys, paths[0]) < 65536 && pb_membersize(PublicKeys, public_keys[0]) < 65536 && pb_membersize(GetAddress, multisig) < 65536 && pb_membersize(LoadDevice, node) < 65536 && pb_membersize(SimpleSignTx, inputs[0]) < 65536 && pb_membersize(SimpleSignTx, outputs[0]) < 65536 && pb_membersize(SimpleSignTx, transactions[0]) < 65536 && pb_membersize(TxRequest, details) < 65536 && pb_membersize(TxRequest, serialized) < 65536 && pb_membersize(TxAck, tx) < 65536 && pb_membersize(RawTxAck, tx) < 65536 && pb_membersize(SignIdentity, identity) < 65536 && pb_membersize(DebugLinkState, node) < 65536 && pb_membersize(DebugLinkSigningStats, stats[0]) < 65536), YOU_MUST_DEFINE_PB_FIELD_32BIT_FOR_MESSAGES_Initialize_GetFeatures_Features_ClearSession_ApplySettings_ChangePin_Ping_Success_Failure_ButtonRequest_ButtonAck_PinMatrixRequest_PinMatrixAck_Cancel_PassphraseRequest_PassphraseAck_GetEntropy_Entropy_GetPublicKey_PublicKey_GetPublicKeys_PublicKeys_GetAddress_Address_GetAddresses_Addresses_WipeDevice_LoadDevice_ResetDevice_EntropyRequest_EntropyAck_RecoveryDevice_WordRequest_WordAck_CharacterRequest_CharacterAck_SignMessage_VerifyMessage_MessageSignature_EncryptMessage_EncryptedMessage_DecryptMessage_DecryptedMessage_CipherKeyValue_CipheredKeyValue_EstimateTxSize_TxSize_SignTx_SimpleSignTx_TxRequest_TxAck_RawTxAck_SignIdentity_SignedIdentity_FirmwareErase_FirmwareUpload_DebugLinkDecision_DebugLinkGetState_DebugLinkState_DebugLinkStop_DebugLinkLog_DebugLinkFillConfig_DebugLinkGetSigningStats_DebugLinkSigningStats)
 #endif
 
 #if !defined(PB_FIELD_16BIT) && !defined(PB_FIELD_32BIT)
@@ -28,6 +28,11 @@ const pb_field_t HDNodePathType_fields[3] = {
     PB_LAST_FIELD
 };
 
+const pb_field_t AddressPathType_fields[2] = {
+    PB_FIELD2(  1, UINT32  , REPEATED, STATIC  , FIRST, AddressPathType, address_n, address_n, 0),
+    PB_LAST_FIELD
+};
+
 const pb_field_t CoinType_fields[9] = {
     PB_FIELD2(  1, STRING  , OPTIONAL, STATIC  , FIRST, CoinType, coin_name, coin_name, 0),
     PB_FIELD2(  2, STRING  , OPTIONAL, STATIC  , OTHER, CoinType, coin_shortcut, coin_name, 0),
@@ -47,7 +52,7 @@ const pb_field_t MultisigRedeemScriptType_fields[4] = {
     PB_LAST_FIELD
 };
 
-const pb_field_t TxInputType_fields[8] = {
+const pb_field_t TxInputType_fields[9] = {
     PB_FIELD2(  1, UINT32  , REPEATED, STATIC  , FIRST, TxInputType, address_n, address_n, 0),
     PB_FIELD2(  2, BYTES   , REQUIRED, STATIC  , OTHER, TxInputType, prev_hash, address_n, 0),
     PB_FIELD2(  3, UINT32  , REQUIRED, STATIC  , OTHER, TxInputType, prev_index, prev_hash, 0),
@@ -55,6 +60,7 @@ const pb_field_t TxInputType_fields[8] = {
     PB_FIELD2(  5, UINT32  , OPTIONAL, STATIC  , OTHER, TxInputType, sequence, script_sig, &TxInputType_sequence_default),
     PB_FIELD2(  6, ENUM    , OPTIONAL, STATIC  , OTHER, TxInputType, script_type, sequence, &TxInputType_script_type_default),
     PB_FIELD2(  7, MESSAGE , OPTIONAL, STATIC  , OTHER, TxInputType, multisig, script_type, &MultisigRedeemScriptType_fields),
+    PB_FIELD2(  8, UINT64  , OPTIONAL, STATIC  , OTHER, TxInputType, amount, multisig, 0),
     PB_LAST_FIELD
 };
 
@@ -91,9 +97,10 @@ const pb_field_t RawTransactionType_fields[2] = {
     PB_LAST_FIELD
 };
 
-const pb_field_t TxRequestDetailsType_fields[3] = {
+const pb_field_t TxRequestDetailsType_fields[4] = {
     PB_FIELD2(  1, UINT32  , OPTIONAL, STATIC  , FIRST, TxRequestDetailsType, request_index, request_index, 0),
     PB_FIELD2(  2, BYTES   , OPTIONAL, STATIC  , OTHER, TxRequestDetailsType, tx_hash, request_index, 0),
+    PB_FIELD2(  5, UINT32  , OPTIONAL, STATIC  , OTHER, TxRequestDetailsType, request_count, tx_hash, 0),
     PB_LAST_FIELD
 };
 
@@ -114,6 +121,14 @@ const pb_field_t IdentityType_fields[7] = {
     PB_LAST_FIELD
 };
 
+const pb_field_t SigningStatType_fields[5] = {
+    PB_FIELD2(  1, STRING  , OPTIONAL, STATIC  , FIRST, SigningStatType, name, name, 0),
+    PB_FIELD2(  2, UINT32  , OPTIONAL, STATIC  , OTHER, SigningStatType, count, name, 0),
+    PB_FIELD2(  3, UINT64  , OPTIONAL, STATIC  , OTHER, SigningStatType, total, count, 0),
+    PB_FIELD2(  4, UINT32  , OPTIONAL, STATIC  , OTHER, SigningStatType, max, total, 0),
+    PB_LAST_FIELD
+};
+
 typedef struct {
     bool wire_in;
 } wire_in_struct;
@@ -176,7 +191,7 @@ const pb_extension_type_t wire_debug_out = {
  * numbers or field sizes that are larger than what can fit in 8 or 16 bit
  * field descriptors.
  */
-STATIC_ASSERT((pb_membersize(HDNodePathType, node) < 65536 && pb_membersize(MultisigRedeemScriptType, pubkeys[0]) < 65536 && pb_membersize(TxInputType, multisig) < 65536 && pb_membersize(TxOutputType, multisig) < 65536 && pb_membersize(TransactionType, inputs[0]) < 65536 && pb_membersize(TransactionType, bin_outputs[0]) < 65536 && pb_membersize(TransactionType, outputs[0]) < 65536), YOU_MUST_DEFINE_PB_FIELD_32BIT_FOR_MESSAGES_HDNodeType_HDNodePathType_CoinType_MultisigRedeemScriptType_TxInputType_TxOutputType_TxOutputBinType_TransactionType_RawTransactionType_TxRequestDetailsType_TxRequestSerializedType_IdentityType)
+STATIC_ASSERT((pb_membersize(HDNodePathType, node) < 65536 && pb_membersize(MultisigRedeemScriptType, pubkeys[0]) < 65536 && pb_membersize(TxInputType, multisig) < 65536 && pb_membersize(TxOutputType, multisig) < 65536 && pb_membersize(TransactionType, inputs[0]) < 65536 && pb_membersize(TransactionType, bin_outputs[0]) < 65536 && pb_membersize(TransactionType, outputs[0]) < 65536), YOU_MUST_DEFINE_PB_FIELD_32BIT_FOR_MESSAGES_HDNodeType_HDNodePathType_AddressPathType_CoinType_MultisigRedeemScriptType_TxInputType_TxOutputType_TxOutputBinType_TransactionType_RawTransactionType_TxRequestDetailsType_TxRequestSerializedType_IdentityType_SigningStatType)
 #endif
 
 #if !defined(PB_FIELD_16BIT) && !defined(PB_FIELD_32BIT)
@@ -27,7 +27,11 @@
 
 /* === Defines ============================================================= */
 
-/* The max size of a decoded protobuf */
+/* The max size of a decoded protobuf, host builds pad the structs more */
+#ifdef EMULATOR
+#define MAX_DECODE_SIZE (14 * 1024)
+#else
 #define MAX_DECODE_SIZE (12 * 1024)
+#endif
 
 #endif
@@ -65,12 +65,18 @@ typedef enum _MessageType {
     MessageType_MessageType_CharacterRequest = 80,
     MessageType_MessageType_CharacterAck = 81,
     MessageType_MessageType_RawTxAck = 82,
+    MessageType_MessageType_GetAddresses = 83,
+    MessageType_MessageType_Addresses = 84,
+    MessageType_MessageType_GetPublicKeys = 85,
+    MessageType_MessageType_PublicKeys = 86,
     MessageType_MessageType_DebugLinkDecision = 100,
     MessageType_MessageType_DebugLinkGetState = 101,
     MessageType_MessageType_DebugLinkState = 102,
     MessageType_MessageType_DebugLinkStop = 103,
     MessageType_MessageType_DebugLinkLog = 104,
-    MessageType_MessageType_DebugLinkFillConfig = 105
+    MessageType_MessageType_DebugLinkFillConfig = 105,
+    MessageType_MessageType_DebugLinkGetSigningStats = 106,
+    MessageType_MessageType_DebugLinkSigningStats = 107
 } MessageType;
 
 /* Struct definitions */
@@ -130,6 +136,11 @@ typedef struct _Address {
     char address[36];
 } Address;
 
+typedef struct _Addresses {
+    size_t address_count;
+    char address[20][36];
+} Addresses;
+
 typedef struct _ApplySettings {
     bool has_language;
     char language[17];
@@ -206,6 +217,11 @@ typedef struct _DebugLinkDecision {
     bool yes_no;
 } DebugLinkDecision;
 
+typedef struct _DebugLinkGetSigningStats {
+    bool has_clear;
+    bool clear;
+} DebugLinkGetSigningStats;
+
 typedef struct _DebugLinkLog {
     bool has_level;
     uint32_t level;
@@ -215,6 +231,13 @@ typedef struct _DebugLinkLog {
     char text[256];
 } DebugLinkLog;
 
+typedef struct _DebugLinkSigningStats {
+    bool has_clock_hz;
+    uint32_t clock_hz;
+    size_t stats_count;
+    SigningStatType stats[25];
+} DebugLinkSigningStats;
+
 typedef struct {
     size_t size;
     uint8_t bytes[1024];
@@ -457,6 +480,17 @@ typedef struct _GetAddress {
     MultisigRedeemScriptType multisig;
 } GetAddress;
 
+typedef struct _GetAddresses {
+    size_t address_n_count;
+    uint32_t address_n[8];
+    bool has_coin_name;
+    char coin_name[17];
+    bool has_start_index;
+    uint32_t start_index;
+    bool has_count;
+    uint32_t count;
+} GetAddresses;
+
 typedef struct _GetEntropy {
     uint32_t size;
 } GetEntropy;
@@ -470,6 +504,11 @@ typedef struct _GetPublicKey {
     bool show_display;
 } GetPublicKey;
 
+typedef struct _GetPublicKeys {
+    size_t paths_count;
+    AddressPathType paths[16];
+} GetPublicKeys;
+
 typedef struct _LoadDevice {
     bool has_mnemonic;
     char mnemonic[241];
@@ -529,6 +568,11 @@ typedef struct _PublicKey {
     char xpub[113];
 } PublicKey;
 
+typedef struct _PublicKeys {
+    size_t public_keys_count;
+    PublicKey public_keys[16];
+} PublicKeys;
+
 typedef struct _RawTxAck {
     bool has_tx;
     RawTransactionType tx;
@@ -683,6 +727,7 @@ typedef struct _WordAck {
 
 /* Default values for struct fields */
 extern const char GetAddress_coin_name_default[17];
+extern const char GetAddresses_coin_name_default[17];
 extern const char LoadDevice_language_default[17];
 extern const uint32_t ResetDevice_strength_default;
 extern const char ResetDevice_language_default[17];
@@ -715,8 +760,12 @@ extern const char SimpleSignTx_coin_name_default[17];
 #define Entropy_init_default                     {{0, {0}}}
 #define GetPublicKey_init_default                {0, {0, 0, 0, 0, 0, 0, 0, 0}, false, "", false, 0}
 #define PublicKey_init_default                   {HDNodeType_init_default, false, ""}
+#define GetPublicKeys_init_default               {0, {AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default, AddressPathType_init_default}}
+#define PublicKeys_init_default                  {0, {PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default, PublicKey_init_default}}
 #define GetAddress_init_default                  {0, {0, 0, 0, 0, 0, 0, 0, 0}, false, "Bitcoin", false, 0, false, MultisigRedeemScriptType_init_default}
 #define Address_init_default                     {""}
+#define GetAddresses_init_default                {0, {0, 0, 0, 0, 0, 0, 0, 0}, false, "Bitcoin", false, 0, false, 0}
+#define Addresses_init_default                   {0, {"", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "", ""}}
 #define WipeDevice_init_default                  {0}
 #define LoadDevice_init_default                  {false, "", false, HDNodeType_init_default, false, "", false, 0, false, "english", false, "", false, 0}
 #define ResetDevice_init_default                 {false, 0, false, 256u, false, 0, false, 0, false, "english", false, ""}
@@ -753,6 +802,8 @@ extern const char SimpleSignTx_coin_name_default[17];
 #define DebugLinkStop_init_default               {0}
 #define DebugLinkLog_init_default                {false, 0, false, "", false, ""}
 #define DebugLinkFillConfig_init_default         {0}
+#define DebugLinkGetSigningStats_init_default    {false, 0}
+#define DebugLinkSigningStats_init_default       {false, 0, 0, {SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default, SigningStatType_init_default}}
 #define Initialize_init_zero                     {0}
 #define GetFeatures_init_zero                    {0}
 #define Features_init_zero                       {false, "", false, 0, false, 0, false, 0, false, 0, false, "", false, 0, false, 0, false, "", false, "", 0, {CoinType_init_zero, CoinType_init_zero, CoinType_init_zero, CoinType_init_zero, CoinType_init_zero, CoinType_init_zero, CoinType_init_zero}, false, 0, false, {0, {0}}, false, {0, {0}}, false, 0, false, 0, false, 0}
@@ -773,8 +824,12 @@ extern const char SimpleSignTx_coin_name_default[17];
 #define Entropy_init_zero                        {{0, {0}}}
 #define GetPublicKey_init_zero                   {0, {0, 0, 0, 0, 0, 0, 0, 0}, false, "", false, 0}
 #define PublicKey_init_zero                      {HDNodeType_init_zero, false, ""}
+#define GetPublicKeys_init_zero                  {0, {AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero, AddressPathType_init_zero}}
+#define PublicKeys_init_zero                     {0, {PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero, PublicKey_init_zero}}
 #define GetAddress_init_zero                     {0, {0, 0, 0, 0, 0, 0, 0, 0}, false, "", false, 0, false, MultisigRedeemScriptType_init_zero}
 #define Address_init_zero                        {""}
+#define GetAddresses_init_zero                   {0, {0, 0, 0, 0, 0, 0, 0, 0}, false, "", false, 0, false, 0}
+#define Addresses_init_zero                      {0, {"", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "", ""}}
 #define WipeDevice_init_zero                     {0}
 #define LoadDevice_init_zero                     {false, "", false, HDNodeType_init_zero, false, "", false, 0, false, "", false, "", false, 0}
 #define ResetDevice_init_zero                    {false, 0, false, 0, false, 0, false, 0, false, "", false, ""}
@@ -811,9 +866,12 @@ extern const char SimpleSignTx_coin_name_default[17];
 #define DebugLinkStop_init_zero                  {0}
 #define DebugLinkLog_init_zero                   {false, 0, false, "", false, ""}
 #define DebugLinkFillConfig_init_zero            {0}
+#define DebugLinkGetSigningStats_init_zero       {false, 0}
+#define DebugLinkSigningStats_init_zero          {false, 0, 0, {SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero, SigningStatType_init_zero}}
 
 /* Field tags (for use in manual encoding/decoding) */
 #define Address_address_tag                      1
+#define Addresses_address_tag                    1
 #define ApplySettings_language_tag               1
 #define ApplySettings_label_tag                  2
 #define ApplySettings_use_passphrase_tag         3
@@ -837,6 +895,9 @@ extern const char SimpleSignTx_coin_name_default[17];
 #define DebugLinkLog_level_tag                   1
 #define DebugLinkLog_bucket_tag                  2
 #define DebugLinkLog_text_tag                    3
+#define DebugLinkGetSigningStats_clear_tag       1
+#define DebugLinkSigningStats_clock_hz_tag       1
+#define DebugLinkSigningStats_stats_tag          2
 #define DebugLinkState_layout_tag                1
 #define DebugLinkState_pin_tag                   2
 #define DebugLinkState_matrix_tag                3
@@ -895,10 +956,15 @@ extern const char SimpleSignTx_coin_name_default[17];
 #define GetAddress_coin_name_tag                 2
 #define GetAddress_show_display_tag              3
 #define GetAddress_multisig_tag                  4
+#define GetAddresses_address_n_tag               1
+#define GetAddresses_coin_name_tag               2
+#define GetAddresses_start_index_tag             3
+#define GetAddresses_count_tag                   4
 #define GetEntropy_size_tag                      1
 #define GetPublicKey_address_n_tag               1
 #define GetPublicKey_ecdsa_curve_name_tag        2
 #define GetPublicKey_show_display_tag            3
+#define GetPublicKeys_paths_tag                  1
 #define LoadDevice_mnemonic_tag                  1
 #define LoadDevice_node_tag                      2
 #define LoadDevice_pin_tag                       3
@@ -917,6 +983,7 @@ extern const char SimpleSignTx_coin_name_default[17];
 #define Ping_passphrase_protection_tag           4
 #define PublicKey_node_tag                       1
 #define PublicKey_xpub_tag                       2
+#define PublicKeys_public_keys_tag               1
 #define RawTxAck_tx_tag                          1
 #define RecoveryDevice_word_count_tag            1
 #define RecoveryDevice_passphrase_protection_tag 2
@@ -981,8 +1048,12 @@ extern const pb_field_t GetEntropy_fields[2];
 extern const pb_field_t Entropy_fields[2];
 extern const pb_field_t GetPublicKey_fields[4];
 extern const pb_field_t PublicKey_fields[3];
+extern const pb_field_t GetPublicKeys_fields[2];
+extern const pb_field_t PublicKeys_fields[2];
 extern const pb_field_t GetAddress_fields[5];
 extern const pb_field_t Address_fields[2];
+extern const pb_field_t GetAddresses_fields[5];
+extern const pb_field_t Addresses_fields[2];
 extern const pb_field_t WipeDevice_fields[1];
 extern const pb_field_t LoadDevice_fields[8];
 extern const pb_field_t ResetDevice_fields[7];
@@ -1019,6 +1090,8 @@ extern const pb_field_t DebugLinkState_fields[15];
 extern const pb_field_t DebugLinkStop_fields[1];
 extern const pb_field_t DebugLinkLog_fields[4];
 extern const pb_field_t DebugLinkFillConfig_fields[1];
+extern const pb_field_t DebugLinkGetSigningStats_fields[2];
+extern const pb_field_t DebugLinkSigningStats_fields[3];
 
 /* Maximum encoded size of messages (where known) */
 #define Initialize_size                          0
@@ -1041,8 +1114,12 @@ extern const pb_field_t DebugLinkFillConfig_fields[1];
 #define Entropy_size                             1027
 #define GetPublicKey_size                        84
 #define PublicKey_size                           (121 + HDNodeType_size)
+#define GetPublicKeys_size                       800
+#define PublicKeys_size                          (48 + 16*PublicKey_size)
 #define GetAddress_size                          (75 + MultisigRedeemScriptType_size)
 #define Address_size                             38
+#define GetAddresses_size                        79
+#define Addresses_size                           760
 #define WipeDevice_size                          0
 #define LoadDevice_size                          (320 + HDNodeType_size)
 #define ResetDevice_size                         66
@@ -1079,6 +1156,8 @@ extern const pb_field_t DebugLinkFillConfig_fields[1];
 #define DebugLinkStop_size                       0
 #define DebugLinkLog_size                        300
 #define DebugLinkFillConfig_size                 0
+#define DebugLinkGetSigningStats_size            2
+#define DebugLinkSigningStats_size               (56 + 25*SigningStatType_size)
 
 #ifdef __cplusplus
 } /* extern "C" */
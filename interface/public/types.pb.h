@@ -34,7 +34,9 @@ typedef enum _OutputScriptType {
 
 typedef enum _InputScriptType {
     InputScriptType_SPENDADDRESS = 0,
-    InputScriptType_SPENDMULTISIG = 1
+    InputScriptType_SPENDMULTISIG = 1,
+    InputScriptType_SPENDWITNESS = 3,
+    InputScriptType_SPENDP2SHWITNESS = 4
 } InputScriptType;
 
 typedef enum _RequestType {
@@ -88,6 +90,11 @@ typedef enum _PinMatrixRequestType {
 } PinMatrixRequestType;
 
 /* Struct definitions */
+typedef struct _AddressPathType {
+    size_t address_n_count;
+    uint32_t address_n[8];
+} AddressPathType;
+
 typedef struct _CoinType {
     bool has_coin_name;
     char coin_name[17];
@@ -157,6 +164,17 @@ typedef struct _RawTransactionType {
     RawTransactionType_payload_t payload;
 } RawTransactionType;
 
+typedef struct _SigningStatType {
+    bool has_name;
+    char name[24];
+    bool has_count;
+    uint32_t count;
+    bool has_total;
+    uint64_t total;
+    bool has_max;
+    uint32_t max;
+} SigningStatType;
+
 typedef struct {
     size_t size;
     uint8_t bytes[520];
@@ -177,6 +195,8 @@ typedef struct _TxRequestDetailsType {
     uint32_t request_index;
     bool has_tx_hash;
     TxRequestDetailsType_tx_hash_t tx_hash;
+    bool has_request_count;
+    uint32_t request_count;
 } TxRequestDetailsType;
 
 typedef struct {
@@ -241,6 +261,8 @@ typedef struct _TxInputType {
     InputScriptType script_type;
     bool has_multisig;
     MultisigRedeemScriptType multisig;
+    bool has_amount;
+    uint64_t amount;
 } TxInputType;
 
 typedef struct {
@@ -269,7 +291,7 @@ typedef struct _TransactionType {
     size_t inputs_count;
     TxInputType inputs[1];
     size_t bin_outputs_count;
-    TxOutputBinType bin_outputs[1];
+    TxOutputBinType bin_outputs[5];
     bool has_lock_time;
     uint32_t lock_time;
     size_t outputs_count;
@@ -298,30 +320,35 @@ extern const uint32_t IdentityType_index_default;
 /* Initializer values for message structs */
 #define HDNodeType_init_default                  {0, 0, 0, {0, {0}}, false, {0, {0}}, false, {0, {0}}}
 #define HDNodePathType_init_default              {HDNodeType_init_default, 0, {0, 0, 0, 0, 0, 0, 0, 0}}
+#define AddressPathType_init_default             {0, {0, 0, 0, 0, 0, 0, 0, 0}}
 #define CoinType_init_default                    {false, "", false, "", false, 0u, false, 0, false, 5u, false, 6u, false, 10u, false, ""}
 #define MultisigRedeemScriptType_init_default    {0, {HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default, HDNodePathType_init_default}, 0, {{0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}}, false, 0}
-#define TxInputType_init_default                 {0, {0, 0, 0, 0, 0, 0, 0, 0}, {0, {0}}, 0, false, {0, {0}}, false, 4294967295u, false, InputScriptType_SPENDADDRESS, false, MultisigRedeemScriptType_init_default}
+#define TxInputType_init_default                 {0, {0, 0, 0, 0, 0, 0, 0, 0}, {0, {0}}, 0, false, {0, {0}}, false, 4294967295u, false, InputScriptType_SPENDADDRESS, false, MultisigRedeemScriptType_init_default, false, 0}
 #define TxOutputType_init_default                {false, "", 0, {0, 0, 0, 0, 0, 0, 0, 0}, 0, (OutputScriptType)0, false, MultisigRedeemScriptType_init_default, false, {0, {0}}, false, (OutputAddressType)0}
 #define TxOutputBinType_init_default             {0, {0, {0}}}
-#define TransactionType_init_default             {false, 0, 0, {TxInputType_init_default}, 0, {TxOutputBinType_init_default}, false, 0, 0, {TxOutputType_init_default}, false, 0, false, 0}
+#define TransactionType_init_default             {false, 0, 0, {TxInputType_init_default}, 0, {TxOutputBinType_init_default, TxOutputBinType_init_default, TxOutputBinType_init_default, TxOutputBinType_init_default, TxOutputBinType_init_default}, false, 0, 0, {TxOutputType_init_default}, false, 0, false, 0}
 #define RawTransactionType_init_default          {{0, {0}}}
-#define TxRequestDetailsType_init_default        {false, 0, false, {0, {0}}}
+#define TxRequestDetailsType_init_default        {false, 0, false, {0, {0}}, false, 0}
 #define TxRequestSerializedType_init_default     {false, 0, false, {0, {0}}, false, {0, {0}}}
 #define IdentityType_init_default                {false, "", false, "", false, "", false, "", false, "", false, 0u}
+#define SigningStatType_init_default             {false, "", false, 0, false, 0, false, 0}
 #define HDNodeType_init_zero                     {0, 0, 0, {0, {0}}, false, {0, {0}}, false, {0, {0}}}
 #define HDNodePathType_init_zero                 {HDNodeType_init_zero, 0, {0, 0, 0, 0, 0, 0, 0, 0}}
+#define AddressPathType_init_zero                {0, {0, 0, 0, 0, 0, 0, 0, 0}}
 #define CoinType_init_zero                       {false, "", false, "", false, 0, false, 0, false, 0, false, 0, false, 0, false, ""}
 #define MultisigRedeemScriptType_init_zero       {0, {HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero, HDNodePathType_init_zero}, 0, {{0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}, {0, {0}}}, false, 0}
-#define TxInputType_init_zero                    {0, {0, 0, 0, 0, 0, 0, 0, 0}, {0, {0}}, 0, false, {0, {0}}, false, 0, false, (InputScriptType)0, false, MultisigRedeemScriptType_init_zero}
+#define TxInputType_init_zero                    {0, {0, 0, 0, 0, 0, 0, 0, 0}, {0, {0}}, 0, false, {0, {0}}, false, 0, false, (InputScriptType)0, false, MultisigRedeemScriptType_init_zero, false, 0}
 #define TxOutputType_init_zero                   {false, "", 0, {0, 0, 0, 0, 0, 0, 0, 0}, 0, (OutputScriptType)0, false, MultisigRedeemScriptType_init_zero, false, {0, {0}}, false, (OutputAddressType)0}
 #define TxOutputBinType_init_zero                {0, {0, {0}}}
-#define TransactionType_init_zero                {false, 0, 0, {TxInputType_init_zero}, 0, {TxOutputBinType_init_zero}, false, 0, 0, {TxOutputType_init_zero}, false, 0, false, 0}
+#define TransactionType_init_zero                {false, 0, 0, {TxInputType_init_zero}, 0, {TxOutputBinType_init_zero, TxOutputBinType_init_zero, TxOutputBinType_init_zero, TxOutputBinType_init_zero, TxOutputBinType_init_zero}, false, 0, 0, {TxOutputType_init_zero}, false, 0, false, 0}
 #define RawTransactionType_init_zero             {{0, {0}}}
-#define TxRequestDetailsType_init_zero           {false, 0, false, {0, {0}}}
+#define TxRequestDetailsType_init_zero           {false, 0, false, {0, {0}}, false, 0}
 #define TxRequestSerializedType_init_zero        {false, 0, false, {0, {0}}, false, {0, {0}}}
 #define IdentityType_init_zero                   {false, "", false, "", false, "", false, "", false, "", false, 0}
+#define SigningStatType_init_zero                {false, "", false, 0, false, 0, false, 0}
 
 /* Field tags (for use in manual encoding/decoding) */
+#define AddressPathType_address_n_tag            1
 #define CoinType_coin_name_tag                   1
 #define CoinType_coin_shortcut_tag               2
 #define CoinType_address_type_tag                3
@@ -342,11 +369,16 @@ extern const uint32_t IdentityType_index_default;
 #define IdentityType_port_tag                    4
 #define IdentityType_path_tag                    5
 #define IdentityType_index_tag                   6
+#define SigningStatType_name_tag                 1
+#define SigningStatType_count_tag                2
+#define SigningStatType_total_tag                3
+#define SigningStatType_max_tag                  4
 #define RawTransactionType_payload_tag           1
 #define TxOutputBinType_amount_tag               1
 #define TxOutputBinType_script_pubkey_tag        2
 #define TxRequestDetailsType_request_index_tag   1
 #define TxRequestDetailsType_tx_hash_tag         2
+#define TxRequestDetailsType_request_count_tag   5
 #define TxRequestSerializedType_signature_index_tag 1
 #define TxRequestSerializedType_signature_tag    2
 #define TxRequestSerializedType_serialized_tx_tag 3
@@ -362,6 +394,7 @@ extern const uint32_t IdentityType_index_default;
 #define TxInputType_sequence_tag                 5
 #define TxInputType_script_type_tag              6
 #define TxInputType_multisig_tag                 7
+#define TxInputType_amount_tag                   8
 #define TxOutputType_address_tag                 1
 #define TxOutputType_address_n_tag               2
 #define TxOutputType_amount_tag                  3
@@ -384,30 +417,34 @@ extern const uint32_t IdentityType_index_default;
 /* Struct field encoding specification for nanopb */
 extern const pb_field_t HDNodeType_fields[7];
 extern const pb_field_t HDNodePathType_fields[3];
+extern const pb_field_t AddressPathType_fields[2];
 extern const pb_field_t CoinType_fields[9];
 extern const pb_field_t MultisigRedeemScriptType_fields[4];
-extern const pb_field_t TxInputType_fields[8];
+extern const pb_field_t TxInputType_fields[9];
 extern const pb_field_t TxOutputType_fields[8];
 extern const pb_field_t TxOutputBinType_fields[3];
 extern const pb_field_t TransactionType_fields[8];
 extern const pb_field_t RawTransactionType_fields[2];
-extern const pb_field_t TxRequestDetailsType_fields[3];
+extern const pb_field_t TxRequestDetailsType_fields[4];
 extern const pb_field_t TxRequestSerializedType_fields[4];
 extern const pb_field_t IdentityType_fields[7];
+extern const pb_field_t SigningStatType_fields[5];
 
 /* Maximum encoded size of messages (where known) */
 #define HDNodeType_size                          121
 #define HDNodePathType_size                      171
+#define AddressPathType_size                     48
 #define CoinType_size                            99
 #define MultisigRedeemScriptType_size            3741
-#define TxInputType_size                         5497
+#define TxInputType_size                         5508
 #define TxOutputType_size                        3935
 #define TxOutputBinType_size                     534
-#define TransactionType_size                     9999
+#define TransactionType_size                     12158
 #define RawTransactionType_size                  2
-#define TxRequestDetailsType_size                40
+#define TxRequestDetailsType_size                46
 #define TxRequestSerializedType_size             2132
 #define IdentityType_size                        416
+#define SigningStatType_size                     48
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -32,6 +32,137 @@
 #include "coins.h"
 #include "crypto.h"
 
+/* === Defines ============================================================= */
+
+/* Cosigner sets remembered for the signing session */
+#define MULTISIG_CACHE_SIZE	4
+
+/* Cosigner chain nodes, the parents of the addresses derived from them */
+#define XPUB_CACHE_SIZE		8
+
+/* === Private Variables =================================================== */
+
+/* Derived pubkeys and fingerprint of a cosigner set */
+typedef struct {
+	bool set, has_pubkeys, has_fingerprint;
+	uint32_t last_use;
+	uint8_t id[32];			/* hash of m and the cosigner nodes and paths */
+	uint8_t pubkeys[15][33];	/* in redeem script order */
+	uint8_t fingerprint[32];
+} MultisigCacheEntry;
+
+/* Public node derived from a cosigner xpub, kept as an affine point */
+typedef struct {
+	bool set, has_node;
+	uint32_t last_use;
+	uint8_t id[32];			/* hash of the xpub and the path prefix */
+	uint8_t chain_code[32];
+	curve_point pub;
+} XpubCacheEntry;
+
+static MultisigCacheEntry multisig_cache[MULTISIG_CACHE_SIZE];
+static uint32_t multisig_cache_uses;
+
+static XpubCacheEntry xpub_cache[XPUB_CACHE_SIZE];
+static uint32_t xpub_cache_uses;
+
+/* === Private Functions =================================================== */
+
+/*
+ * multisig_cache_entry() - Find the cache entry of a cosigner set, replacing
+ * the least recently used one if it is not cached yet
+ *
+ * INPUT
+ *     - multisig: multisig redeem script info
+ * OUTPUT
+ *     cache entry, possibly still empty
+ */
+static MultisigCacheEntry *multisig_cache_entry(const MultisigRedeemScriptType *multisig)
+{
+	MultisigCacheEntry *entry = &multisig_cache[0];
+	uint8_t id[32];
+	uint32_t i, n = multisig->pubkeys_count;
+	SHA256_CTX ctx;
+
+	/* Signatures are left out, they are filled in while signing */
+	sha256_Init(&ctx);
+	sha256_Update(&ctx, (const uint8_t *)&(multisig->m), sizeof(uint32_t));
+	sha256_Update(&ctx, (const uint8_t *)&n, sizeof(uint32_t));
+	for (i = 0; i < n; i++) {
+		const HDNodePathType *path = &(multisig->pubkeys[i]);
+		uint32_t count = path->address_n_count;
+		sha256_Update(&ctx, (const uint8_t *)&(path->node.depth), sizeof(uint32_t));
+		sha256_Update(&ctx, (const uint8_t *)&(path->node.fingerprint), sizeof(uint32_t));
+		sha256_Update(&ctx, (const uint8_t *)&(path->node.child_num), sizeof(uint32_t));
+		sha256_Update(&ctx, path->node.chain_code.bytes, path->node.chain_code.size);
+		sha256_Update(&ctx, path->node.public_key.bytes, path->node.public_key.size);
+		sha256_Update(&ctx, (const uint8_t *)&count, sizeof(uint32_t));
+		sha256_Update(&ctx, (const uint8_t *)path->address_n, count * sizeof(uint32_t));
+	}
+	sha256_Final(id, &ctx);
+
+	multisig_cache_uses++;
+	for (i = 0; i < MULTISIG_CACHE_SIZE; i++) {
+		if (multisig_cache[i].set && memcmp(multisig_cache[i].id, id, 32) == 0) {
+			multisig_cache[i].last_use = multisig_cache_uses;
+			return &multisig_cache[i];
+		}
+		if (!multisig_cache[i].set ||
+		    (entry->set && multisig_cache[i].last_use < entry->last_use)) {
+			entry = &multisig_cache[i];
+		}
+	}
+
+	memset(entry, 0, sizeof(MultisigCacheEntry));
+	entry->set = true;
+	entry->last_use = multisig_cache_uses;
+	memcpy(entry->id, id, 32);
+	return entry;
+}
+
+/*
+ * xpub_cache_entry() - Find the cache entry of the parent of a cosigner
+ * path, replacing the least recently used one if it is not cached yet
+ *
+ * INPUT
+ *     - hdnodepath: cosigner xpub and path, at least one level deep
+ * OUTPUT
+ *     cache entry, possibly still empty
+ */
+static XpubCacheEntry *xpub_cache_entry(const HDNodePathType *hdnodepath)
+{
+	XpubCacheEntry *entry = &xpub_cache[0];
+	uint8_t id[32];
+	uint32_t i, prefix = hdnodepath->address_n_count - 1;
+	SHA256_CTX ctx;
+
+	/* The derived node only depends on the xpub key, its chain code and the path */
+	sha256_Init(&ctx);
+	sha256_Update(&ctx, hdnodepath->node.public_key.bytes, 33);
+	sha256_Update(&ctx, hdnodepath->node.chain_code.bytes, 32);
+	sha256_Update(&ctx, (const uint8_t *)&prefix, sizeof(uint32_t));
+	sha256_Update(&ctx, (const uint8_t *)hdnodepath->address_n, prefix * sizeof(uint32_t));
+	sha256_Final(id, &ctx);
+
+	xpub_cache_uses++;
+	for (i = 0; i < XPUB_CACHE_SIZE; i++) {
+		if (xpub_cache[i].set && memcmp(xpub_cache[i].id, id, 32) == 0) {
+			xpub_cache[i].last_use = xpub_cache_uses;
+			return &xpub_cache[i];
+		}
+		if (!xpub_cache[i].set ||
+		    (entry->set && xpub_cache[i].last_use < entry->last_use)) {
+			entry = &xpub_cache[i];
+		}
+	}
+
+	memset(entry, 0, sizeof(XpubCacheEntry));
+	entry->set = true;
+	entry->last_use = xpub_cache_uses;
+	memcpy(entry->id, id, 32);
+	return entry;
+}
+
 /* === Functions =========================================================== */
 
 uint32_t ser_length(uint32_t len, uint8_t *out)
@@ -288,26 +419,89 @@ uint8_t *cryptoHDNodePathToPubkey(const HDNodePathType *hdnodepath)
 {
 	if (!hdnodepath->node.has_public_key || hdnodepath->node.public_key.size != 33) return 0;
 	static HDNode node;
-	if (hdnode_from_xpub(hdnodepath->node.depth, hdnodepath->node.fingerprint, hdnodepath->node.child_num, hdnodepath->node.chain_code.bytes, hdnodepath->node.public_key.bytes, &node) == 0) {
-		return 0;
+	curve_point pub;
+	uint32_t i = 0;
+	// the parent of the address is shared by all addresses on its chain
+	XpubCacheEntry *entry = NULL;
+	if (hdnodepath->address_n_count > 0 && hdnodepath->node.chain_code.size == 32) {
+		entry = xpub_cache_entry(hdnodepath);
 	}
-	animating_progress_handler();
-	uint32_t i;
-	for (i = 0; i < hdnodepath->address_n_count; i++) {
-		if (hdnode_public_ckd(&node, hdnodepath->address_n[i]) == 0) {
+	if (entry && entry->has_node) {
+		memcpy(node.chain_code, entry->chain_code, 32);
+		memcpy(&pub, &(entry->pub), sizeof(curve_point));
+		i = hdnodepath->address_n_count - 1;
+	} else {
+		if (hdnode_from_xpub(hdnodepath->node.depth, hdnodepath->node.fingerprint, hdnodepath->node.child_num, hdnodepath->node.chain_code.bytes, hdnodepath->node.public_key.bytes, &node) == 0) {
+			if (entry) entry->set = false;
+			return 0;
+		}
+		// decompress once and carry the affine point through the chain
+		if (!ecdsa_read_pubkey(&secp256k1, node.public_key, &pub)) {
+			if (entry) entry->set = false;
+			return 0;
+		}
+		animating_progress_handler();
+	}
+	for (; i < hdnodepath->address_n_count; i++) {
+		if (entry && !entry->has_node && i == hdnodepath->address_n_count - 1) {
+			memcpy(entry->chain_code, node.chain_code, 32);
+			memcpy(&(entry->pub), &pub, sizeof(curve_point));
+			entry->has_node = true;
+		}
+		if (hdnode_public_ckd_cp(&secp256k1, &pub, node.chain_code, hdnodepath->address_n[i], &pub, node.chain_code) == 0) {
 			return 0;
 		}
 		animating_progress_handler();
 	}
+	node.public_key[0] = 0x02 | (pub.y.val[0] & 0x01);
+	bn_write_be(&pub.x, node.public_key + 1);
 	return node.public_key;
 }
 
+// derived pubkeys of all cosigners in redeem script order, 33 bytes each
+const uint8_t *cryptoMultisigPubkeys(const MultisigRedeemScriptType *multisig)
+{
+	const uint32_t n = multisig->pubkeys_count;
+	if (n < 1 || n > 15) {
+		return 0;
+	}
+	MultisigCacheEntry *entry = multisig_cache_entry(multisig);
+	if (!entry->has_pubkeys) {
+		uint32_t i;
+		for (i = 0; i < n; i++) {
+			const uint8_t *pubkey = cryptoHDNodePathToPubkey(&(multisig->pubkeys[i]));
+			if (!pubkey) {
+				entry->set = false;
+				return 0;
+			}
+			memcpy(entry->pubkeys[i], pubkey, 33);
+		}
+		entry->has_pubkeys = true;
+	}
+	return entry->pubkeys[0];
+}
+
+void cryptoMultisigCacheClear(void)
+{
+	memset(multisig_cache, 0, sizeof(multisig_cache));
+	multisig_cache_uses = 0;
+}
+
+void cryptoXpubCacheClear(void)
+{
+	memset(xpub_cache, 0, sizeof(xpub_cache));
+	xpub_cache_uses = 0;
+}
+
 int cryptoMultisigPubkeyIndex(const MultisigRedeemScriptType *multisig, const uint8_t *pubkey)
 {
+	const uint8_t *pubkeys = cryptoMultisigPubkeys(multisig);
 	size_t i;
+	if (!pubkeys) {
+		return -1;
+	}
 	for (i = 0; i < multisig->pubkeys_count; i++) {
-		const uint8_t *node_pubkey = cryptoHDNodePathToPubkey(&(multisig->pubkeys[i]));
-		if (node_pubkey && memcmp(node_pubkey, pubkey, 33) == 0) {
+		if (memcmp(pubkeys + i * 33, pubkey, 33) == 0) {
 			return i;
 		}
 	}
@@ -329,6 +523,11 @@ int cryptoMultisigFingerprint(const MultisigRedeemScriptType *multisig, uint8_t
 		if (!ptr[i]->node.has_public_key || ptr[i]->node.public_key.size != 33) return 0;
 		if (ptr[i]->node.chain_code.size != 32) return 0;
 	}
+	MultisigCacheEntry *entry = multisig_cache_entry(multisig);
+	if (entry->has_fingerprint) {
+		memcpy(hash, entry->fingerprint, 32);
+		return 1;
+	}
 	// minsort according to pubkey
 	for (i = 0; i < n - 1; i++) {
 		for (j = n - 1; j > i; j--) {
@@ -352,6 +551,8 @@ int cryptoMultisigFingerprint(const MultisigRedeemScriptType *multisig, uint8_t
 	}
 	sha256_Update(&ctx, (const uint8_t *)&n, sizeof(uint32_t));
 	sha256_Final(hash, &ctx);
+	memcpy(entry->fingerprint, hash, 32);
+	entry->has_fingerprint = true;
 	animating_progress_handler();
 	return 1;
 }
@@ -55,6 +55,7 @@
 #include "reset.h"
 #include "recovery.h"
 #include "recovery_cipher.h"
+#include "node_cache.h"
 
 /* === Private Variables =================================================== */
 
@@ -72,6 +73,7 @@ static const MessagesMap_t MessagesMap[] =
     MSG_IN(MessageType_MessageType_FirmwareUpload,      FirmwareUpload_fields, (void (*)(void *))fsm_msgFirmwareUpload)
     MSG_IN(MessageType_MessageType_GetEntropy,          GetEntropy_fields, (void (*)(void *))fsm_msgGetEntropy)
     MSG_IN(MessageType_MessageType_GetPublicKey,        GetPublicKey_fields, (void (*)(void *))fsm_msgGetPublicKey)
+    MSG_IN(MessageType_MessageType_GetPublicKeys,       GetPublicKeys_fields, (void (*)(void *))fsm_msgGetPublicKeys)
     MSG_IN(MessageType_MessageType_LoadDevice,          LoadDevice_fields, (void (*)(void *))fsm_msgLoadDevice)
     MSG_IN(MessageType_MessageType_ResetDevice,         ResetDevice_fields, (void (*)(void *))fsm_msgResetDevice)
     MSG_IN(MessageType_MessageType_SignTx,              SignTx_fields, (void (*)(void *))fsm_msgSignTx)
@@ -83,6 +85,7 @@ static const MessagesMap_t MessagesMap[] =
     MSG_IN(MessageType_MessageType_ApplySettings,       ApplySettings_fields, (void (*)(void *))fsm_msgApplySettings)
     MSG_IN(MessageType_MessageType_ButtonAck,           ButtonAck_fields,           NO_PROCESS_FUNC)
     MSG_IN(MessageType_MessageType_GetAddress,          GetAddress_fields, (void (*)(void *))fsm_msgGetAddress)
+    MSG_IN(MessageType_MessageType_GetAddresses,        GetAddresses_fields, (void (*)(void *))fsm_msgGetAddresses)
     MSG_IN(MessageType_MessageType_EntropyAck,          EntropyAck_fields, (void (*)(void *))fsm_msgEntropyAck)
     MSG_IN(MessageType_MessageType_SignMessage,         SignMessage_fields, (void (*)(void *))fsm_msgSignMessage)
     MSG_IN(MessageType_MessageType_SignIdentity,        SignIdentity_fields, (void (*)(void *))fsm_msgSignIdentity)
@@ -103,12 +106,14 @@ static const MessagesMap_t MessagesMap[] =
     MSG_OUT(MessageType_MessageType_Failure,            Failure_fields,             NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_Entropy,            Entropy_fields,             NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_PublicKey,          PublicKey_fields,           NO_PROCESS_FUNC)
+    MSG_OUT(MessageType_MessageType_PublicKeys,         PublicKeys_fields,          NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_Features,           Features_fields,            NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_PinMatrixRequest,   PinMatrixRequest_fields,    NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_TxRequest,          TxRequest_fields,           NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_CipheredKeyValue,   CipheredKeyValue_fields,    NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_ButtonRequest,      ButtonRequest_fields,       NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_Address,            Address_fields,             NO_PROCESS_FUNC)
+    MSG_OUT(MessageType_MessageType_Addresses,          Addresses_fields,           NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_EntropyRequest,     EntropyRequest_fields,      NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_MessageSignature,   MessageSignature_fields,    NO_PROCESS_FUNC)
     MSG_OUT(MessageType_MessageType_SignedIdentity,     SignedIdentity_fields,      NO_PROCESS_FUNC)
@@ -124,10 +129,12 @@ static const MessagesMap_t MessagesMap[] =
     DEBUG_IN(MessageType_MessageType_DebugLinkDecision, DebugLinkDecision_fields,   NO_PROCESS_FUNC)
     DEBUG_IN(MessageType_MessageType_DebugLinkGetState, DebugLinkGetState_fields, (void (*)(void *))fsm_msgDebugLinkGetState)
     DEBUG_IN(MessageType_MessageType_DebugLinkStop,     DebugLinkStop_fields, (void (*)(void *))fsm_msgDebugLinkStop)
+    DEBUG_IN(MessageType_MessageType_DebugLinkGetSigningStats, DebugLinkGetSigningStats_fields, (void (*)(void *))fsm_msgDebugLinkGetSigningStats)
 
     /* Debug Out Messages */
     DEBUG_OUT(MessageType_MessageType_DebugLinkState, DebugLinkState_fields,        NO_PROCESS_FUNC)
     DEBUG_OUT(MessageType_MessageType_DebugLinkLog, DebugLinkLog_fields,            NO_PROCESS_FUNC)
+    DEBUG_OUT(MessageType_MessageType_DebugLinkSigningStats, DebugLinkSigningStats_fields, NO_PROCESS_FUNC)
 #endif
 };
 
@@ -213,6 +220,8 @@ const CoinType *fsm_getCoin(const char *name)
 const HDNode *fsm_getDerivedNode(uint32_t *address_n, size_t address_n_count)
 {
     static HDNode node;
+    HDNode account;
+    size_t account_depth;
 
     if(!storage_get_root_node(&node))
     {
@@ -227,6 +236,44 @@ const HDNode *fsm_getDerivedNode(uint32_t *address_n, size_t address_n_count)
         return &node;
     }
 
+    /* The account prefix of BIP44 style paths is kept in the persistent node cache */
+    account_depth = node_cache_account_depth(address_n, address_n_count);
+
+    if(account_depth > 0)
+    {
+        if(!node_cache_get(&node, address_n, account_depth, &account))
+        {
+            memcpy(&account, &node, sizeof(HDNode));
+
+            if(hdnode_private_ckd_lazy(&account, address_n, account_depth, true) == 0)
+            {
+                memset(&account, 0, sizeof(account));
+                fsm_sendFailure(FailureType_Failure_Other, "Failed to derive private key");
+                go_home();
+                return 0;
+            }
+
+            node_cache_set(&node, address_n, account_depth, &account);
+        }
+
+        memcpy(&node, &account, sizeof(HDNode));
+        memset(&account, 0, sizeof(account));
+
+        /*
+         * The shared derivation cache is keyed by the root node that signing
+         * derives from, starting it from the account node would flush it
+         */
+        if(hdnode_private_ckd_lazy(&node, address_n + account_depth,
+                                   address_n_count - account_depth, true) == 0)
+        {
+            fsm_sendFailure(FailureType_Failure_Other, "Failed to derive private key");
+            go_home();
+            return 0;
+        }
+
+        return &node;
+    }
+
     if(hdnode_private_ckd_cached(&node, address_n, address_n_count) == 0)
     {
         fsm_sendFailure(FailureType_Failure_Other, "Failed to derive private key");
@@ -541,6 +588,100 @@ void fsm_msgGetPublicKey(GetPublicKey *msg)
     go_home();
 }
 
+void fsm_msgGetPublicKeys(GetPublicKeys *msg)
+{
+    /* nodes[d] is the node at depth d of the previously derived path */
+    static HDNode nodes[sizeof(msg->paths[0].address_n) / sizeof(msg->paths[0].address_n[0]) + 1];
+    const uint32_t *prev_path = NULL;
+    size_t prev_count = 0, shared, d, j;
+
+    RESP_INIT(PublicKeys);
+
+    if(!storage_is_initialized())
+    {
+        fsm_sendFailure(FailureType_Failure_NotInitialized, "Device not initialized");
+        return;
+    }
+
+    if(!pin_protect_cached())
+    {
+        go_home();
+        return;
+    }
+
+    if(!storage_get_root_node(&nodes[0]))
+    {
+        fsm_sendFailure(FailureType_Failure_NotInitialized,
+                        "Device not initialized or passphrase request cancelled");
+        go_home();
+        return;
+    }
+
+    for(j = 0; j < msg->paths_count; j++)
+    {
+        const uint32_t *path = msg->paths[j].address_n;
+        const size_t count = msg->paths[j].address_n_count;
+
+        /* Reuse the prefix shared with the previous path, e.g. m/44'/coin' */
+        for(shared = 0; shared < prev_count && shared < count && prev_path[shared] == path[shared];
+                shared++) {}
+
+        /* Intermediate nodes carry no fingerprint, so always redo the last step */
+        if(shared == count && count > 0)
+        {
+            shared--;
+        }
+
+        for(d = shared; d < count; d++)
+        {
+            /* Keep the parent public key around for the siblings that follow */
+            if(nodes[d].public_key[0] == 0 && (!(path[d] & 0x80000000) || d + 1 == count))
+            {
+                hdnode_fill_public_key(&nodes[d]);
+            }
+
+            memcpy(&nodes[d + 1], &nodes[d], sizeof(HDNode));
+
+            if(hdnode_private_ckd_step(&nodes[d + 1], path[d], d + 1 == count) == 0)
+            {
+                memset(nodes, 0, sizeof(nodes));
+                fsm_sendFailure(FailureType_Failure_Other, "Failed to derive private key");
+                go_home();
+                return;
+            }
+        }
+
+        prev_path = path;
+        prev_count = count;
+
+        HDNode *node = &nodes[count];
+
+        if(node->public_key[0] == 0)
+        {
+            hdnode_fill_public_key(node);
+        }
+
+        PublicKey *pub = &resp->public_keys[j];
+        pub->node.depth = node->depth;
+        pub->node.fingerprint = node->fingerprint;
+        pub->node.child_num = node->child_num;
+        pub->node.chain_code.size = 32;
+        memcpy(pub->node.chain_code.bytes, node->chain_code, 32);
+        pub->node.has_private_key = false;
+        pub->node.has_public_key = true;
+        pub->node.public_key.size = 33;
+        memcpy(pub->node.public_key.bytes, node->public_key, 33);
+        pub->has_xpub = true;
+        hdnode_serialize_public(node, pub->xpub, sizeof(pub->xpub));
+    }
+
+    resp->public_keys_count = msg->paths_count;
+
+    memset(nodes, 0, sizeof(nodes));
+    msg_write(MessageType_MessageType_PublicKeys, resp);
+    go_home();
+}
+
 void fsm_msgLoadDevice(LoadDevice *msg)
 {
     if(storage_is_initialized())
@@ -660,29 +801,41 @@ void fsm_msgTxAck(TxAck *msg)
 
 void fsm_msgRawTxAck(RawMessage *msg, uint32_t frame_length)
 {
-    static RawMessageState msg_state = RAW_MESSAGE_NOT_STARTED;
-    static uint32_t msg_offset = 0, skip = 0;
+    static RawFieldStream stream;
+    static uint32_t msg_offset = 0;
+    RawField field;
 
     /* Start raw transaction */
-    if(msg_state == RAW_MESSAGE_NOT_STARTED)
+    if(msg_offset == 0)
     {
-        msg_state = RAW_MESSAGE_STARTED;
-        skip = parse_pb_varint(msg, RAW_TX_ACK_VARINT_COUNT);
+        raw_field_init(&stream);
     }
 
-    /* Parse raw transaction */
-    if(msg_state == RAW_MESSAGE_STARTED)
+    msg_offset += msg->length;
+
+    /* The transaction is parsed straight from the report as it arrives */
+    while(raw_field_next(&stream, msg, &field))
     {
-        msg_offset += msg->length;
+        if(field.depth == 0 && field.number == RawTxAck_tx_tag)
+        {
+            raw_field_enter(&stream);
+        }
+        else if(field.depth == 1 && field.number == RawTransactionType_payload_tag &&
+                field.len > 0)
+        {
+            parse_raw_txack(field.data, field.len);
+        }
+    }
 
-        parse_raw_txack(msg->buffer, msg->length);
+    /* Finish raw transaction */
+    if(msg_offset >= frame_length)
+    {
+        msg_offset = 0;
 
-        /* Finish raw transaction */
-        if(msg_offset >= frame_length - skip)
+        if(raw_field_failed(&stream))
         {
-            msg_offset = 0;
-            skip = 0;
-            msg_state = RAW_MESSAGE_NOT_STARTED;
+            fsm_sendFailure(FailureType_Failure_SyntaxError, "Malformed transaction");
+            signing_abort();
         }
     }
 }
@@ -944,6 +1097,62 @@ void fsm_msgGetAddress(GetAddress *msg)
     go_home();
 }
 
+void fsm_msgGetAddresses(GetAddresses *msg)
+{
+    RESP_INIT(Addresses);
+
+    const size_t max_count = sizeof(resp->address) / sizeof(resp->address[0]);
+    uint8_t public_keys[sizeof(resp->address) / sizeof(resp->address[0])][33];
+    uint32_t start_index = msg->has_start_index ? msg->start_index : 0;
+    uint32_t i;
+
+    if(!storage_is_initialized())
+    {
+        fsm_sendFailure(FailureType_Failure_NotInitialized, "Device not initialized");
+        return;
+    }
+
+    if(!msg->has_count || msg->count == 0 || msg->count > max_count)
+    {
+        fsm_sendFailure(FailureType_Failure_Other, "Invalid address count");
+        go_home();
+        return;
+    }
+
+    if(!pin_protect_cached())
+    {
+        go_home();
+        return;
+    }
+
+    const CoinType *coin = fsm_getCoin(msg->coin_name);
+
+    if(!coin) { return; }
+
+    const HDNode *node = fsm_getDerivedNode(msg->address_n, msg->address_n_count);
+
+    if(!node) { return; }
+
+    /* Derive all children of the account node in one go, no confirmation on display */
+    if(!hdnode_private_ckd_public_batch(node, start_index, msg->count, public_keys))
+    {
+        fsm_sendFailure(FailureType_Failure_Other, "Failed to derive addresses");
+        go_home();
+        return;
+    }
+
+    for(i = 0; i < msg->count; i++)
+    {
+        ecdsa_get_address(public_keys[i], coin->address_type, resp->address[i],
+                          sizeof(resp->address[i]));
+    }
+
+    resp->address_count = msg->count;
+
+    msg_write(MessageType_MessageType_Addresses, resp);
+    go_home();
+}
+
 void fsm_msgEntropyAck(EntropyAck *msg)
 {
     if(msg->has_entropy)
@@ -1476,4 +1685,17 @@ void fsm_msgDebugLinkStop(DebugLinkStop *msg)
 {
     (void)msg;
 }
+
+void fsm_msgDebugLinkGetSigningStats(DebugLinkGetSigningStats *msg)
+{
+    RESP_INIT(DebugLinkSigningStats);
+
+    signing_get_stats(resp);
+    msg_debug_write(MessageType_MessageType_DebugLinkSigningStats, resp);
+
+    if(msg->has_clear && msg->clear)
+    {
+        signing_clear_stats();
+    }
+}
 #endif
@@ -0,0 +1,319 @@
+/*
+ * This file is part of the KeepKey project.
+ *
+ * Copyright (C) 2016 KeepKey LLC
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* === Includes ============================================================ */
+
+#include <string.h>
+
+#include <libopencm3/stm32/flash.h>
+
+#include <aes.h>
+#include <hmac.h>
+#include <keepkey_flash.h>
+#include <memory.h>
+#include <rng.h>
+
+#include "node_cache.h"
+
+/* === Defines ============================================================= */
+
+#define NODE_CACHE_RECORDS      (FLASH_NODE_CACHE_LEN / sizeof(NodeCacheRecord))
+#define NODE_CACHE_KEY_SALT     "KeepKey node cache"
+
+#define PURPOSE_BIP44           (0x80000000 | 44)
+#define PURPOSE_BIP49           (0x80000000 | 49)
+#define PURPOSE_BIP84           (0x80000000 | 84)
+
+/* === Private Variables =================================================== */
+
+_Static_assert(sizeof(HDNode) <= sizeof(((NodeCacheRecord *)NULL)->payload),
+               "HDNode is too large for node cache record");
+_Static_assert(sizeof(NodeCacheRecord) % sizeof(uint32_t) == 0,
+               "Node cache record must be word aligned");
+
+static const NodeCacheRecord *const node_cache = (const NodeCacheRecord *)FLASH_NODE_CACHE_START;
+
+/* === Private Functions =================================================== */
+
+/*
+ * node_cache_keys() - Derive encryption and authentication keys for a root node
+ *
+ * INPUT
+ *     - root: root node the cached nodes were derived from
+ *     - keys: 32 byte AES key followed by 32 byte HMAC key
+ * OUTPUT
+ *     none
+ */
+static void node_cache_keys(const HDNode *root, uint8_t keys[64])
+{
+    uint8_t msg[sizeof(NODE_CACHE_KEY_SALT) - 1 + 32];
+
+    memcpy(msg, NODE_CACHE_KEY_SALT, sizeof(NODE_CACHE_KEY_SALT) - 1);
+    memcpy(msg + sizeof(NODE_CACHE_KEY_SALT) - 1, root->chain_code, 32);
+    hmac_sha512(root->private_key, 32, msg, sizeof(msg), keys);
+}
+
+/*
+ * node_cache_path_id() - Compute lookup id of a path under a root's HMAC key
+ *
+ * INPUT
+ *     - mac_key: 32 byte HMAC key
+ *     - address_n: path of node
+ *     - address_n_count: depth of path
+ *     - id: buffer for the record id
+ * OUTPUT
+ *     none
+ */
+static void node_cache_path_id(const uint8_t *mac_key, const uint32_t *address_n,
+                               size_t address_n_count, uint8_t id[12])
+{
+    uint8_t path[(1 + NODE_CACHE_MAX_DEPTH) * sizeof(uint32_t)];
+    uint8_t hash[32];
+    uint32_t count = address_n_count;
+
+    memcpy(path, &count, sizeof(uint32_t));
+    memcpy(path + sizeof(uint32_t), address_n, address_n_count * sizeof(uint32_t));
+    hmac_sha256(mac_key, 32, path, (1 + address_n_count) * sizeof(uint32_t), hash);
+    memcpy(id, hash, 12);
+}
+
+/*
+ * node_cache_record_mac() - Authenticate id, iv and payload of a record
+ *
+ * INPUT
+ *     - mac_key: 32 byte HMAC key
+ *     - record: record to authenticate
+ *     - mac: buffer for truncated HMAC
+ * OUTPUT
+ *     none
+ */
+static void node_cache_record_mac(const uint8_t *mac_key, const NodeCacheRecord *record,
+                                  uint8_t mac[16])
+{
+    uint8_t hash[32];
+
+    hmac_sha256(mac_key, 32, record->id,
+                sizeof(record->id) + sizeof(record->iv) + sizeof(record->payload), hash);
+    memcpy(mac, hash, 16);
+}
+
+/*
+ * node_cache_slot_is_free() - Whether a record slot is still fully erased
+ *
+ * INPUT
+ *     - record: record slot in flash
+ * OUTPUT
+ *     true/false whether slot can be programmed
+ */
+static bool node_cache_slot_is_free(const NodeCacheRecord *record)
+{
+    const uint32_t *word = (const uint32_t *)record;
+
+    for(size_t i = 0; i < sizeof(NodeCacheRecord) / sizeof(uint32_t); i++)
+    {
+        if(word[i] != 0xFFFFFFFF)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* === Functions =========================================================== */
+
+/*
+ * node_cache_account_depth() - Levels of a path that belong in the node cache
+ *
+ * Only the hardened purpose'/coin'/account' prefix of BIP44 style paths is
+ * cached.  Identity, cipher and other paths never reach flash.
+ *
+ * INPUT
+ *     - address_n: path of node
+ *     - address_n_count: depth of path
+ * OUTPUT
+ *     number of leading levels to look up in the cache, 0 for none
+ */
+size_t node_cache_account_depth(const uint32_t *address_n, size_t address_n_count)
+{
+    size_t depth = 0;
+
+    if(address_n_count == 0 || (address_n[0] != PURPOSE_BIP44 &&
+                                address_n[0] != PURPOSE_BIP49 && address_n[0] != PURPOSE_BIP84))
+    {
+        return 0;
+    }
+
+    while(depth < address_n_count && depth < NODE_CACHE_MAX_DEPTH &&
+            (address_n[depth] & 0x80000000))
+    {
+        depth++;
+    }
+
+    return depth;
+}
+
+/*
+ * node_cache_get() - Look up a derived node in the flash node cache
+ *
+ * INPUT
+ *     - root: root node the path is derived from
+ *     - address_n: path of node
+ *     - address_n_count: depth of path
+ *     - node: where to put the cached node
+ * OUTPUT
+ *     true/false whether node was found
+ */
+bool node_cache_get(const HDNode *root, const uint32_t *address_n, size_t address_n_count,
+                    HDNode *node)
+{
+    uint8_t keys[64], id[12], mac[16], iv[16], plain[sizeof(((NodeCacheRecord *)NULL)->payload)];
+    aes_decrypt_ctx ctx;
+    bool found = false;
+
+    if(address_n_count == 0 || address_n_count > NODE_CACHE_MAX_DEPTH)
+    {
+        return false;
+    }
+
+    node_cache_keys(root, keys);
+    node_cache_path_id(keys + 32, address_n, address_n_count, id);
+
+    for(size_t i = 0; i < NODE_CACHE_RECORDS && !node_cache_slot_is_free(&node_cache[i]); i++)
+    {
+        const NodeCacheRecord *record = &node_cache[i];
+
+        if(record->magic != NODE_CACHE_MAGIC || memcmp(record->id, id, sizeof(id)) != 0)
+        {
+            continue;
+        }
+
+        node_cache_record_mac(keys + 32, record, mac);
+
+        if(memcmp(record->mac, mac, sizeof(mac)) != 0)
+        {
+            continue;
+        }
+
+        memcpy(iv, record->iv, sizeof(iv));
+        aes_decrypt_key256(keys, &ctx);
+        aes_cbc_decrypt(record->payload, plain, sizeof(plain), iv, &ctx);
+        memcpy(node, plain, sizeof(HDNode));
+        found = true;
+        break;
+    }
+
+    memset(keys, 0, sizeof(keys));
+    memset(plain, 0, sizeof(plain));
+    memset(&ctx, 0, sizeof(ctx));
+    return found;
+}
+
+/*
+ * node_cache_set() - Append a derived node to the flash node cache
+ *
+ * INPUT
+ *     - root: root node the path is derived from
+ *     - address_n: path of node
+ *     - address_n_count: depth of path
+ *     - node: derived node to cache
+ * OUTPUT
+ *     none
+ */
+void node_cache_set(const HDNode *root, const uint32_t *address_n, size_t address_n_count,
+                    const HDNode *node)
+{
+    uint8_t keys[64], iv[16], plain[sizeof(((NodeCacheRecord *)NULL)->payload)];
+    NodeCacheRecord record;
+    aes_encrypt_ctx ctx;
+    size_t slot;
+
+    if(address_n_count == 0 || address_n_count > NODE_CACHE_MAX_DEPTH)
+    {
+        return;
+    }
+
+    node_cache_keys(root, keys);
+
+    record.magic = NODE_CACHE_MAGIC;
+    node_cache_path_id(keys + 32, address_n, address_n_count, record.id);
+    random_buffer(record.iv, sizeof(record.iv));
+
+    memset(plain, 0, sizeof(plain));
+    memcpy(plain, node, sizeof(HDNode));
+    memcpy(iv, record.iv, sizeof(iv));
+    aes_encrypt_key256(keys, &ctx);
+    aes_cbc_encrypt(plain, record.payload, sizeof(plain), iv, &ctx);
+
+    node_cache_record_mac(keys + 32, &record, record.mac);
+
+    memset(keys, 0, sizeof(keys));
+    memset(plain, 0, sizeof(plain));
+    memset(&ctx, 0, sizeof(ctx));
+
+    /* Append after the last record, skipping slots left half written by a power loss */
+    for(slot = 0; slot < NODE_CACHE_RECORDS; slot++)
+    {
+        if(node_cache_slot_is_free(&node_cache[slot]))
+        {
+            break;
+        }
+    }
+
+    flash_unlock();
+
+    /* Sector is full, start over */
+    if(slot == NODE_CACHE_RECORDS)
+    {
+        flash_erase_word(FLASH_NODE_CACHE);
+        slot = 0;
+    }
+
+    /* Load record body first, magic last so an interrupted write is never valid */
+    if(flash_write_word(FLASH_NODE_CACHE, slot * sizeof(NodeCacheRecord) + sizeof(uint32_t),
+                        sizeof(NodeCacheRecord) - sizeof(uint32_t),
+                        (uint8_t *)&record + sizeof(uint32_t)))
+    {
+        flash_write_word(FLASH_NODE_CACHE, slot * sizeof(NodeCacheRecord), sizeof(uint32_t),
+                         (uint8_t *)&record);
+    }
+
+    flash_lock();
+}
+
+/*
+ * node_cache_clear() - Erase the flash node cache
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+void node_cache_clear(void)
+{
+    /* Records are appended from the start, so an erased first slot means an empty cache */
+    if(node_cache_slot_is_free(&node_cache[0]))
+    {
+        return;
+    }
+
+    flash_unlock();
+    flash_erase_word(FLASH_NODE_CACHE);
+    flash_lock();
+}
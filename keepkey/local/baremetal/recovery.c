@@ -144,18 +144,7 @@ void recovery_word(const char *word)
     } else { // real word
         if (enforce_wordlist) 
         { // check if word is valid
-            const char * const *wl = mnemonic_wordlist();
-            bool found = false;
-            while (*wl) 
-            {
-                if (strcmp(word, *wl) == 0) 
-                {
-                    found = true;
-                    break;
-                }
-                wl++;
-            }
-            if (!found) 
+            if (mnemonic_find_word(word) < 0)
             {
                 storage_reset();
                 fsm_sendFailure(FailureType_Failure_SyntaxError, "Word not found in a wordlist");
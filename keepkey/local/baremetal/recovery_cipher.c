@@ -50,7 +50,6 @@ static char auto_completed_word[CURRENT_WORD_BUF];
 static void format_current_word(char *current_word, bool auto_completed);
 static uint32_t get_current_word_pos(void);
 static void get_current_word(char *current_word);
-static bool exact_str_match(const char *str1, const char *str2, uint32_t len);
 static bool attempt_auto_complete(char *partial_word);
 
 /* === Private Functions =================================================== */
@@ -140,36 +139,6 @@ static void get_current_word(char *current_word)
     }
 }
 
-/*
- * exact_str_match() - Determines if two strings are exact matches for length passed
- * (does not stop at null termination)
- *
- * INPUT
- *     - str1: first string
- *     - str2: second string
- *     - len: length to compare string for match
- * OUTPUT
- *     true/false whether matched or not
- */
-static bool exact_str_match(const char *str1, const char *str2, uint32_t len)
-{
-    uint32_t i = 0, match = 0;
-
-    for(; i < len && i < CURRENT_WORD_BUF; i++)
-    {
-        if(str1[i] == str2[i])
-        {
-            match++;
-        }
-        else
-        {
-            match--;
-        }
-    }
-
-    return match == len;
-}
-
 /*
  * attempt_auto_complete() - Attempts to auto complete a partial word
  *
@@ -181,37 +150,24 @@ static bool exact_str_match(const char *str1, const char *str2, uint32_t len)
 static bool attempt_auto_complete(char *partial_word)
 {
     const char *const *wordlist = mnemonic_wordlist();
+    int match, found;
 
-    uint32_t partial_word_len = strlen(partial_word), i = 0, match = 0, found = 0;
+    /* Words starting with partial word, an exact match sorts first */
+    found = mnemonic_find_prefix(partial_word, &match);
 
-    for(; wordlist[i] != 0; i++)
+    if(match == 0)
     {
-        /* Check for match including null termination */
-        if(exact_str_match(partial_word, wordlist[i], partial_word_len + 1))
-        {
-            strlcpy(partial_word, wordlist[i], CURRENT_WORD_BUF);
-            goto matched;
-        }
-        /* Check for match for just characters of partial word */
-        else if(exact_str_match(partial_word, wordlist[i], partial_word_len))
-        {
-            match++;
-            found = i;
-        }
+        return false;
     }
 
     /* Autocomplete if we can */
-    if(match == 1)
+    if(match == 1 || strcmp(partial_word, wordlist[found]) == 0)
     {
         strlcpy(partial_word, wordlist[found], CURRENT_WORD_BUF);
-    }
-    else
-    {
-        return false;
+        return true;
     }
 
-matched:
-    return true;
+    return false;
 }
 
 /* === Functions =========================================================== */
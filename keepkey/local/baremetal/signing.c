@@ -19,12 +19,15 @@
 
 /* === Includes ============================================================ */
 
+#include <stdio.h>
+
 #include <msg_dispatch.h>
 #include <ecdsa.h>
 #include <secp256k1.h>
 #include <crypto.h>
 #include <layout.h>
 #include <confirm_sm.h>
+#include <timer.h>
 
 #include "crypto.h"
 #include "signing.h"
@@ -34,8 +37,82 @@
 #include "home_sm.h"
 #include "app_confirm.h"
 
+/* === Defines ============================================================= */
+
+/* RAM for the prevouts, input commitments and compiled outputs of linear signing */
+#define SIGNING_CACHE_SIZE	(8 * 1024)
+
+/* Longest script a raw previous transaction may carry, Bitcoin's MAX_SCRIPT_SIZE */
+#define RAW_TX_MAX_SCRIPT	10000
+
+/* Verified previous outputs remembered until the session ends */
+#define PREVTX_CACHE_SIZE	32
+
+/* Inputs whose keys and nonces are prepared while the user confirms */
+#define PRECOMPUTE_INPUTS	8
+
+/* Telemetry: host round trip and TxAck processing time of each stage,
+ * followed by the major operations */
+#define SIGNING_STAGES		(STAGE_REQUEST_SEGWIT_WITNESS + 1)
+#define STAT_WAIT		0
+#define STAT_WORK		SIGNING_STAGES
+#define STAT_RAW_TX		(2 * SIGNING_STAGES)
+#define STAT_DERIVE		(STAT_RAW_TX + 1)
+#define STAT_SIGN		(STAT_RAW_TX + 2)
+#define STAT_CONFIRM		(STAT_RAW_TX + 3)
+#define STAT_IDLE		(STAT_RAW_TX + 4)
+#define SIGNING_STATS		(STAT_RAW_TX + 5)
+
+/* Items of each kind one TxAck can carry */
+#define TXACK_MAX_INPUTS	(sizeof(((TransactionType *)NULL)->inputs) / sizeof(TxInputType))
+#define TXACK_MAX_OUTPUTS	(sizeof(((TransactionType *)NULL)->outputs) / sizeof(TxOutputType))
+#define TXACK_MAX_BIN_OUTPUTS	(sizeof(((TransactionType *)NULL)->bin_outputs) / sizeof(TxOutputBinType))
+
+/* Most one item adds to serialized_tx, with tx header and footer */
+#define CHUNK_MAX_INPUT(script_len)	(4 + 2 + 5 + 32 + 4 + 3 + (script_len) + 4 + 4)
+#define CHUNK_MAX_WITNESS	(1 + 1 + 73 + 1 + 1 + 33 + 4)
+#define CHUNK_MAX_OUTPUT	(8 + 3 + sizeof(((TxOutputBinType *)NULL)->script_pubkey.bytes) + 4)
+
 /* === Private Variables =================================================== */
 
+/* What phase 2 of linear signing needs to rebuild an input's sighash */
+typedef struct {
+	uint8_t prevout[36];	/* serialized previous tx hash and index */
+	uint32_t sequence;
+} SigningInputCache;
+
+/* Durations in get_timestamp() ticks */
+typedef struct {
+	uint32_t count;
+	uint64_t total;
+	uint32_t max;
+} SigningStat;
+
+/* Amount of a previous output whose transaction has been verified */
+typedef struct {
+	bool set;
+	uint8_t prev_hash[32];
+	uint32_t prev_index;
+	uint64_t amount;
+} PrevTxCacheEntry;
+
+/* Input key, sighash and nonce prepared ahead of phase 2 */
+typedef struct {
+	bool set;		/* input received in phase 1 */
+	bool has_key, has_digest, has_nonce;
+	bool nonce_tried;	/* has_nonce is final */
+	uint32_t address_n[8];
+	size_t address_n_count;
+	InputScriptType script_type;
+	uint64_t amount;
+	uint8_t prevout[36];
+	uint32_t sequence;
+	uint8_t privkey[32], pubkey[33];
+	uint8_t digest[32];	/* sighash k was generated for */
+	bignum256 k;
+	curve_point R;
+} PrecomputedInput;
+
 static uint32_t inputs_count;
 static uint32_t outputs_count;
 static const CoinType *coin;
@@ -48,10 +125,36 @@ static TxInputType input;
 static TxOutputBinType bin_output;
 static TxStruct to, tp, ti;
 static SHA256_CTX tc;
-static uint8_t hash[32], hash_check[32], privkey[32], pubkey[33], sig[64];
+static uint8_t hash[32], hash_check[32], hash_inputs_check[32], privkey[32], pubkey[33], sig[64];
 static uint64_t to_spend, spending, change_spend;
 static bool multisig_fp_set, multisig_fp_mismatch;
 static uint8_t multisig_fp[32];
+static bool linear, outputs_cached;
+static uint32_t hashed_inputs, output_cache_start, output_cache_len;
+static SHA256_CTX linear_prefix;
+static SHA256_CTX hashers[3];
+static uint8_t hash_prevouts[32], hash_sequence[32], hash_outputs[32];
+static uint64_t input_spend_start, segwit_to_spend;
+static union {
+	SigningInputCache inputs[SIGNING_CACHE_SIZE / sizeof(SigningInputCache)];
+	uint8_t bytes[SIGNING_CACHE_SIZE];
+} signing_cache;
+
+static PrevTxCacheEntry prevtx_cache[PREVTX_CACHE_SIZE];
+static uint32_t prevtx_cache_next;
+
+/* Last request sent and the TxAck items answering it */
+static RequestType batch_type;
+static TxRequestDetailsType batch_request;
+static TransactionType *batch_tx;
+static uint32_t batch_items, batch_pos;
+static bool batch_next;
+
+static PrecomputedInput precomputed[PRECOMPUTE_INPUTS];
+static bool outputs_checked;
+static uint32_t idle_end, idle_ticks;
+
+_Static_assert(sizeof(TxAck) <= MAX_DECODE_SIZE, "TxAck does not fit the decode buffer");
 
 /* === Variables =========================================================== */
 
@@ -63,22 +166,39 @@ enum {
 	STAGE_REQUEST_3_OUTPUT,
 	STAGE_REQUEST_4_INPUT,
 	STAGE_REQUEST_4_OUTPUT,
-	STAGE_REQUEST_5_OUTPUT
+	STAGE_REQUEST_4_SIGN_INPUT,
+	STAGE_REQUEST_5_OUTPUT,
+	STAGE_REQUEST_SEGWIT_WITNESS
 } signing_stage;
 const uint32_t version = 1;
 const uint32_t lock_time = 0;
 
+static SigningStat signing_stats[SIGNING_STATS];
+static uint32_t request_time;
+static bool request_pending;
+
 enum {
 	NOT_PARSING,
 	PARSING_VERSION,
 	PARSING_INPUT_COUNT,
-	PARSING_INPUTS,
+	PARSING_INPUT_PREVOUT,
+	PARSING_INPUT_SCRIPT_LEN,
+	PARSING_INPUT_SCRIPT,
 	PARSING_OUTPUT_COUNT,
-	PARSING_OUTPUTS_VALUE,
-	PARSING_OUTPUTS,
+	PARSING_OUTPUT_VALUE,
+	PARSING_OUTPUT_SCRIPT_LEN,
+	PARSING_OUTPUT_SCRIPT,
 	PARSING_LOCKTIME
 } raw_tx_status;
 
+/* Field of the raw previous transaction being parsed, kept across chunks */
+static struct {
+	uint32_t left;		/* bytes left of the field or skipped span */
+	uint32_t seen;		/* inputs or outputs parsed so far */
+	uint8_t field[9];	/* bytes of a field straddling chunks */
+	uint8_t field_len;
+} raw_tx;
+
 /* === Private Functions =================================================== */
 
 /*
@@ -105,24 +225,929 @@ static bool check_valid_output_address(TxOutputType *tx_out)
 
             break;
 
-        case OutputAddressType_TRANSFER:
-        case OutputAddressType_CHANGE:
-            if(tx_out->address_n_count > 0)
-            {
-                /* valid address type */
-                ret_val = true;
-            }
+        case OutputAddressType_TRANSFER:
+        case OutputAddressType_CHANGE:
+            if(tx_out->address_n_count > 0)
+            {
+                /* valid address type */
+                ret_val = true;
+            }
+
+            break;
+    }
+
+    return(ret_val);
+}
+
+/*
+ * raw_tx_start() - Start the next field or skipped span of the raw transaction
+ *
+ * INPUT
+ *     - status: parsing state of the field
+ *     - len: size of the field, 0 for a varint
+ * OUTPUT
+ *     none
+ */
+static void raw_tx_start(int status, uint32_t len)
+{
+	raw_tx_status = status;
+	raw_tx.left = len;
+	raw_tx.field_len = 0;
+}
+
+/*
+ * raw_tx_skip() - Skip over the current span of the raw transaction
+ *
+ * INPUT
+ *     - pos: position in chunk, advanced past the skipped bytes
+ *     - end: end of chunk
+ * OUTPUT
+ *     true/false whether the span is complete
+ */
+static bool raw_tx_skip(const uint8_t **pos, const uint8_t *end)
+{
+	uint32_t n = (uint32_t)(end - *pos) < raw_tx.left ? (uint32_t)(end - *pos) : raw_tx.left;
+
+	raw_tx.left -= n;
+	*pos += n;
+	return raw_tx.left == 0;
+}
+
+/*
+ * raw_tx_read() - Collect the current fixed size field of the raw transaction
+ *
+ * INPUT
+ *     - pos: position in chunk, advanced past the consumed bytes
+ *     - end: end of chunk
+ * OUTPUT
+ *     true/false whether raw_tx.field holds the complete field
+ */
+static bool raw_tx_read(const uint8_t **pos, const uint8_t *end)
+{
+	uint32_t n = (uint32_t)(end - *pos) < raw_tx.left ? (uint32_t)(end - *pos) : raw_tx.left;
+
+	memcpy(raw_tx.field + raw_tx.field_len, *pos, n);
+	raw_tx.field_len += n;
+	return raw_tx_skip(pos, end);
+}
+
+/*
+ * raw_tx_read_varint() - Collect the current varint of the raw transaction
+ *
+ * INPUT
+ *     - pos: position in chunk, advanced past the consumed bytes
+ *     - end: end of chunk
+ *     - value: where to put the varint once complete
+ * OUTPUT
+ *     true/false whether the varint is complete
+ */
+static bool raw_tx_read_varint(const uint8_t **pos, const uint8_t *end, uint32_t *value)
+{
+	/* The first byte tells how long the varint is */
+	if (raw_tx.field_len == 0) {
+		raw_tx.left = **pos < 253 ? 1 : **pos == 253 ? 3 : **pos == 254 ? 5 : 9;
+	}
+
+	if (!raw_tx_read(pos, end)) {
+		return false;
+	}
+
+	deser_length(raw_tx.field, value);
+	return true;
+}
+
+/*
+ * stat_add() - Account for an operation that started at start
+ *
+ * INPUT
+ *     - id: STAT_ index
+ *     - start: get_timestamp() when the operation started
+ * OUTPUT
+ *     none
+ */
+static void stat_add(uint32_t id, uint32_t start)
+{
+	/* Wraps correctly for durations up to 2^32 ticks, 35 s at full clock */
+	uint32_t ticks = get_timestamp() - start;
+	SigningStat *stat = &signing_stats[id];
+
+	stat->count++;
+	stat->total += ticks;
+	if (ticks > stat->max) {
+		stat->max = ticks;
+	}
+}
+
+static void request_sent(void)
+{
+	request_time = get_timestamp();
+	request_pending = true;
+}
+
+static void request_answered(void)
+{
+	if (request_pending) {
+		stat_add(STAT_WAIT + signing_stage, request_time);
+		request_pending = false;
+	}
+}
+
+static bool is_segwit_input(const TxInputType *txinput)
+{
+	return txinput->script_type == InputScriptType_SPENDWITNESS ||
+	       txinput->script_type == InputScriptType_SPENDP2SHWITNESS;
+}
+
+/*
+ * serialize_prevout() - Serialize the previous output an input spends
+ *
+ * INPUT
+ *     - txinput: input
+ *     - out: 36 byte buffer
+ * OUTPUT
+ *     none
+ */
+static void serialize_prevout(const TxInputType *txinput, uint8_t *out)
+{
+	int i;
+
+	for (i = 0; i < 32; i++) {
+		out[i] = txinput->prev_hash.bytes[31 - i];
+	}
+	memcpy(out + 32, &txinput->prev_index, 4);
+}
+
+/*
+ * init_checksum() - Start the transaction checksum over the fields sent in
+ * SignTx, before the inputs are added
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+static void init_checksum(void)
+{
+	sha256_Init(&tc);
+	sha256_Update(&tc, (const uint8_t *)&inputs_count, sizeof(inputs_count));
+	sha256_Update(&tc, (const uint8_t *)&outputs_count, sizeof(outputs_count));
+	sha256_Update(&tc, (const uint8_t *)&version, sizeof(version));
+	sha256_Update(&tc, (const uint8_t *)&lock_time, sizeof(lock_time));
+}
+
+/*
+ * input_hash_at() - Where the phase 1 hash of an input is kept, after the
+ * prevouts of all inputs
+ *
+ * INPUT
+ *     - index: input index, below hashed_inputs
+ * OUTPUT
+ *     pointer to 32 byte hash
+ */
+static uint8_t *input_hash_at(uint32_t index)
+{
+	return signing_cache.bytes + inputs_count * sizeof(SigningInputCache) + index * 32;
+}
+
+/*
+ * cache_input() - Commit to an input received in phase 1 for linear signing
+ *
+ * INPUT
+ *     - txinput: input as sent by the host
+ * OUTPUT
+ *     none
+ */
+static void cache_input(const TxInputType *txinput)
+{
+	SigningInputCache *entry = &signing_cache.inputs[idx1];
+
+	if (idx1 < hashed_inputs) {
+		sha256_Raw((const uint8_t *)txinput, sizeof(TxInputType), input_hash_at(idx1));
+	}
+	serialize_prevout(txinput, entry->prevout);
+	entry->sequence = txinput->sequence;
+}
+
+/*
+ * check_cached_input() - Compare input idx1 sent in phase 2 with its hash
+ * kept in phase 1
+ *
+ * INPUT
+ *     - txinput: input as sent by the host
+ * OUTPUT
+ *     true/false whether input is unchanged, failure has been sent otherwise
+ */
+static bool check_cached_input(const TxInputType *txinput)
+{
+	sha256_Raw((const uint8_t *)txinput, sizeof(TxInputType), hash);
+	if (memcmp(hash, input_hash_at(idx1), 32) != 0) {
+		fsm_sendFailure(FailureType_Failure_Other, "Transaction has changed during signing");
+		signing_abort();
+		return false;
+	}
+	return true;
+}
+
+/*
+ * hash_segwit_input() - Add an input to hashPrevouts and hashSequence
+ *
+ * INPUT
+ *     - txinput: input
+ * OUTPUT
+ *     none
+ */
+static void hash_segwit_input(const TxInputType *txinput)
+{
+	uint8_t prevout[36];
+
+	serialize_prevout(txinput, prevout);
+	sha256_Update(&hashers[0], prevout, 36);
+	sha256_Update(&hashers[1], (const uint8_t *)&txinput->sequence, 4);
+}
+
+/*
+ * hash_segwit_output() - Add a compiled output to hashOutputs
+ *
+ * INPUT
+ *     - output: compiled output
+ * OUTPUT
+ *     none
+ */
+static void hash_segwit_output(const TxOutputBinType *output)
+{
+	sha256_Update(&hashers[2], (const uint8_t *)&output->amount, 8);
+	ser_length_hash(&hashers[2], output->script_pubkey.size);
+	sha256_Update(&hashers[2], output->script_pubkey.bytes, output->script_pubkey.size);
+}
+
+static void hash_segwit_final(SHA256_CTX *ctx, uint8_t *digest)
+{
+	sha256_Final(digest, ctx);
+	sha256_Raw(digest, 32, digest);
+}
+
+/*
+ * segwit_sighash_fields() - Compute the BIP143 sighash of an input, which
+ * only depends on the input itself and the hashes of phase 1
+ *
+ * INPUT
+ *     - prevout: serialized previous output of input
+ *     - script: scriptCode of input
+ *     - script_len: length of scriptCode
+ *     - amount: amount of input
+ *     - sequence: sequence of input
+ *     - digest: where to put the sighash
+ * OUTPUT
+ *     none
+ */
+static void segwit_sighash_fields(const uint8_t *prevout, const uint8_t *script, uint32_t script_len,
+                                  uint64_t amount, uint32_t sequence, uint8_t *digest)
+{
+	const uint32_t hash_type = 1;
+	SHA256_CTX ctx;
+
+	sha256_Init(&ctx);
+	sha256_Update(&ctx, (const uint8_t *)&version, 4);
+	sha256_Update(&ctx, hash_prevouts, 32);
+	sha256_Update(&ctx, hash_sequence, 32);
+	sha256_Update(&ctx, prevout, 36);
+	ser_length_hash(&ctx, script_len);
+	sha256_Update(&ctx, script, script_len);
+	sha256_Update(&ctx, (const uint8_t *)&amount, 8);
+	sha256_Update(&ctx, (const uint8_t *)&sequence, 4);
+	sha256_Update(&ctx, hash_outputs, 32);
+	sha256_Update(&ctx, (const uint8_t *)&lock_time, 4);
+	sha256_Update(&ctx, (const uint8_t *)&hash_type, 4);
+	hash_segwit_final(&ctx, digest);
+}
+
+static void segwit_sighash(const TxInputType *txinput, uint8_t *digest)
+{
+	uint8_t prevout[36];
+
+	serialize_prevout(txinput, prevout);
+	segwit_sighash_fields(prevout, txinput->script_sig.bytes, txinput->script_sig.size,
+	                      txinput->amount, txinput->sequence, digest);
+}
+
+/*
+ * check_segwit_amount() - Check the amount a segwit input claims against its
+ * previous transaction, once that has been verified
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     true/false whether amount matches, failure has been sent otherwise
+ */
+static bool check_segwit_amount(void)
+{
+	if (!is_segwit_input(&input)) {
+		return true;
+	}
+	if (to_spend - input_spend_start != input.amount) {
+		fsm_sendFailure(FailureType_Failure_Other, "Segwit input amount mismatch");
+		signing_abort();
+		return false;
+	}
+	segwit_to_spend += input.amount;
+	return true;
+}
+
+/*
+ * prevtx_cache_find() - Look up the amount of the output spent by input
+ *
+ * INPUT
+ *     - amount: where to put the verified amount
+ * OUTPUT
+ *     true/false whether the output has been verified before
+ */
+static bool prevtx_cache_find(uint64_t *amount)
+{
+	for (uint32_t i = 0; i < PREVTX_CACHE_SIZE; i++) {
+		if (prevtx_cache[i].set && prevtx_cache[i].prev_index == input.prev_index &&
+		    input.prev_hash.size == 32 &&
+		    memcmp(prevtx_cache[i].prev_hash, input.prev_hash.bytes, 32) == 0) {
+			*amount = prevtx_cache[i].amount;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * prevtx_cache_add() - Remember the amount of the output spent by input, once
+ * its previous transaction has been verified
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+static void prevtx_cache_add(void)
+{
+	PrevTxCacheEntry *entry = &prevtx_cache[prevtx_cache_next];
+
+	entry->set = true;
+	memcpy(entry->prev_hash, input.prev_hash.bytes, 32);
+	entry->prev_index = input.prev_index;
+	entry->amount = to_spend - input_spend_start;
+	prevtx_cache_next = (prevtx_cache_next + 1) % PREVTX_CACHE_SIZE;
+}
+
+/*
+ * cache_output() - Append a compiled output for phase 2, dropping the hashes
+ * of the last inputs and then the prevouts to make room, and falling back to
+ * streaming the outputs again once they do not fit on their own
+ *
+ * INPUT
+ *     - output: compiled output
+ * OUTPUT
+ *     none
+ */
+static void cache_output(const TxOutputBinType *output)
+{
+	uint8_t *out;
+	uint32_t r, need, drop, move;
+
+	if (!outputs_cached) {
+		return;
+	}
+
+	/* amount, script length of at most 3 bytes, script */
+	need = output_cache_len + 8 + 3 + output->script_pubkey.size;
+	if (need > SIGNING_CACHE_SIZE && linear) {
+		drop = (need - SIGNING_CACHE_SIZE + 31) / 32;
+		if (drop <= hashed_inputs) {
+			/* Those inputs are checked by streaming all inputs again instead */
+			move = drop * 32;
+			hashed_inputs -= drop;
+		} else {
+			/* Without the prevouts only the inputs are streamed again */
+			move = output_cache_start;
+			linear = false;
+			hashed_inputs = 0;
+		}
+		memmove(signing_cache.bytes + output_cache_start - move,
+		        signing_cache.bytes + output_cache_start, output_cache_len - output_cache_start);
+		output_cache_start -= move;
+		output_cache_len -= move;
+		need -= move;
+	}
+	if (need > SIGNING_CACHE_SIZE) {
+		outputs_cached = false;
+		linear = false;
+		hashed_inputs = 0;
+		return;
+	}
+
+	out = signing_cache.bytes + output_cache_len;
+	memcpy(out, &output->amount, 8);
+	r = 8 + ser_length(output->script_pubkey.size, out + 8);
+	memcpy(out + r, output->script_pubkey.bytes, output->script_pubkey.size);
+	output_cache_len += r + output->script_pubkey.size;
+}
+
+/*
+ * hash_cached_outputs() - Hash the outputs kept in phase 1 as they appear in
+ * a legacy sighash preimage
+ *
+ * INPUT
+ *     - ctx: sighash preimage context
+ * OUTPUT
+ *     none
+ */
+static void hash_cached_outputs(SHA256_CTX *ctx)
+{
+	ser_length_hash(ctx, outputs_count);
+	sha256_Update(ctx, signing_cache.bytes + output_cache_start, output_cache_len - output_cache_start);
+}
+
+/*
+ * hash_empty_input() - Hash a cached input with an empty script, as it
+ * appears in the sighash preimage of every other input
+ *
+ * INPUT
+ *     - ctx: sighash preimage context
+ *     - index: input index
+ * OUTPUT
+ *     none
+ */
+static void hash_empty_input(SHA256_CTX *ctx, uint32_t index)
+{
+	const SigningInputCache *entry = &signing_cache.inputs[index];
+
+	sha256_Update(ctx, entry->prevout, 36);
+	ser_length_hash(ctx, 0);
+	sha256_Update(ctx, (const uint8_t *)&entry->sequence, 4);
+}
+
+/*
+ * linear_sighash_at() - Compute the legacy sighash of an input from the cache
+ *
+ * INPUT
+ *     - prefix: preimage context holding the header and the inputs before index
+ *     - index: input index
+ *     - script: scriptCode of input
+ *     - script_len: length of scriptCode
+ *     - digest: where to put the sighash
+ * OUTPUT
+ *     none
+ */
+static void linear_sighash_at(const SHA256_CTX *prefix, uint32_t index, const uint8_t *script,
+                              uint32_t script_len, uint8_t *digest)
+{
+	const SigningInputCache *entry = &signing_cache.inputs[index];
+	const uint32_t hash_type = 1;
+	SHA256_CTX ctx;
+	uint32_t j;
+
+	memcpy(&ctx, prefix, sizeof(SHA256_CTX));
+
+	sha256_Update(&ctx, entry->prevout, 36);
+	ser_length_hash(&ctx, script_len);
+	sha256_Update(&ctx, script, script_len);
+	sha256_Update(&ctx, (const uint8_t *)&entry->sequence, 4);
+
+	for (j = index + 1; j < inputs_count; j++) {
+		hash_empty_input(&ctx, j);
+	}
+
+	hash_cached_outputs(&ctx);
+	sha256_Update(&ctx, (const uint8_t *)&lock_time, 4);
+	sha256_Update(&ctx, (const uint8_t *)&hash_type, 4);
+
+	sha256_Final(digest, &ctx);
+	sha256_Raw(digest, 32, digest);
+	memset(&ctx, 0, sizeof(ctx));
+}
+
+static void linear_sighash(const TxInputType *txinput, uint8_t *digest)
+{
+	/* Header and the inputs before idx1 are shared with the previous input */
+	linear_sighash_at(&linear_prefix, idx1, txinput->script_sig.bytes, txinput->script_sig.size, digest);
+}
+
+/*
+ * precompute_input() - Remember what an input needs for its key and nonce to
+ * be prepared ahead of phase 2
+ *
+ * INPUT
+ *     - txinput: input as sent by the host
+ * OUTPUT
+ *     none
+ */
+static void precompute_input(const TxInputType *txinput)
+{
+	PrecomputedInput *slot;
+
+	if (idx1 >= PRECOMPUTE_INPUTS) {
+		return;
+	}
+
+	slot = &precomputed[idx1];
+	memset(slot, 0, sizeof(PrecomputedInput));
+	slot->set = true;
+	memcpy(slot->address_n, txinput->address_n, txinput->address_n_count * sizeof(uint32_t));
+	slot->address_n_count = txinput->address_n_count;
+	slot->script_type = txinput->script_type;
+	slot->amount = txinput->amount;
+	serialize_prevout(txinput, slot->prevout);
+	slot->sequence = txinput->sequence;
+}
+
+/*
+ * precompute_key() - Derive the key of a remembered input
+ *
+ * INPUT
+ *     - slot: remembered input
+ * OUTPUT
+ *     none
+ */
+static void precompute_key(PrecomputedInput *slot)
+{
+	HDNode n;
+
+	memcpy(&n, root, sizeof(HDNode));
+	if (hdnode_private_ckd_cached(&n, slot->address_n, slot->address_n_count) != 0) {
+		memcpy(slot->privkey, n.private_key, 32);
+		memcpy(slot->pubkey, n.public_key, 33);
+		slot->has_key = true;
+	} else {
+		/* Left for phase 2 to fail on */
+		slot->set = false;
+	}
+	memset(&n, 0, sizeof(n));
+}
+
+/*
+ * precompute_digest() - Compute the sighash of a remembered input, now that
+ * all outputs are known
+ *
+ * INPUT
+ *     - index: input index
+ * OUTPUT
+ *     none
+ */
+static void precompute_digest(uint32_t index)
+{
+	PrecomputedInput *slot = &precomputed[index];
+	uint8_t pkh[20], script[25];
+	uint32_t script_len, j;
+	SHA256_CTX prefix;
+
+	/* Both kinds of single key input sign over a pay to pubkey hash scriptCode */
+	ecdsa_get_pubkeyhash(slot->pubkey, pkh);
+	script_len = compile_script_sig(coin->address_type, pkh, script);
+
+	if (slot->script_type == InputScriptType_SPENDWITNESS ||
+	    slot->script_type == InputScriptType_SPENDP2SHWITNESS) {
+		segwit_sighash_fields(slot->prevout, script, script_len, slot->amount, slot->sequence, slot->digest);
+	} else {
+		sha256_Init(&prefix);
+		sha256_Update(&prefix, (const uint8_t *)&version, sizeof(version));
+		ser_length_hash(&prefix, inputs_count);
+		for (j = 0; j < index; j++) {
+			hash_empty_input(&prefix, j);
+		}
+		linear_sighash_at(&prefix, index, script, script_len, slot->digest);
+		memset(&prefix, 0, sizeof(prefix));
+	}
+	slot->has_digest = true;
+}
+
+/*
+ * precompute_nonce() - Generate the signing nonce of a remembered input and
+ * its point k*G
+ *
+ * INPUT
+ *     - slot: remembered input with its sighash
+ * OUTPUT
+ *     none
+ */
+static void precompute_nonce(PrecomputedInput *slot)
+{
+	slot->has_nonce = ecdsa_sign_nonce(&secp256k1, slot->privkey, slot->digest, &slot->k, &slot->R) == 0;
+	slot->nonce_tried = true;
+}
+
+/*
+ * precompute_step() - Prepare the next input key, sighash or nonce
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     true/false whether there was anything left to prepare
+ */
+static bool precompute_step(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < PRECOMPUTE_INPUTS && i < inputs_count; i++) {
+		if (precomputed[i].set && !precomputed[i].has_key) {
+			precompute_key(&precomputed[i]);
+			return true;
+		}
+	}
+
+	/* Sighashes depend on every output, and legacy ones on the input cache */
+	if (!outputs_checked) {
+		return false;
+	}
+
+	for (i = 0; i < PRECOMPUTE_INPUTS && i < inputs_count; i++) {
+		PrecomputedInput *slot = &precomputed[i];
+
+		if (!slot->has_key || slot->nonce_tried) {
+			continue;
+		}
+		if (slot->has_digest) {
+			precompute_nonce(slot);
+			return true;
+		}
+		if (slot->script_type == InputScriptType_SPENDWITNESS ||
+		    slot->script_type == InputScriptType_SPENDP2SHWITNESS ||
+		    (slot->script_type == InputScriptType_SPENDADDRESS && linear)) {
+			precompute_digest(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * signing_idle() - Prepare one input key, sighash or nonce while a
+ * confirmation of the outputs or the fee waits for the user
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+static void signing_idle(void)
+{
+	uint32_t start = get_timestamp();
+
+	if (!signing || signing_stage != STAGE_REQUEST_3_OUTPUT) {
+		return;
+	}
+
+	/* Leave the confirmation loop at least as long as the last step took,
+	 * so buttons, Cancel and the debug link are still polled half the time */
+	if (start - idle_end < idle_ticks) {
+		return;
+	}
+
+	if (precompute_step()) {
+		idle_end = get_timestamp();
+		idle_ticks = idle_end - start;
+		stat_add(STAT_IDLE, start);
+	}
+}
+
+/*
+ * sign_digest() - Sign hash with privkey, using the nonce prepared for input
+ * idx1 if it was generated for the same key and sighash
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+static void sign_digest(void)
+{
+	PrecomputedInput *slot = idx1 < PRECOMPUTE_INPUTS ? &precomputed[idx1] : NULL;
+	uint32_t start = get_timestamp();
+
+	if (slot && slot->has_nonce &&
+	    memcmp(slot->digest, hash, 32) == 0 && memcmp(slot->privkey, privkey, 32) == 0 &&
+	    ecdsa_sign_digest_nonce(&secp256k1, privkey, hash, &slot->k, &slot->R, sig, 0) == 0) {
+		slot->has_nonce = false;
+		stat_add(STAT_SIGN, start);
+		return;
+	}
+
+	if (slot) {
+		/* A nonce is never used for anything but the sighash it was made for */
+		memset(&slot->k, 0, sizeof(slot->k));
+		memset(&slot->R, 0, sizeof(slot->R));
+		slot->has_nonce = false;
+	}
+	ecdsa_sign_digest(&secp256k1, privkey, hash, sig, 0);
+	stat_add(STAT_SIGN, start);
+}
+
+/*
+ * compile_input_script() - Derive the key of the input to sign and fill in
+ * its scriptCode
+ *
+ * INPUT
+ *     - txinput: input to sign
+ * OUTPUT
+ *     true/false whether input could be compiled, failure has been sent otherwise
+ */
+static bool compile_input_script(TxInputType *txinput)
+{
+	const PrecomputedInput *slot = idx1 < PRECOMPUTE_INPUTS ? &precomputed[idx1] : NULL;
+
+	if (slot && slot->has_key && slot->address_n_count == txinput->address_n_count &&
+	    memcmp(slot->address_n, txinput->address_n, txinput->address_n_count * sizeof(uint32_t)) == 0) {
+		/* Derived while the user was confirming */
+		memcpy(privkey, slot->privkey, 32);
+		memcpy(pubkey, slot->pubkey, 33);
+	} else {
+		uint32_t start = get_timestamp();
+		memcpy(&node, root, sizeof(HDNode));
+		if (hdnode_private_ckd_cached(&node, txinput->address_n, txinput->address_n_count) == 0) {
+			fsm_sendFailure(FailureType_Failure_Other, "Failed to derive private key");
+			signing_abort();
+			return false;
+		}
+		stat_add(STAT_DERIVE, start);
+		memcpy(privkey, node.private_key, 32);
+		memcpy(pubkey, node.public_key, 33);
+	}
+	if (txinput->script_type == InputScriptType_SPENDMULTISIG) {
+		if (!txinput->has_multisig) {
+			fsm_sendFailure(FailureType_Failure_Other, "Multisig info not provided");
+			signing_abort();
+			return false;
+		}
+		txinput->script_sig.size = compile_script_multisig(&(txinput->multisig), txinput->script_sig.bytes);
+	} else { // SPENDADDRESS
+		ecdsa_get_pubkeyhash(pubkey, hash);
+		txinput->script_sig.size = compile_script_sig(coin->address_type, hash, txinput->script_sig.bytes);
+	}
+	if (txinput->script_sig.size == 0) {
+		fsm_sendFailure(FailureType_Failure_Other, "Failed to compile input");
+		signing_abort();
+		return false;
+	}
+	return true;
+}
+
+/*
+ * sign_input() - Sign the sighash in hash for input idx1 and put the signed
+ * input into the response
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     true/false whether input was signed, failure has been sent otherwise
+ */
+static bool sign_input(void)
+{
+	resp.has_serialized = true;
+	resp.serialized.has_signature_index = true;
+	resp.serialized.signature_index = idx1;
+	resp.serialized.has_signature = true;
+	resp.serialized.has_serialized_tx = true;
+	sign_digest();
+	resp.serialized.signature.size = ecdsa_sig_to_der(sig, resp.serialized.signature.bytes);
+	if (input.script_type == InputScriptType_SPENDMULTISIG) {
+		if (!input.has_multisig) {
+			fsm_sendFailure(FailureType_Failure_Other, "Multisig info not provided");
+			signing_abort();
+			return false;
+		}
+		// fill in the signature
+		int pubkey_idx = cryptoMultisigPubkeyIndex(&(input.multisig), pubkey);
+		if (pubkey_idx < 0) {
+			fsm_sendFailure(FailureType_Failure_Other, "Pubkey not found in multisig script");
+			signing_abort();
+			return false;
+		}
+		memcpy(input.multisig.signatures[pubkey_idx].bytes, resp.serialized.signature.bytes, resp.serialized.signature.size);
+		input.multisig.signatures[pubkey_idx].size = resp.serialized.signature.size;
+		input.script_sig.size = serialize_script_multisig(&(input.multisig), input.script_sig.bytes);
+		if (input.script_sig.size == 0) {
+			fsm_sendFailure(FailureType_Failure_Other, "Failed to serialize multisig script");
+			signing_abort();
+			return false;
+		}
+	} else { // SPENDADDRESS
+		input.script_sig.size = serialize_script_sig(resp.serialized.signature.bytes, resp.serialized.signature.size, pubkey, 33, input.script_sig.bytes);
+	}
+	resp.serialized.serialized_tx.size += tx_serialize_input(&to, &input, resp.serialized.serialized_tx.bytes + resp.serialized.serialized_tx.size);
+	return true;
+}
+
+/*
+ * sign_segwit_input() - Sign the BIP143 sighash in hash for input idx1 and
+ * put its witness into the response
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+static void sign_segwit_input(void)
+{
+	uint8_t witness[1 + 1 + 73 + 1 + 33];
+	uint32_t witness_len;
+
+	resp.has_serialized = true;
+	resp.serialized.has_signature_index = true;
+	resp.serialized.signature_index = idx1;
+	resp.serialized.has_signature = true;
+	resp.serialized.has_serialized_tx = true;
+	sign_digest();
+	resp.serialized.signature.size = ecdsa_sig_to_der(sig, resp.serialized.signature.bytes);
+	witness_len = serialize_witness_sig(resp.serialized.signature.bytes, resp.serialized.signature.size, pubkey, 33, witness);
+	resp.serialized.serialized_tx.size += tx_serialize_witness(&to, witness, witness_len, resp.serialized.serialized_tx.bytes + resp.serialized.serialized_tx.size);
+}
+
+/*
+ * txack_items() - Number of items a TxAck carries for the current stage
+ *
+ * INPUT
+ *     - tx: transaction data sent by the host
+ * OUTPUT
+ *     number of inputs or outputs, 0 for the meta stage
+ */
+static uint32_t txack_items(const TransactionType *tx)
+{
+	switch (signing_stage) {
+		case STAGE_REQUEST_1_INPUT:
+		case STAGE_REQUEST_2_PREV_INPUT:
+		case STAGE_REQUEST_4_INPUT:
+		case STAGE_REQUEST_4_SIGN_INPUT:
+		case STAGE_REQUEST_SEGWIT_WITNESS:
+			return tx->inputs_count;
+		case STAGE_REQUEST_2_PREV_OUTPUT:
+			return tx->bin_outputs_count;
+		case STAGE_REQUEST_3_OUTPUT:
+		case STAGE_REQUEST_4_OUTPUT:
+		case STAGE_REQUEST_5_OUTPUT:
+			return tx->outputs_count;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * batch_has_next() - Whether the next unconsumed TxAck item answers the request
+ * in resp and its serialized data still fits the response
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     true/false whether the item can be consumed without a round trip
+ */
+static bool batch_has_next(void)
+{
+	uint32_t next = batch_pos + 1, chunk_max;
+
+	if (batch_tx == NULL || next >= batch_items || resp.serialized.has_signature) {
+		return false;
+	}
+
+	if (resp.request_type != batch_type ||
+	    resp.details.request_index != batch_request.request_index + next ||
+	    resp.details.has_tx_hash != batch_request.has_tx_hash ||
+	    (resp.details.has_tx_hash &&
+	     memcmp(resp.details.tx_hash.bytes, batch_request.tx_hash.bytes, 32) != 0)) {
+		return false;
+	}
 
-            break;
-    }
+	if (resp.request_type == RequestType_TXOUTPUT) {
+		chunk_max = CHUNK_MAX_OUTPUT;
+	} else if (is_segwit_input(&batch_tx->inputs[next])) {
+		/* Its witness is larger than its input chunk */
+		chunk_max = CHUNK_MAX_WITNESS;
+	} else {
+		chunk_max = CHUNK_MAX_INPUT(sizeof(input.script_sig.bytes));
+	}
 
-    return(ret_val);
+	return resp.serialized.serialized_tx.size + chunk_max <= sizeof(resp.serialized.serialized_tx.bytes);
 }
 
-static void reset_parsing_buffer(uint8_t *buffer, uint8_t *buffer_index)
+/*
+ * send_request() - Send the request set up in resp, or let signing_txack()
+ * continue with the next item of the current TxAck when it carries it
+ *
+ * INPUT
+ *     - remaining: items left from the requested index on
+ *     - max_count: items of the requested kind one TxAck can carry
+ * OUTPUT
+ *     none
+ */
+static void send_request(uint32_t remaining, uint32_t max_count)
 {
-	memset(buffer, 0, VAR_INT_BUFFER);
-	*buffer_index = 0;
+	if (batch_has_next()) {
+		/* Only the serialized data carries over to the next item */
+		resp.has_request_type = false;
+		resp.has_details = false;
+		memset(&resp.details, 0, sizeof(TxRequestDetailsType));
+		batch_next = true;
+		return;
+	}
+
+	resp.details.has_request_count = true;
+	resp.details.request_count = remaining < max_count ? remaining : max_count;
+	batch_type = resp.request_type;
+	memcpy(&batch_request, &resp.details, sizeof(TxRequestDetailsType));
+	msg_write(MessageType_MessageType_TxRequest, &resp);
+	request_sent();
 }
 
 /* === Functions =========================================================== */
@@ -130,6 +1155,10 @@ static void reset_parsing_buffer(uint8_t *buffer, uint8_t *buffer_index)
 /*
 Workflow of streamed signing
 The STAGE_ constants describe the signing_stage when request is sent.
+A request for inputs or outputs may be answered with up to request_count
+consecutive items. They are consumed in order, each one as if it had been
+requested on its own, until a request asks for something else or the
+response has to be sent for its signature or serialized data.
 I - input
 O - output
 Phase1 - check inputs, previous transactions, and outputs
@@ -139,6 +1168,7 @@ Phase1 - check inputs, previous transactions, and outputs
 foreach I (idx1):
     Request I                                                         STAGE_REQUEST_1_INPUT
     Add I to TransactionChecksum
+    Add I to hashPrevouts and hashSequence
     Calculate amount of I:
         Request prevhash I, META                                      STAGE_REQUEST_2_PREV_META
         foreach prevhash I (idx2):
@@ -147,9 +1177,11 @@ foreach I (idx1):
             Request prevhash O                                        STAGE_REQUEST_2_PREV_OUTPUT
             Add amount of prevhash O (which is amount of I)
         Calculate hash of streamed tx, compare to prevhash I
+        If I is segwit, compare amount of I with amount of prevhash O
 foreach O (idx1):
     Request O                                                         STAGE_REQUEST_3_OUTPUT
     Add O to TransactionChecksum
+    Add O to hashOutputs
     Display output
     Ask for confirmation
 Check tx fee
@@ -157,26 +1189,65 @@ Ask for confirmation
 Phase2: sign inputs, check that nothing changed
 ===============================================
 foreach I (idx1):  // input to sign
-    foreach I (idx2):
-        Request I                                                     STAGE_REQUEST_4_INPUT
-        If idx1 == idx2
-        Remember key for signing
-            Fill scriptsig
-        Add I to StreamTransactionSign
-        Add I to TransactionChecksum
-    foreach O (idx2):
-        Request O                                                     STAGE_REQUEST_4_OUTPUT
-        Add O to StreamTransactionSign
-        Add O to TransactionChecksum
-    Compare TransactionChecksum with checksum computed in Phase 1
-    If different:
-        Failure
-    Sign StreamTransactionSign
-    Return signed chunk
+    Request I                                                         STAGE_REQUEST_4_SIGN_INPUT
+    If the prevouts and compiled outputs of Phase1 fit in RAM (linear signing)
+    and the hash of I could be kept next to them:
+        Compare hash of I with the one kept in Phase1
+        If different:
+            Failure
+    If I is segwit:
+        Fill scriptsig, it is signed after the outputs
+        Return I
+    Else if the hash of I was kept in linear signing:
+        Fill scriptsig
+        Hash header, inputs and outputs kept in Phase1 with scriptsig of I
+        Sign it
+        Return signed chunk
+    Else (legacy signing):
+        foreach I (idx2):
+            Request I                                                 STAGE_REQUEST_4_INPUT
+            If idx1 == idx2
+            Remember key for signing
+                Fill scriptsig
+            Add I to StreamTransactionSign
+            Add I to TransactionChecksum
+        If the compiled outputs of Phase1 fit in RAM:
+            Compare TransactionChecksum with inputs checksum of Phase 1
+            If different:
+                Failure
+            Add outputs kept in Phase1 to StreamTransactionSign
+        Else:
+            foreach O (idx2):
+                Request O                                             STAGE_REQUEST_4_OUTPUT
+                Add O to StreamTransactionSign
+                Add O to TransactionChecksum
+            Compare TransactionChecksum with checksum computed in Phase 1
+            If different:
+                Failure
+        Sign StreamTransactionSign
+        Return signed chunk
 foreach O (idx1):
     Request O                                                         STAGE_REQUEST_5_OUTPUT
     Rewrite change address
     Return O
+If any I is segwit:
+    foreach I (idx1):
+        Request I                                                     STAGE_REQUEST_SEGWIT_WITNESS
+        If the hash of I was kept in linear signing:
+            Compare hash of I with the one kept in Phase1
+            If different:
+                Failure
+        Else if the hash of any I was not kept:
+            Add I to TransactionChecksum
+        If I is segwit:
+            Sign BIP143 hash of I, hashPrevouts, hashSequence, hashOutputs
+            Return witness
+        Else:
+            Return empty witness
+    If the hash of any I was not kept:
+        Compare TransactionChecksum with inputs checksum of Phase 1
+        If different:
+            Failure
 */
 
 void send_req_1_input(void)
@@ -187,7 +1258,7 @@ void send_req_1_input(void)
 	resp.has_details = true;
 	resp.details.has_request_index = true;
 	resp.details.request_index = idx1;
-	msg_write(MessageType_MessageType_TxRequest, &resp);
+	send_request(1, 1);
 }
 
 void send_req_2_prev_meta(void)
@@ -200,6 +1271,7 @@ void send_req_2_prev_meta(void)
 	resp.details.tx_hash.size = input.prev_hash.size;
 	memcpy(resp.details.tx_hash.bytes, input.prev_hash.bytes, input.prev_hash.size);
 	msg_write(MessageType_MessageType_TxRequest, &resp);
+	request_sent();
 }
 
 void send_req_2_prev_input(void)
@@ -213,7 +1285,7 @@ void send_req_2_prev_input(void)
 	resp.details.has_tx_hash = true;
 	resp.details.tx_hash.size = input.prev_hash.size;
 	memcpy(resp.details.tx_hash.bytes, input.prev_hash.bytes, resp.details.tx_hash.size);
-	msg_write(MessageType_MessageType_TxRequest, &resp);
+	send_request(tp.inputs_len - idx2, TXACK_MAX_INPUTS);
 }
 
 void send_req_2_prev_output(void)
@@ -227,7 +1299,7 @@ void send_req_2_prev_output(void)
 	resp.details.has_tx_hash = true;
 	resp.details.tx_hash.size = input.prev_hash.size;
 	memcpy(resp.details.tx_hash.bytes, input.prev_hash.bytes, resp.details.tx_hash.size);
-	msg_write(MessageType_MessageType_TxRequest, &resp);
+	send_request(tp.outputs_len - idx2, TXACK_MAX_BIN_OUTPUTS);
 }
 
 void send_req_3_output(void)
@@ -238,7 +1310,7 @@ void send_req_3_output(void)
 	resp.has_details = true;
 	resp.details.has_request_index = true;
 	resp.details.request_index = idx1;
-	msg_write(MessageType_MessageType_TxRequest, &resp);
+	send_request(outputs_count - idx1, TXACK_MAX_OUTPUTS);
 }
 
 void send_req_4_input(void)
@@ -249,7 +1321,18 @@ void send_req_4_input(void)
 	resp.has_details = true;
 	resp.details.has_request_index = true;
 	resp.details.request_index = idx2;
-	msg_write(MessageType_MessageType_TxRequest, &resp);
+	send_request(inputs_count - idx2, TXACK_MAX_INPUTS);
+}
+
+void send_req_4_sign_input(void)
+{
+	signing_stage = STAGE_REQUEST_4_SIGN_INPUT;
+	resp.has_request_type = true;
+	resp.request_type = RequestType_TXINPUT;
+	resp.has_details = true;
+	resp.details.has_request_index = true;
+	resp.details.request_index = idx1;
+	send_request(inputs_count - idx1, TXACK_MAX_INPUTS);
 }
 
 void send_req_4_output(void)
@@ -260,7 +1343,7 @@ void send_req_4_output(void)
 	resp.has_details = true;
 	resp.details.has_request_index = true;
 	resp.details.request_index = idx2;
-	msg_write(MessageType_MessageType_TxRequest, &resp);
+	send_request(outputs_count - idx2, TXACK_MAX_OUTPUTS);
 }
 
 void send_req_5_output(void)
@@ -271,7 +1354,18 @@ void send_req_5_output(void)
 	resp.has_details = true;
 	resp.details.has_request_index = true;
 	resp.details.request_index = idx1;
-	msg_write(MessageType_MessageType_TxRequest, &resp);
+	send_request(outputs_count - idx1, TXACK_MAX_OUTPUTS);
+}
+
+void send_req_segwit_witness(void)
+{
+	signing_stage = STAGE_REQUEST_SEGWIT_WITNESS;
+	resp.has_request_type = true;
+	resp.request_type = RequestType_TXINPUT;
+	resp.has_details = true;
+	resp.details.has_request_index = true;
+	resp.details.request_index = idx1;
+	send_request(inputs_count - idx1, TXACK_MAX_INPUTS);
 }
 
 void send_req_finished(void)
@@ -299,200 +1393,282 @@ void signing_init(uint32_t _inputs_count, uint32_t _outputs_count, const CoinTyp
 
 	multisig_fp_set = false;
 	multisig_fp_mismatch = false;
+	cryptoMultisigCacheClear();
+
+	/* Prevouts of all inputs come first, then the hashes of as many inputs
+	 * as fit, then the outputs as they are compiled */
+	linear = inputs_count <= sizeof(signing_cache.inputs) / sizeof(SigningInputCache);
+	outputs_cached = true;
+	hashed_inputs = 0;
+	output_cache_start = 0;
+	if (linear) {
+		output_cache_start = inputs_count * sizeof(SigningInputCache);
+		hashed_inputs = (SIGNING_CACHE_SIZE - output_cache_start) / 32;
+		if (hashed_inputs > inputs_count) {
+			hashed_inputs = inputs_count;
+		}
+		output_cache_start += hashed_inputs * 32;
+	}
+	output_cache_len = output_cache_start;
 
 	tx_init(&to, inputs_count, outputs_count, version, lock_time, false);
-	sha256_Init(&tc);
-	sha256_Update(&tc, (const uint8_t *)&inputs_count, sizeof(inputs_count));
-	sha256_Update(&tc, (const uint8_t *)&outputs_count, sizeof(outputs_count));
-	sha256_Update(&tc, (const uint8_t *)&version, sizeof(version));
-	sha256_Update(&tc, (const uint8_t *)&lock_time, sizeof(lock_time));
+	sha256_Init(&hashers[0]);
+	sha256_Init(&hashers[1]);
+	sha256_Init(&hashers[2]);
+	segwit_to_spend = 0;
+	init_checksum();
 
 	raw_tx_status = NOT_PARSING;
 
+	/* Keys and nonces are prepared while the outputs and fee are confirmed */
+	memset(precomputed, 0, sizeof(precomputed));
+	outputs_checked = false;
+	idle_end = 0;
+	idle_ticks = 0;
+	set_confirm_idle_handler(&signing_idle);
+
 	send_req_1_input();
 }
 
-void parse_raw_txack(uint8_t *msg, uint32_t msg_size){
-	static int32_t state_pos = 0;
-	static uint8_t *ptr;
-	static uint8_t var_int_buffer[VAR_INT_BUFFER];
-	static uint8_t var_int_buffer_index;
-	static uint32_t seen, script_len;
-	static uint64_t current_output_val;
+/*
+ * input_verified() - Account for the verified amount of input idx1 and go on
+ * with the next input, or with the outputs after the last one
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+static void input_verified(void)
+{
+	SHA256_CTX ctx;
+
+	if (!check_segwit_amount()) {
+		return;
+	}
+	if (idx1 < inputs_count - 1) {
+		idx1++;
+		send_req_1_input();
+	} else {
+		/* Legacy signing checks the inputs against this on their own when
+		 * the outputs are kept in RAM */
+		memcpy(&ctx, &tc, sizeof(SHA256_CTX));
+		sha256_Final(hash_inputs_check, &ctx);
+		idx1 = 0;
+		send_req_3_output();
+	}
+}
+
+/*
+ * sign_streamed_input() - Sign input idx1 with the legacy sighash streamed
+ * into ti and go on with the next input, or with the outputs after the last one
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+static void sign_streamed_input(void)
+{
+	tx_hash_final(&ti, hash, false);
+	if (!sign_input()) {
+		return;
+	}
 
-	for(uint32_t i = 0; i < msg_size; ++i) {
+	if (linear) {
+		hash_empty_input(&linear_prefix, idx1);
+	}
+	if (idx1 < inputs_count - 1) {
+		idx1++;
+		send_req_4_sign_input();
+	} else {
+		idx1 = 0;
+		send_req_5_output();
+	}
+}
 
-		state_pos--;
+/*
+ * signing_prevtx_cache_clear() - Forget the previous outputs verified in this session
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+void signing_prevtx_cache_clear(void)
+{
+	memset(prevtx_cache, 0, sizeof(prevtx_cache));
+	prevtx_cache_next = 0;
+}
 
-		switch(raw_tx_status) {
+/*
+ * parse_raw_txack_chunk() - Feed a chunk of a raw previous transaction to the parser
+ *
+ * INPUT
+ *     - msg: raw transaction bytes
+ *     - msg_size: length of chunk
+ * OUTPUT
+ *     none
+ */
+static void parse_raw_txack_chunk(uint8_t *msg, uint32_t msg_size)
+{
+	const uint8_t *pos = msg, *end = msg + msg_size;
+	uint32_t len;
+	uint64_t amount;
+
+	/* Fields are parsed in place as far as the chunk goes; the spans in
+	 * between are only skipped and the whole chunk is hashed at once */
+	while (pos < end) {
+		switch (raw_tx_status) {
 			case NOT_PARSING:
 				tx_init(&tp, 0, 0, 0, 0, false);
-				state_pos = sizeof(uint32_t);
-				raw_tx_status = PARSING_VERSION;
-				ptr = (uint8_t *)&tp.version;
+				raw_tx_start(PARSING_VERSION, sizeof(uint32_t));
+				/* FALLTHROUGH */
 			case PARSING_VERSION:
-				*ptr++ = msg[i];
-
-				if(state_pos == 1)
-				{
-					raw_tx_status = PARSING_INPUT_COUNT;
-					reset_parsing_buffer(var_int_buffer, &var_int_buffer_index);
+				if (raw_tx_read(&pos, end)) {
+					memcpy(&tp.version, raw_tx.field, sizeof(uint32_t));
+					raw_tx_start(PARSING_INPUT_COUNT, 0);
 				}
 				break;
 			case PARSING_INPUT_COUNT:
-				var_int_buffer[var_int_buffer_index++] = msg[i];
-
-				if(var_int_buffer_index >= deser_length(var_int_buffer, &tp.inputs_len))
-				{
-					raw_tx_status = PARSING_INPUTS;
-					state_pos = 36;
-					seen = 0;
-					reset_parsing_buffer(var_int_buffer, &var_int_buffer_index);
-				}
-
-				break;
-			case PARSING_INPUTS:
-				if(state_pos < 0 && seen < tp.inputs_len)
-				{
-					var_int_buffer[var_int_buffer_index++] = msg[i];
-
-					if(var_int_buffer_index >= deser_length(var_int_buffer, &script_len))
-					{
-						seen++;
-
-						if(seen < tp.inputs_len)
-						{
-							state_pos = script_len + 4 + 36;
-						}
-						else
-						{
-							state_pos = script_len + 3;	
-						}
-
-						script_len = 0;
-						reset_parsing_buffer(var_int_buffer, &var_int_buffer_index);
+				if (raw_tx_read_varint(&pos, end, &tp.inputs_len)) {
+					if (tp.inputs_len == 0) {
+						fsm_sendFailure(FailureType_Failure_Other, "Previous transaction has no inputs");
+						signing_abort();
+						return;
 					}
-				}
-				else if(state_pos < 0)
-				{
-					raw_tx_status = PARSING_OUTPUT_COUNT;
+					raw_tx.seen = 0;
+					raw_tx_start(PARSING_INPUT_PREVOUT, 32 + 4);
 				}
 				break;
-			case PARSING_OUTPUT_COUNT:
-				var_int_buffer[var_int_buffer_index++] = msg[i];
-
-				if(var_int_buffer_index >= deser_length(var_int_buffer, &tp.outputs_len))
-				{
-					raw_tx_status = PARSING_OUTPUTS_VALUE;
-					state_pos = 8;
-					seen = 0;
-					current_output_val = 0;
-					ptr = (uint8_t *)&current_output_val;
-					reset_parsing_buffer(var_int_buffer, &var_int_buffer_index);
+			case PARSING_INPUT_PREVOUT:
+				if (raw_tx_skip(&pos, end)) {
+					raw_tx_start(PARSING_INPUT_SCRIPT_LEN, 0);
 				}
 				break;
-			case PARSING_OUTPUTS_VALUE:
-				if(state_pos < 8)
-				{
-					*ptr++ = msg[i];
-
-					if(state_pos < 1)
-					{
-						if (seen == input.prev_index) {
-							to_spend += current_output_val;
-						}
-
-						raw_tx_status = PARSING_OUTPUTS;
-						script_len = 0;
-						reset_parsing_buffer(var_int_buffer, &var_int_buffer_index);
+			case PARSING_INPUT_SCRIPT_LEN:
+				if (raw_tx_read_varint(&pos, end, &len)) {
+					if (len > RAW_TX_MAX_SCRIPT) {
+						fsm_sendFailure(FailureType_Failure_Other, "Previous transaction script too long");
+						signing_abort();
+						return;
 					}
+					/* Script and sequence */
+					raw_tx_start(PARSING_INPUT_SCRIPT, len + sizeof(uint32_t));
 				}
 				break;
-			case PARSING_OUTPUTS:
-				if(state_pos < 0 && seen < tp.outputs_len)
-				{
-					var_int_buffer[var_int_buffer_index++] = msg[i];
-
-					if(var_int_buffer_index >= deser_length(var_int_buffer, &script_len))
-					{
-						seen++;
-
-						if(seen < tp.outputs_len)
-						{
-							current_output_val = 0;
-							ptr = (uint8_t *)&current_output_val;
-							raw_tx_status = PARSING_OUTPUTS_VALUE;
-							state_pos = script_len + 8;
-						}
-						else
-						{
-							state_pos = script_len - 1;
-						}
+			case PARSING_INPUT_SCRIPT:
+				if (raw_tx_skip(&pos, end)) {
+					if (++raw_tx.seen < tp.inputs_len) {
+						raw_tx_start(PARSING_INPUT_PREVOUT, 32 + 4);
+					} else {
+						raw_tx_start(PARSING_OUTPUT_COUNT, 0);
 					}
 				}
-				else if(state_pos < 0)
-				{
-					raw_tx_status = PARSING_LOCKTIME;
-					state_pos = 4;
-					ptr = (uint8_t *)&tp.lock_time;
-					reset_parsing_buffer(var_int_buffer, &var_int_buffer_index);
+				break;
+			case PARSING_OUTPUT_COUNT:
+				if (raw_tx_read_varint(&pos, end, &tp.outputs_len)) {
+					raw_tx.seen = 0;
+					raw_tx_start(tp.outputs_len > 0 ? PARSING_OUTPUT_VALUE : PARSING_LOCKTIME,
+					             tp.outputs_len > 0 ? sizeof(uint64_t) : sizeof(uint32_t));
 				}
 				break;
-			case PARSING_LOCKTIME:
-            	if(state_pos >= 0)
-				{
-					*ptr++ = msg[i];
+			case PARSING_OUTPUT_VALUE:
+				/* Only the output spent by the input is of interest */
+				if (raw_tx.seen != input.prev_index) {
+					if (raw_tx_skip(&pos, end)) {
+						raw_tx_start(PARSING_OUTPUT_SCRIPT_LEN, 0);
+					}
+				} else if (raw_tx_read(&pos, end)) {
+					memcpy(&amount, raw_tx.field, sizeof(uint64_t));
+					to_spend += amount;
+					raw_tx_start(PARSING_OUTPUT_SCRIPT_LEN, 0);
 				}
-				if(state_pos < 1)
-				{
-					raw_tx_status = NOT_PARSING;
-					memset(&resp, 0, sizeof(TxRequest));
-
-					sha256_Update(&(tp.ctx), (const uint8_t*)msg+i, 1);
-					tx_hash_final(&tp, hash, true);
-					if (memcmp(hash, input.prev_hash.bytes, 32) != 0) {
-						fsm_sendFailure(FailureType_Failure_Other, "Encountered invalid prevhash");
+				break;
+			case PARSING_OUTPUT_SCRIPT_LEN:
+				if (raw_tx_read_varint(&pos, end, &len)) {
+					if (len > RAW_TX_MAX_SCRIPT) {
+						fsm_sendFailure(FailureType_Failure_Other, "Previous transaction script too long");
 						signing_abort();
 						return;
 					}
-            		
-            		if (idx1 < inputs_count - 1) {
-						idx1++;
-						send_req_1_input();
+					raw_tx_start(PARSING_OUTPUT_SCRIPT, len);
+				}
+				break;
+			case PARSING_OUTPUT_SCRIPT:
+				/* An empty script completes without consuming anything, the
+				 * lock time always follows */
+				if (raw_tx_skip(&pos, end)) {
+					if (++raw_tx.seen < tp.outputs_len) {
+						raw_tx_start(PARSING_OUTPUT_VALUE, sizeof(uint64_t));
 					} else {
-						idx1 = 0;
-						send_req_3_output();
+						raw_tx_start(PARSING_LOCKTIME, sizeof(uint32_t));
 					}
+				}
+				break;
+			case PARSING_LOCKTIME:
+				if (!raw_tx_read(&pos, end)) {
+					break;
+				}
+
+				memcpy(&tp.lock_time, raw_tx.field, sizeof(uint32_t));
+				raw_tx_status = NOT_PARSING;
+				memset(&resp, 0, sizeof(TxRequest));
 
+				/* Bytes past the end of the transaction are not part of it */
+				sha256_Update(&(tp.ctx), msg, pos - msg);
+				tx_hash_final(&tp, hash, true);
+				if (memcmp(hash, input.prev_hash.bytes, 32) != 0) {
+					fsm_sendFailure(FailureType_Failure_Other, "Encountered invalid prevhash");
+					signing_abort();
 					return;
 				}
-				break;
+				prevtx_cache_add();
+				input_verified();
+				return;
 		}
-
-		sha256_Update(&(tp.ctx), (const uint8_t*)msg+i, 1);
 	}
+
+	sha256_Update(&(tp.ctx), msg, msg_size);
 }
 
-void signing_txack(TransactionType *tx)
+void parse_raw_txack(uint8_t *msg, uint32_t msg_size)
 {
-	if (!signing) {
-		fsm_sendFailure(FailureType_Failure_UnexpectedMessage, "Not in Signing mode");
-		go_home();
+	uint32_t start;
+
+	/* The rest of a transaction that already failed is dropped */
+	if (!signing || signing_stage != STAGE_REQUEST_2_PREV_META) {
 		return;
 	}
 
+	request_answered();
+	start = get_timestamp();
+	parse_raw_txack_chunk(msg, msg_size);
+	stat_add(STAT_RAW_TX, start);
+}
+
+/*
+ * signing_txack_item() - Advance the signing state machine by item batch_pos of a TxAck
+ *
+ * INPUT
+ *     - tx: transaction data sent by the host
+ * OUTPUT
+ *     none
+ */
+static void signing_txack_item(TransactionType *tx)
+{
 	int co;
-	memset(&resp, 0, sizeof(TxRequest));
+	uint64_t amount;
 
 	switch (signing_stage) {
 		case STAGE_REQUEST_1_INPUT:
 			/* compute multisig fingerprint */
 			/* (if all input share the same fingerprint, outputs having the same fingerprint will be considered as change outputs) */
-			if (tx->inputs[0].script_type == InputScriptType_SPENDMULTISIG) {
-				if (tx->inputs[0].has_multisig && !multisig_fp_mismatch) {
+			if (tx->inputs[batch_pos].script_type == InputScriptType_SPENDMULTISIG) {
+				if (tx->inputs[batch_pos].has_multisig && !multisig_fp_mismatch) {
 					if (multisig_fp_set) {
 						uint8_t h[32];
-						if (cryptoMultisigFingerprint(&(tx->inputs[0].multisig), h) == 0) {
+						if (cryptoMultisigFingerprint(&(tx->inputs[batch_pos].multisig), h) == 0) {
 							fsm_sendFailure(FailureType_Failure_Other, "Error computing multisig fingeprint");
 							signing_abort();
 							return;
@@ -501,7 +1677,7 @@ void signing_txack(TransactionType *tx)
 							multisig_fp_mismatch = true;
 						}
 					} else {
-						if (cryptoMultisigFingerprint(&(tx->inputs[0].multisig), multisig_fp) == 0) {
+						if (cryptoMultisigFingerprint(&(tx->inputs[batch_pos].multisig), multisig_fp) == 0) {
 							fsm_sendFailure(FailureType_Failure_Other, "Error computing multisig fingeprint");
 							signing_abort();
 							return;
@@ -512,9 +1688,34 @@ void signing_txack(TransactionType *tx)
 			} else { // InputScriptType_SPENDADDRESS
 				multisig_fp_mismatch = true;
 			}
-			sha256_Update(&tc, (const uint8_t *)tx->inputs, sizeof(TxInputType));
-			memcpy(&input, tx->inputs, sizeof(TxInputType));
-			send_req_2_prev_meta();
+			if (is_segwit_input(&tx->inputs[batch_pos])) {
+				if (!tx->inputs[batch_pos].has_amount) {
+					fsm_sendFailure(FailureType_Failure_Other, "Segwit input without amount");
+					signing_abort();
+					return;
+				}
+				if (tx->inputs[batch_pos].has_multisig) {
+					fsm_sendFailure(FailureType_Failure_Other, "Segwit multisig inputs are not supported");
+					signing_abort();
+					return;
+				}
+				to.is_segwit = true;
+			}
+			sha256_Update(&tc, (const uint8_t *)&tx->inputs[batch_pos], sizeof(TxInputType));
+			if (linear) {
+				cache_input(&tx->inputs[batch_pos]);
+			}
+			hash_segwit_input(&tx->inputs[batch_pos]);
+			precompute_input(&tx->inputs[batch_pos]);
+			memcpy(&input, &tx->inputs[batch_pos], sizeof(TxInputType));
+			input_spend_start = to_spend;
+			if (prevtx_cache_find(&amount)) {
+				/* Verified by an earlier transaction of this session */
+				to_spend += amount;
+				input_verified();
+			} else {
+				send_req_2_prev_meta();
+			}
 			return;
 		case STAGE_REQUEST_2_PREV_META:
 			tx_init(&tp, tx->inputs_cnt, tx->outputs_cnt, tx->version, tx->lock_time, false);
@@ -522,7 +1723,7 @@ void signing_txack(TransactionType *tx)
 			send_req_2_prev_input();
 			return;
 		case STAGE_REQUEST_2_PREV_INPUT:
-			if (!tx_serialize_input_hash(&tp, tx->inputs)) {
+			if (!tx_serialize_input_hash(&tp, &tx->inputs[batch_pos])) {
 				fsm_sendFailure(FailureType_Failure_Other, "Failed to serialize input");
 				signing_abort();
 				return;
@@ -536,13 +1737,13 @@ void signing_txack(TransactionType *tx)
 			}
 			return;
 		case STAGE_REQUEST_2_PREV_OUTPUT:
-			if (!tx_serialize_output_hash(&tp, tx->bin_outputs)) {
+			if (!tx_serialize_output_hash(&tp, &tx->bin_outputs[batch_pos])) {
 				fsm_sendFailure(FailureType_Failure_Other, "Failed to serialize output");
 				signing_abort();
 				return;
 			}
 			if (idx2 == input.prev_index) {
-				to_spend += tx->bin_outputs[0].amount;
+				to_spend += tx->bin_outputs[batch_pos].amount;
 			}
 			if (idx2 < tp.outputs_len - 1) {
 				/* Check prevtx of next input */
@@ -556,13 +1757,8 @@ void signing_txack(TransactionType *tx)
 					signing_abort();
 					return;
 				}
-				if (idx1 < inputs_count - 1) {
-					idx1++;
-					send_req_1_input();
-				} else {
-					idx1 = 0;
-					send_req_3_output();
-				}
+				prevtx_cache_add();
+				input_verified();
 			}
 			return;
 		case STAGE_REQUEST_3_OUTPUT:
@@ -573,11 +1769,11 @@ void signing_txack(TransactionType *tx)
 			 */
 			bool is_change = false;
 
-			if (tx->outputs[0].script_type == OutputScriptType_PAYTOMULTISIG &&
-			    tx->outputs[0].has_multisig &&
+			if (tx->outputs[batch_pos].script_type == OutputScriptType_PAYTOMULTISIG &&
+			    tx->outputs[batch_pos].has_multisig &&
 			    multisig_fp_set && !multisig_fp_mismatch) {
 				uint8_t h[32];
-				if (cryptoMultisigFingerprint(&(tx->outputs[0].multisig), h) == 0) {
+				if (cryptoMultisigFingerprint(&(tx->outputs[batch_pos].multisig), h) == 0) {
 					fsm_sendFailure(FailureType_Failure_Other, "Error computing multisig fingeprint");
 					signing_abort();
 					return;
@@ -586,28 +1782,28 @@ void signing_txack(TransactionType *tx)
 					is_change = true;
 				}
                         } else {
-                            if(tx->outputs[0].has_address_type) {
-                                if(check_valid_output_address(tx->outputs) == false) {
+                            if(tx->outputs[batch_pos].has_address_type) {
+                                if(check_valid_output_address(&tx->outputs[batch_pos]) == false) {
                                     fsm_sendFailure(FailureType_Failure_Other, "Invalid output address type");
                                     signing_abort();
                                     return;
                                 }
 
-                                if(tx->outputs[0].script_type == OutputScriptType_PAYTOADDRESS &&
-                                        tx->outputs[0].address_n_count > 0 &&
-                                        tx->outputs[0].address_type == OutputAddressType_CHANGE) {
+                                if(tx->outputs[batch_pos].script_type == OutputScriptType_PAYTOADDRESS &&
+                                        tx->outputs[batch_pos].address_n_count > 0 &&
+                                        tx->outputs[batch_pos].address_type == OutputAddressType_CHANGE) {
                                     is_change = true;
                                 }
                             }
-                            else if(tx->outputs[0].script_type == OutputScriptType_PAYTOADDRESS &&
-                                    tx->outputs[0].address_n_count > 0) {
+                            else if(tx->outputs[batch_pos].script_type == OutputScriptType_PAYTOADDRESS &&
+                                    tx->outputs[batch_pos].address_n_count > 0) {
                                 is_change = true;
                             }
                         }
 
 			if (is_change) {
 				if (change_spend == 0) { // not set
-					change_spend = tx->outputs[0].amount;
+					change_spend = tx->outputs[batch_pos].amount;
 				} else {
 					fsm_sendFailure(FailureType_Failure_Other, "Only one change output allowed");
 					signing_abort();
@@ -615,8 +1811,10 @@ void signing_txack(TransactionType *tx)
 			    }
 			}
 
-			spending += tx->outputs[0].amount;
-			co = compile_output(coin, root, tx->outputs, &bin_output, !is_change);
+			spending += tx->outputs[batch_pos].amount;
+			uint32_t confirm_start = get_timestamp();
+			co = compile_output(coin, root, &tx->outputs[batch_pos], &bin_output, !is_change);
+			stat_add(STAT_CONFIRM, confirm_start);
 
 			if (co < 0) {
 				fsm_sendFailure(FailureType_Failure_Other, "Signing cancelled by user");
@@ -628,11 +1826,17 @@ void signing_txack(TransactionType *tx)
 				return;
 			}
 			sha256_Update(&tc, (const uint8_t *)&bin_output, sizeof(TxOutputBinType));
+			cache_output(&bin_output);
+			hash_segwit_output(&bin_output);
 			if (idx1 < outputs_count - 1) {
 				idx1++;
 				send_req_3_output();
 			} else {
                             sha256_Final(hash_check, &tc);
+			    hash_segwit_final(&hashers[0], hash_prevouts);
+			    hash_segwit_final(&hashers[1], hash_sequence);
+			    hash_segwit_final(&hashers[2], hash_outputs);
+			    outputs_checked = true;
                             // check fees
                             if (spending > to_spend) {
                                 fsm_sendFailure(FailureType_Failure_NotEnoughFunds, "Not enough funds");
@@ -646,6 +1850,7 @@ void signing_txack(TransactionType *tx)
 
 		            coin_amnt_to_str(coin, fee, fee_str, sizeof(fee_str));
 
+		            confirm_start = get_timestamp();
                             if(fee > (uint64_t)tx_est_size * coin->maxfee_kb) {
 			        if (!confirm(ButtonRequestType_ButtonRequest_FeeOverThreshold,
 		                        "Confirm Fee", "%s", fee_str)) {
@@ -664,57 +1869,39 @@ void signing_txack(TransactionType *tx)
 		                signing_abort();
 		                return;
 		            }
+		            stat_add(STAT_CONFIRM, confirm_start);
 		            // Everything was checked, now phase 2 begins and the transaction is signed.
 		            layout_simple_message("Signing Transaction...");
 
+			    if (linear) {
+			        sha256_Init(&linear_prefix);
+			        sha256_Update(&linear_prefix, (const uint8_t *)&version, sizeof(version));
+			        ser_length_hash(&linear_prefix, inputs_count);
+			    }
+
 			    idx1 = 0;
 			    idx2 = 0;
-			    send_req_4_input();
+			    send_req_4_sign_input();
 			}
 			return;
 		}
 		case STAGE_REQUEST_4_INPUT:
 			if (idx2 == 0) {
 				tx_init(&ti, inputs_count, outputs_count, version, lock_time, true);
-				sha256_Init(&tc);
-				sha256_Update(&tc, (const uint8_t *)&inputs_count, sizeof(inputs_count));
-				sha256_Update(&tc, (const uint8_t *)&outputs_count, sizeof(outputs_count));
-				sha256_Update(&tc, (const uint8_t *)&version, sizeof(version));
-				sha256_Update(&tc, (const uint8_t *)&lock_time, sizeof(lock_time));
+				init_checksum();
 				memset(privkey, 0, 32);
 				memset(pubkey, 0, 33);
 			}
-			sha256_Update(&tc, (const uint8_t *)tx->inputs, sizeof(TxInputType));
+			sha256_Update(&tc, (const uint8_t *)&tx->inputs[batch_pos], sizeof(TxInputType));
 			if (idx2 == idx1) {
-				memcpy(&input, tx->inputs, sizeof(TxInputType));
-				memcpy(&node, root, sizeof(HDNode));
-				if (hdnode_private_ckd_cached(&node, tx->inputs[0].address_n, tx->inputs[0].address_n_count) == 0) {
-					fsm_sendFailure(FailureType_Failure_Other, "Failed to derive private key");
-					signing_abort();
-					return;
-				}
-				if (tx->inputs[0].script_type == InputScriptType_SPENDMULTISIG) {
-					if (!tx->inputs[0].has_multisig) {
-						fsm_sendFailure(FailureType_Failure_Other, "Multisig info not provided");
-						signing_abort();
-						return;
-					}
-					tx->inputs[0].script_sig.size = compile_script_multisig(&(tx->inputs[0].multisig), tx->inputs[0].script_sig.bytes);
-				} else { // SPENDADDRESS
-					ecdsa_get_pubkeyhash(node.public_key, hash);
-					tx->inputs[0].script_sig.size = compile_script_sig(coin->address_type, hash, tx->inputs[0].script_sig.bytes);
-				}
-				if (tx->inputs[0].script_sig.size == 0) {
-					fsm_sendFailure(FailureType_Failure_Other, "Failed to compile input");
-					signing_abort();
+				memcpy(&input, &tx->inputs[batch_pos], sizeof(TxInputType));
+				if (!compile_input_script(&tx->inputs[batch_pos])) {
 					return;
 				}
-				memcpy(privkey, node.private_key, 32);
-				memcpy(pubkey, node.public_key, 33);
 			} else {
-				tx->inputs[0].script_sig.size = 0;
+				tx->inputs[batch_pos].script_sig.size = 0;
 			}
-			if (!tx_serialize_input_hash(&ti, tx->inputs)) {
+			if (!tx_serialize_input_hash(&ti, &tx->inputs[batch_pos])) {
 				fsm_sendFailure(FailureType_Failure_Other, "Failed to serialize input");
 				signing_abort();
 				return;
@@ -722,13 +1909,25 @@ void signing_txack(TransactionType *tx)
 			if (idx2 < inputs_count - 1) {
 				idx2++;
 				send_req_4_input();
+			} else if (outputs_cached) {
+				/* The outputs were checked in phase 1 and kept, only the
+				 * inputs had to be streamed again */
+				sha256_Final(hash, &tc);
+				if (memcmp(hash, hash_inputs_check, 32) != 0) {
+					fsm_sendFailure(FailureType_Failure_Other, "Transaction has changed during signing");
+					signing_abort();
+					return;
+				}
+				hash_cached_outputs(&ti.ctx);
+				tx_serialize_footer_hash(&ti);
+				sign_streamed_input();
 			} else {
 				idx2 = 0;
 				send_req_4_output();
 			}
 			return;
 		case STAGE_REQUEST_4_OUTPUT:
-			co = compile_output(coin, root, tx->outputs, &bin_output, false);
+			co = compile_output(coin, root, &tx->outputs[batch_pos], &bin_output, false);
 			if (co < 0) {
 				fsm_sendFailure(FailureType_Failure_Other, "Signing cancelled by user");
 				signing_abort();
@@ -754,63 +1953,118 @@ void signing_txack(TransactionType *tx)
 					signing_abort();
 					return;
 				}
-				tx_hash_final(&ti, hash, false);
+				sign_streamed_input();
+			}
+			return;
+		case STAGE_REQUEST_4_SIGN_INPUT:
+			/* The sighash is built from what was checked in phase 1, so only the
+			 * input itself has to match */
+			if (idx1 < hashed_inputs && !check_cached_input(&tx->inputs[batch_pos])) {
+				return;
+			}
+			if (is_segwit_input(&tx->inputs[batch_pos])) {
+				/* Signed once all outputs are serialized, as part of the witness */
+				if (!compile_input_script(&tx->inputs[batch_pos])) {
+					return;
+				}
+				if (tx->inputs[batch_pos].script_type == InputScriptType_SPENDP2SHWITNESS) {
+					ecdsa_get_pubkeyhash(pubkey, hash);
+					tx->inputs[batch_pos].script_sig.size = compile_script_sig_p2sh_witness(hash, tx->inputs[batch_pos].script_sig.bytes);
+				} else {
+					tx->inputs[batch_pos].script_sig.size = 0;
+				}
 				resp.has_serialized = true;
-				resp.serialized.has_signature_index = true;
-				resp.serialized.signature_index = idx1;
-				resp.serialized.has_signature = true;
 				resp.serialized.has_serialized_tx = true;
-				ecdsa_sign_digest(&secp256k1, privkey, hash, sig, 0);
-				resp.serialized.signature.size = ecdsa_sig_to_der(sig, resp.serialized.signature.bytes);
-				if (input.script_type == InputScriptType_SPENDMULTISIG) {
-					if (!input.has_multisig) {
-						fsm_sendFailure(FailureType_Failure_Other, "Multisig info not provided");
-						signing_abort();
-						return;
-					}
-					// fill in the signature
-					int pubkey_idx = cryptoMultisigPubkeyIndex(&(input.multisig), pubkey);
-					if (pubkey_idx < 0) {
-						fsm_sendFailure(FailureType_Failure_Other, "Pubkey not found in multisig script");
-						signing_abort();
-						return;
-					}
-					memcpy(input.multisig.signatures[pubkey_idx].bytes, resp.serialized.signature.bytes, resp.serialized.signature.size);
-					input.multisig.signatures[pubkey_idx].size = resp.serialized.signature.size;
-					input.script_sig.size = serialize_script_multisig(&(input.multisig), input.script_sig.bytes);
-					if (input.script_sig.size == 0) {
-						fsm_sendFailure(FailureType_Failure_Other, "Failed to serialize multisig script");
-						signing_abort();
-						return;
-					}
-				} else { // SPENDADDRESS
-					input.script_sig.size = serialize_script_sig(resp.serialized.signature.bytes, resp.serialized.signature.size, pubkey, 33, input.script_sig.bytes);
+				resp.serialized.serialized_tx.size += tx_serialize_input(&to, &tx->inputs[batch_pos], resp.serialized.serialized_tx.bytes + resp.serialized.serialized_tx.size);
+			} else if (idx1 < hashed_inputs) {
+				memcpy(&input, &tx->inputs[batch_pos], sizeof(TxInputType));
+				if (!compile_input_script(&tx->inputs[batch_pos])) {
+					return;
 				}
-				resp.serialized.serialized_tx.size = tx_serialize_input(&to, &input, resp.serialized.serialized_tx.bytes);
-
-				if (idx1 < inputs_count - 1) {
-					idx1++;
-					idx2 = 0;
-					send_req_4_input();
-				} else {
-					idx1 = 0;
-					send_req_5_output();
+				linear_sighash(&tx->inputs[batch_pos], hash);
+				if (!sign_input()) {
+					return;
 				}
+			} else {
+				/* Stream the whole transaction again for its legacy sighash */
+				idx2 = 0;
+				send_req_4_input();
+				return;
+			}
+			if (linear) {
+				hash_empty_input(&linear_prefix, idx1);
+			}
+			if (idx1 < inputs_count - 1) {
+				idx1++;
+				send_req_4_sign_input();
+			} else {
+				idx1 = 0;
+				send_req_5_output();
 			}
 			return;
 		case STAGE_REQUEST_5_OUTPUT:
-			if (compile_output(coin, root, tx->outputs, &bin_output,false) <= 0) {
+			if (compile_output(coin, root, &tx->outputs[batch_pos], &bin_output,false) <= 0) {
 				fsm_sendFailure(FailureType_Failure_Other, "Failed to compile output");
 				signing_abort();
 				return;
 			}
 			resp.has_serialized = true;
 			resp.serialized.has_serialized_tx = true;
-			resp.serialized.serialized_tx.size = tx_serialize_output(&to, &bin_output, resp.serialized.serialized_tx.bytes);
+			resp.serialized.serialized_tx.size += tx_serialize_output(&to, &bin_output, resp.serialized.serialized_tx.bytes + resp.serialized.serialized_tx.size);
 			if (idx1 < outputs_count - 1) {
 				idx1++;
 				send_req_5_output();
+			} else if (to.is_segwit) {
+				idx1 = 0;
+				send_req_segwit_witness();
+			} else {
+				send_req_finished();
+				signing_abort();
+			}
+			return;
+		case STAGE_REQUEST_SEGWIT_WITNESS:
+			if (idx1 < hashed_inputs && !check_cached_input(&tx->inputs[batch_pos])) {
+				return;
+			}
+			/* Inputs without a kept hash are checked all at once at the end */
+			if (hashed_inputs < inputs_count) {
+				if (idx1 == 0) {
+					init_checksum();
+				}
+				sha256_Update(&tc, (const uint8_t *)&tx->inputs[batch_pos], sizeof(TxInputType));
+			}
+			if (is_segwit_input(&tx->inputs[batch_pos])) {
+				/* The amount is committed to by the signature, it must not exceed
+				 * what was checked against the previous transactions */
+				if (tx->inputs[batch_pos].amount > segwit_to_spend) {
+					fsm_sendFailure(FailureType_Failure_Other, "Transaction has changed during signing");
+					signing_abort();
+					return;
+				}
+				segwit_to_spend -= tx->inputs[batch_pos].amount;
+				if (!compile_input_script(&tx->inputs[batch_pos])) {
+					return;
+				}
+				segwit_sighash(&tx->inputs[batch_pos], hash);
+				sign_segwit_input();
+			} else {
+				const uint8_t empty_witness = 0x00;
+				resp.has_serialized = true;
+				resp.serialized.has_serialized_tx = true;
+				resp.serialized.serialized_tx.size += tx_serialize_witness(&to, &empty_witness, 1, resp.serialized.serialized_tx.bytes + resp.serialized.serialized_tx.size);
+			}
+			if (idx1 < inputs_count - 1) {
+				idx1++;
+				send_req_segwit_witness();
 			} else {
+				if (hashed_inputs < inputs_count) {
+					sha256_Final(hash, &tc);
+					if (memcmp(hash, hash_inputs_check, 32) != 0) {
+						fsm_sendFailure(FailureType_Failure_Other, "Transaction has changed during signing");
+						signing_abort();
+						return;
+					}
+				}
 				send_req_finished();
 				signing_abort();
 			}
@@ -821,10 +2075,105 @@ void signing_txack(TransactionType *tx)
 	signing_abort();
 }
 
+void signing_txack(TransactionType *tx)
+{
+	uint32_t stage = signing_stage, start;
+
+	if (!signing) {
+		fsm_sendFailure(FailureType_Failure_UnexpectedMessage, "Not in Signing mode");
+		go_home();
+		return;
+	}
+
+	request_answered();
+	start = get_timestamp();
+	memset(&resp, 0, sizeof(TxRequest));
+
+	batch_items = txack_items(tx);
+	if (signing_stage != STAGE_REQUEST_2_PREV_META &&
+	    (batch_items == 0 || batch_items > batch_request.request_count)) {
+		fsm_sendFailure(FailureType_Failure_Other, "Unexpected number of transaction items");
+		signing_abort();
+		return;
+	}
+
+	/* Consume the items in order for as long as the next request asks for
+	 * the next one of them */
+	batch_tx = tx;
+	batch_next = true;
+	for (batch_pos = 0; batch_next; batch_pos++) {
+		batch_next = false;
+		signing_txack_item(tx);
+	}
+	batch_tx = NULL;
+	stat_add(STAT_WORK + stage, start);
+}
+
 void signing_abort(void)
 {
 	if (signing) {
 		go_home();
 		signing = false;
 	}
+	set_confirm_idle_handler(NULL);
+	memset(precomputed, 0, sizeof(precomputed));
+	outputs_checked = false;
+	request_pending = false;
+}
+
+#if DEBUG_LINK
+/*
+ * signing_get_stats() - Report the signing telemetry collected since the last clear
+ *
+ * INPUT
+ *     - stats: DebugLinkSigningStats response to fill in
+ * OUTPUT
+ *     none
+ */
+void signing_get_stats(DebugLinkSigningStats *stats)
+{
+	static const char *const stage_names[SIGNING_STAGES] = {
+		"input", "prev_meta", "prev_input", "prev_output", "output",
+		"legacy_input", "legacy_output", "sign_input", "serialize_output", "witness"
+	};
+	static const char *const op_names[SIGNING_STATS - STAT_RAW_TX] = {
+		"raw_tx", "derive", "sign", "confirm", "idle"
+	};
+	SigningStatType *out;
+	uint32_t i;
+
+	stats->has_clock_hz = true;
+	stats->clock_hz = get_timestamp_hz();
+
+	for (i = 0; i < SIGNING_STATS; i++) {
+		out = &stats->stats[stats->stats_count++];
+		out->has_name = true;
+		if (i < STAT_WORK) {
+			snprintf(out->name, sizeof(out->name), "%s_wait", stage_names[i - STAT_WAIT]);
+		} else if (i < STAT_RAW_TX) {
+			snprintf(out->name, sizeof(out->name), "%s_work", stage_names[i - STAT_WORK]);
+		} else {
+			snprintf(out->name, sizeof(out->name), "%s", op_names[i - STAT_RAW_TX]);
+		}
+		out->has_count = true;
+		out->count = signing_stats[i].count;
+		out->has_total = true;
+		out->total = signing_stats[i].total;
+		out->has_max = true;
+		out->max = signing_stats[i].max;
+	}
+}
+
+/*
+ * signing_clear_stats() - Start collecting signing telemetry afresh
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+void signing_clear_stats(void)
+{
+	memset(signing_stats, 0, sizeof(signing_stats));
 }
+#endif
@@ -26,6 +26,7 @@
 
 #include <bip39.h>
 #include <aes.h>
+#include <hmac.h>
 #include <pbkdf2.h>
 #include <keepkey_board.h>
 #include <pbkdf2.h>
@@ -38,12 +39,25 @@
 #include "storage.h"
 #include "passphrase_sm.h"
 #include "fsm.h"
+#include "node_cache.h"
+#include "signing.h"
+#include "crypto.h"
 
 /* === Private Variables =================================================== */
 
 static bool   sessionRootNodeCached;
 static HDNode sessionRootNode;
 
+/* Root nodes of recently used passphrases, most recent first */
+static struct
+{
+    bool set;
+    uint8_t passphrase_hash[32];
+    HDNode node;
+} sessionRootNodeLru[ROOT_NODE_LRU_SIZE];
+static bool sessionRootNodeLruSalted;
+static uint8_t sessionRootNodeLruSalt[32];
+
 static bool sessionPinCached;
 static char sessionPin[17];
 
@@ -51,6 +65,9 @@ static bool sessionPassphraseCached;
 static char sessionPassphrase[51];
 static Allocation storage_location = FLASH_INVALID;
 
+/* Set when the seed or passphrase setting changes, node cache is erased on next commit */
+static bool nodeCacheInvalid;
+
 /* === Variables =========================================================== */
 
 /* Shadow memory for configuration data in storage partition */
@@ -171,6 +188,92 @@ static bool storage_get_root_node_cache(HDNode *node)
     return false;
 }
 
+/*
+ * session_passphrase_hash() - Hash session passphrase with per boot salt
+ *
+ * INPUT
+ *     - hash: buffer for 32 byte hash
+ * OUTPUT
+ *     none
+ *
+ */
+static void session_passphrase_hash(uint8_t *hash)
+{
+    if(!sessionRootNodeLruSalted)
+    {
+        random_buffer(sessionRootNodeLruSalt, sizeof(sessionRootNodeLruSalt));
+        sessionRootNodeLruSalted = true;
+    }
+
+    hmac_sha256(sessionRootNodeLruSalt, sizeof(sessionRootNodeLruSalt),
+                (const uint8_t *)sessionPassphrase, strlen(sessionPassphrase), hash);
+}
+
+/*
+ * session_get_root_node_lru() - Find root node of session passphrase in LRU
+ *
+ * INPUT
+ *     - node: hd node to be filled with found root node
+ * OUTPUT
+ *     true/false whether root node was found
+ *
+ */
+static bool session_get_root_node_lru(HDNode *node)
+{
+    uint8_t hash[32];
+    bool found = false;
+
+    session_passphrase_hash(hash);
+
+    for(int i = 0; i < ROOT_NODE_LRU_SIZE; i++)
+    {
+        if(sessionRootNodeLru[i].set &&
+                memcmp(sessionRootNodeLru[i].passphrase_hash, hash, sizeof(hash)) == 0)
+        {
+            memcpy(node, &sessionRootNodeLru[i].node, sizeof(HDNode));
+
+            /* Move entry to front */
+            for(; i > 0; i--)
+            {
+                memcpy(&sessionRootNodeLru[i], &sessionRootNodeLru[i - 1],
+                       sizeof(sessionRootNodeLru[i]));
+            }
+
+            sessionRootNodeLru[0].set = true;
+            memcpy(sessionRootNodeLru[0].passphrase_hash, hash, sizeof(hash));
+            memcpy(&sessionRootNodeLru[0].node, node, sizeof(HDNode));
+            found = true;
+            break;
+        }
+    }
+
+    memset(hash, 0, sizeof(hash));
+    return found;
+}
+
+/*
+ * session_set_root_node_lru() - Add root node of session passphrase to LRU
+ *
+ * INPUT
+ *     - node: root node derived with session passphrase
+ * OUTPUT
+ *     none
+ *
+ */
+static void session_set_root_node_lru(const HDNode *node)
+{
+    /* Least recently used entry drops off the end */
+    for(int i = ROOT_NODE_LRU_SIZE - 1; i > 0; i--)
+    {
+        memcpy(&sessionRootNodeLru[i], &sessionRootNodeLru[i - 1],
+               sizeof(sessionRootNodeLru[i]));
+    }
+
+    sessionRootNodeLru[0].set = true;
+    session_passphrase_hash(sessionRootNodeLru[0].passphrase_hash);
+    memcpy(&sessionRootNodeLru[0].node, node, sizeof(HDNode));
+}
+
 /* === Functions =========================================================== */
 
 /*
@@ -230,6 +333,9 @@ void storage_init(void)
         storage_reset_uuid();
         storage_commit();
     }
+
+    /* Loading the config is not a reset, keep the node cache */
+    nodeCacheInvalid = false;
 }
 
 /*
@@ -264,6 +370,7 @@ void storage_reset(void)
     memset(&shadow_config.cache, 0, sizeof(shadow_config.cache));
 
     shadow_config.storage.version = STORAGE_VERSION;
+    nodeCacheInvalid = true;
     session_clear(true); // clear PIN as well
 }
 
@@ -281,13 +388,32 @@ void session_clear(bool clear_pin)
     memset(&sessionRootNode, 0, sizeof(sessionRootNode));
     sessionPassphraseCached = false;
     memset(&sessionPassphrase, 0, sizeof(sessionPassphrase));
+    signing_prevtx_cache_clear();
+    cryptoMultisigCacheClear();
+    cryptoXpubCacheClear();
 
     if(clear_pin)
     {
         sessionPinCached = false;
+        session_clear_root_node_lru();
     }
 }
 
+/*
+ * session_clear_root_node_lru() - Forget root nodes of all recent passphrases
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+void session_clear_root_node_lru(void)
+{
+    memset(sessionRootNodeLru, 0, sizeof(sessionRootNodeLru));
+    memset(sessionRootNodeLruSalt, 0, sizeof(sessionRootNodeLruSalt));
+    sessionRootNodeLruSalted = false;
+}
+
 /*
  * storage_commit() - Write content of configuration in shadow memory to
  * storage partion in flash
@@ -301,6 +427,12 @@ void storage_commit(void)
 {
     uint32_t shadow_ram_crc32, shadow_flash_crc32, retries;
 
+    if(nodeCacheInvalid)
+    {
+        node_cache_clear();
+        nodeCacheInvalid = false;
+    }
+
     memcpy((void *)&shadow_config, STORAGE_MAGIC_STR, STORAGE_MAGIC_LEN);
 
     for(retries = 0; retries < STORAGE_RETRIES; retries++)
@@ -695,6 +827,13 @@ bool storage_get_root_node(HDNode *node)
             return false;
         }
 
+        if(session_get_root_node_lru(&sessionRootNode))
+        {
+            memcpy(node, &sessionRootNode, sizeof(HDNode));
+            sessionRootNodeCached = true;
+            return true;
+        }
+
         layout_loading();
 
         if(hdnode_from_xprv(shadow_config.storage.node.depth,
@@ -734,6 +873,8 @@ bool storage_get_root_node(HDNode *node)
                             &ctx);
         }
 
+        session_set_root_node_lru(&sessionRootNode);
+
         memcpy(node, &sessionRootNode, sizeof(HDNode));
         sessionRootNodeCached = true;
         return true;
@@ -752,6 +893,13 @@ bool storage_get_root_node(HDNode *node)
             return true;
         }
 
+        if(session_get_root_node_lru(&sessionRootNode))
+        {
+            memcpy(node, &sessionRootNode, sizeof(HDNode));
+            sessionRootNodeCached = true;
+            return true;
+        }
+
         layout_loading();
 
         uint8_t seed[64];
@@ -767,6 +915,7 @@ bool storage_get_root_node(HDNode *node)
         }
 
         storage_set_root_node_cache(&sessionRootNode);
+        session_set_root_node_lru(&sessionRootNode);
 
         memcpy(node, &sessionRootNode, sizeof(HDNode));
         sessionRootNodeCached = true;
@@ -836,6 +985,11 @@ bool storage_get_passphrase_protected(void)
  */
 void storage_set_passphrase_protected(bool passphrase)
 {
+    if(storage_get_passphrase_protected() != passphrase)
+    {
+        nodeCacheInvalid = true;
+    }
+
     shadow_config.storage.has_passphrase_protection = true;
     shadow_config.storage.passphrase_protection = passphrase;
 }
@@ -259,12 +259,12 @@ uint32_t compile_script_multisig(const MultisigRedeemScriptType *multisig, uint8
 	if (n < 1 || n > 15) return 0;
 	uint32_t i, r = 0;
 	if (out) {
+		const uint8_t *pubkeys = cryptoMultisigPubkeys(multisig);
+		if (!pubkeys) return 0;
 		out[r] = 0x50 + m; r++;
 		for (i = 0; i < n; i++) {
 			out[r] = 33; r++; // OP_PUSH 33
-			const uint8_t *pubkey = cryptoHDNodePathToPubkey(&(multisig->pubkeys[i]));
-			if (!pubkey) return 0;
-			memcpy(out + r, pubkey, 33); r += 33;
+			memcpy(out + r, pubkeys + i * 33, 33); r += 33;
 		}
 		out[r] = 0x50 + n; r++;
 		out[r] = 0xAE; r++; // OP_CHECKMULTISIG
@@ -282,6 +282,9 @@ uint32_t compile_script_multisig_hash(const MultisigRedeemScriptType *multisig,
 	if (m < 1 || m > 15) return 0;
 	if (n < 1 || n > 15) return 0;
 
+	const uint8_t *pubkeys = cryptoMultisigPubkeys(multisig);
+	if (!pubkeys) return 0;
+
 	SHA256_CTX ctx;
 	sha256_Init(&ctx);
 
@@ -290,9 +293,7 @@ uint32_t compile_script_multisig_hash(const MultisigRedeemScriptType *multisig,
 	uint32_t i;
 	for (i = 0; i < n; i++) {
 		d[0] = 33; sha256_Update(&ctx, d, 1); // OP_PUSH 33
-		const uint8_t *pubkey = cryptoHDNodePathToPubkey(&(multisig->pubkeys[i]));
-		if (!pubkey) return 0;
-		sha256_Update(&ctx, pubkey, 33);
+		sha256_Update(&ctx, pubkeys + i * 33, 33);
 	}
 	d[0] = 0x50 + n;
 	d[1] = 0xAE;
@@ -314,6 +315,28 @@ uint32_t serialize_script_sig(const uint8_t *signature, uint32_t signature_len,
 	return r;
 }
 
+// scriptSig of a P2SH-P2WPKH input, pushing the witness program as redeem script
+uint32_t compile_script_sig_p2sh_witness(const uint8_t *pubkeyhash, uint8_t *out)
+{
+	out[0] = 0x16; // pushing 22 bytes
+	out[1] = 0x00; // witness version 0
+	out[2] = 0x14; // pushing 20 bytes
+	memcpy(out + 3, pubkeyhash, 20);
+	return 23;
+}
+
+uint32_t serialize_witness_sig(const uint8_t *signature, uint32_t signature_len, const uint8_t *pubkey, uint32_t pubkey_len, uint8_t *out)
+{
+	uint32_t r = 0;
+	out[r] = 0x02; r++; // stack items
+	r += ser_length(signature_len + 1, out + r);
+	memcpy(out + r, signature, signature_len); r += signature_len;
+	out[r] = 0x01; r++;
+	r += ser_length(pubkey_len, out + r);
+	memcpy(out + r, pubkey, pubkey_len); r += pubkey_len;
+	return r;
+}
+
 uint32_t serialize_script_multisig(const MultisigRedeemScriptType *multisig, uint8_t *out)
 {
 	uint32_t i, r = 0;
@@ -339,8 +362,13 @@ uint32_t serialize_script_multisig(const MultisigRedeemScriptType *multisig, uin
 
 uint32_t tx_serialize_header(TxStruct *tx, uint8_t *out)
 {
+	uint32_t r = 4;
 	memcpy(out, &(tx->version), 4);
-	return 4 + ser_length(tx->inputs_len, out + 4);
+	if (tx->is_segwit) {
+		out[r++] = 0x00; // marker
+		out[r++] = 0x01; // flag
+	}
+	return r + ser_length(tx->inputs_len, out + r);
 }
 
 uint32_t tx_serialize_header_hash(TxStruct *tx)
@@ -453,7 +481,28 @@ uint32_t tx_serialize_output(TxStruct *tx, const TxOutputBinType *output, uint8_
 	r += ser_length(output->script_pubkey.size, out + r);
 	memcpy(out + r, output->script_pubkey.bytes, output->script_pubkey.size); r+= output->script_pubkey.size;
 	tx->have_outputs++;
-	if (tx->have_outputs == tx->outputs_len) {
+	// witnesses go between the outputs and the lock time
+	if (tx->have_outputs == tx->outputs_len && !tx->is_segwit) {
+		r += tx_serialize_footer(tx, out + r);
+	}
+	tx->size += r;
+	return r;
+}
+
+uint32_t tx_serialize_witness(TxStruct *tx, const uint8_t *witness, uint32_t witness_len, uint8_t *out)
+{
+	if (!tx->is_segwit || tx->have_outputs < tx->outputs_len) {
+		// not a segwit transaction or not all outputs provided
+		return 0;
+	}
+	if (tx->have_witnesses >= tx->inputs_len) {
+		// already got all witnesses
+		return 0;
+	}
+	uint32_t r = 0;
+	memcpy(out + r, witness, witness_len); r += witness_len;
+	tx->have_witnesses++;
+	if (tx->have_witnesses == tx->inputs_len) {
 		r += tx_serialize_footer(tx, out + r);
 	}
 	tx->size += r;
@@ -492,8 +541,10 @@ void tx_init(TxStruct *tx, uint32_t inputs_len, uint32_t outputs_len, uint32_t v
 	tx->version = version;
 	tx->lock_time = lock_time;
 	tx->add_hash_type = add_hash_type;
+	tx->is_segwit = false;
 	tx->have_inputs = 0;
 	tx->have_outputs = 0;
+	tx->have_witnesses = 0;
 	tx->size = 0;
 	sha256_Init(&(tx->ctx));
 }
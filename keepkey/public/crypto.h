@@ -52,6 +52,9 @@ int cryptoMessageDecrypt(curve_point *nonce, uint8_t *payload, size_t payload_le
                          const uint8_t *hmac, size_t hmac_len, const uint8_t *privkey, uint8_t *msg,
                          size_t *msg_len, bool *display_only, bool *signing, uint8_t *address_raw);
 uint8_t *cryptoHDNodePathToPubkey(const HDNodePathType *hdnodepath);
+const uint8_t *cryptoMultisigPubkeys(const MultisigRedeemScriptType *multisig);
+void cryptoMultisigCacheClear(void);
+void cryptoXpubCacheClear(void);
 int cryptoMultisigPubkeyIndex(const MultisigRedeemScriptType *multisig,
                               const uint8_t *pubkey);
 int cryptoMultisigFingerprint(const MultisigRedeemScriptType *multisig, uint8_t *hash);
@@ -35,7 +35,6 @@
 #define ENTROPY_BUF sizeof(((Entropy *)NULL)->entropy.bytes)
 
 #define BTC_ADDRESS_SIZE     	35
-#define RAW_TX_ACK_VARINT_COUNT	4
 
 /* === Functions =========================================================== */
 
@@ -53,6 +52,7 @@ void fsm_msgFirmwareErase(FirmwareErase *msg);
 void fsm_msgFirmwareUpload(FirmwareUpload *msg);
 void fsm_msgGetEntropy(GetEntropy *msg);
 void fsm_msgGetPublicKey(GetPublicKey *msg);
+void fsm_msgGetPublicKeys(GetPublicKeys *msg);
 void fsm_msgLoadDevice(LoadDevice *msg);
 void fsm_msgResetDevice(ResetDevice *msg);
 void fsm_msgSignTx(SignTx *msg);
@@ -65,6 +65,7 @@ void fsm_msgClearSession(ClearSession *msg);
 void fsm_msgApplySettings(ApplySettings *msg);
 //void fsm_msgButtonAck(ButtonAck *msg);
 void fsm_msgGetAddress(GetAddress *msg);
+void fsm_msgGetAddresses(GetAddresses *msg);
 void fsm_msgEntropyAck(EntropyAck *msg);
 void fsm_msgSignMessage(SignMessage *msg);
 void fsm_msgVerifyMessage(VerifyMessage *msg);
@@ -81,6 +82,7 @@ void fsm_msgCharacterAck(CharacterAck *msg);
 //void fsm_msgDebugLinkDecision(DebugLinkDecision *msg);
 void fsm_msgDebugLinkGetState(DebugLinkGetState *msg);
 void fsm_msgDebugLinkStop(DebugLinkStop *msg);
+void fsm_msgDebugLinkGetSigningStats(DebugLinkGetSigningStats *msg);
 #endif
 
 #endif
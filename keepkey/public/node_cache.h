@@ -0,0 +1,57 @@
+/*
+ * This file is part of the KeepKey project.
+ *
+ * Copyright (C) 2016 KeepKey LLC
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NODE_CACHE_H
+#define NODE_CACHE_H
+
+/* === Includes ============================================================ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <bip32.h>
+
+/* === Defines ============================================================= */
+
+#define NODE_CACHE_MAGIC        0x6863636e  /* "ncch" */
+#define NODE_CACHE_MAX_DEPTH    3   /* purpose'/coin'/account' */
+
+/* === Typedefs ============================================================ */
+
+/* One append-only record in the node cache flash sector */
+typedef struct
+{
+    uint32_t magic;             /* written last, 0xFFFFFFFF marks a free slot */
+    uint8_t id[12];             /* HMAC of the path under the root's cache key */
+    uint8_t iv[16];
+    uint8_t payload[112];       /* AES-256-CBC encrypted node */
+    uint8_t mac[16];            /* HMAC over id, iv and payload */
+} NodeCacheRecord;
+
+/* === Functions =========================================================== */
+
+size_t node_cache_account_depth(const uint32_t *address_n, size_t address_n_count);
+bool node_cache_get(const HDNode *root, const uint32_t *address_n, size_t address_n_count,
+                    HDNode *node);
+void node_cache_set(const HDNode *root, const uint32_t *address_n, size_t address_n_count,
+                    const HDNode *node);
+void node_cache_clear(void);
+
+#endif
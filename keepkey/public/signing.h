@@ -34,7 +34,6 @@
  * progress per input in permille with these many additional bits.
  */
 #define PROGRESS_PRECISION 16
-#define VAR_INT_BUFFER 8
 
 /* === Functions =========================================================== */
 
@@ -43,5 +42,11 @@ void signing_init(uint32_t _inputs_count, uint32_t _outputs_count, const CoinTyp
 void signing_abort(void);
 void parse_raw_txack(uint8_t *msg, uint32_t msg_size);
 void signing_txack(TransactionType *tx);
+void signing_prevtx_cache_clear(void);
+
+#if DEBUG_LINK
+void signing_get_stats(DebugLinkSigningStats *stats);
+void signing_clear_stats(void);
+#endif
 
 #endif
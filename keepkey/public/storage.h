@@ -35,12 +35,16 @@
 
 #define STORAGE_RETRIES 3
 
+/* Number of session root nodes kept for alternating passphrases */
+#define ROOT_NODE_LRU_SIZE 4
+
 /* === Functions =========================================================== */
 
 void storage_init(void);
 void storage_reset_uuid(void);
 void storage_reset(void);
 void session_clear(bool clear_pin);
+void session_clear_root_node_lru(void);
 void storage_commit(void);
 
 void storage_load_device(LoadDevice *msg);
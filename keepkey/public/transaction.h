@@ -37,9 +37,11 @@ typedef struct {
 	uint32_t version;
 	uint32_t lock_time;
 	bool add_hash_type;
+	bool is_segwit;		/* serialize with marker, flag and witnesses */
 
 	uint32_t have_inputs;
 	uint32_t have_outputs;
+	uint32_t have_witnesses;
 	uint32_t size;
 
 	SHA256_CTX ctx;
@@ -52,13 +54,17 @@ uint32_t compile_script_multisig(const MultisigRedeemScriptType *multisig, uint8
 uint32_t compile_script_multisig_hash(const MultisigRedeemScriptType *multisig, uint8_t *hash);
 uint32_t serialize_script_sig(const uint8_t *signature, uint32_t signature_len, const uint8_t *pubkey, uint32_t pubkey_len, uint8_t *out);
 uint32_t serialize_script_multisig(const MultisigRedeemScriptType *multisig, uint8_t *out);
+uint32_t compile_script_sig_p2sh_witness(const uint8_t *pubkeyhash, uint8_t *out);
+uint32_t serialize_witness_sig(const uint8_t *signature, uint32_t signature_len, const uint8_t *pubkey, uint32_t pubkey_len, uint8_t *out);
 int compile_output(const CoinType *coin, const HDNode *root, TxOutputType *in, TxOutputBinType *out, bool needs_confirm);
 uint32_t tx_serialize_input(TxStruct *tx, const TxInputType *input, uint8_t *out);
 uint32_t tx_serialize_output(TxStruct *tx, const TxOutputBinType *output, uint8_t *out);
+uint32_t tx_serialize_witness(TxStruct *tx, const uint8_t *witness, uint32_t witness_len, uint8_t *out);
 
 void tx_init(TxStruct *tx, uint32_t inputs_len, uint32_t outputs_len, uint32_t version, uint32_t lock_time, bool add_hash_type);
 uint32_t tx_serialize_input_hash(TxStruct *tx, const TxInputType *input);
 uint32_t tx_serialize_output_hash(TxStruct *tx, const TxOutputBinType *output);
+uint32_t tx_serialize_footer_hash(TxStruct *tx);
 void tx_hash_final(TxStruct *t, uint8_t *hash, bool reverse);
 
 uint32_t transactionEstimateSize(uint32_t inputs, uint32_t outputs);
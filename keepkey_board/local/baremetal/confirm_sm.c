@@ -42,6 +42,9 @@
 /* Button request ack */
 static bool button_request_acked = false;
 
+/* Work done between screen refreshes while the screen is not animating */
+static confirm_idle_handler_t confirm_idle_handler = NULL;
+
 /* === Variables =========================================================== */
 
 extern bool reset_msg_stack;
@@ -298,6 +301,12 @@ static bool confirm_helper(const char *request_title, const char *request_body,
 
         display_refresh();
         animate();
+
+        /* Animations get every pass, the idle work only static screens */
+        if(confirm_idle_handler && !is_animating())
+        {
+            (*confirm_idle_handler)();
+        }
     }
 
 confirm_helper_exit:
@@ -453,4 +462,17 @@ bool review_without_button_request(const char *request_title, const char *reques
 
     confirm_helper(request_title, strbuf, &layout_standard_notification);
     return true;
-}
\ No newline at end of file
+}
+
+/*
+ * set_confirm_idle_handler() - Set function to run while confirmations wait for the user
+ *
+ * INPUT
+ *     - idle_func: function doing a short unit of work per call, NULL for none
+ * OUTPUT
+ *     none
+ */
+void set_confirm_idle_handler(confirm_idle_handler_t idle_func)
+{
+    confirm_idle_handler = idle_func;
+}
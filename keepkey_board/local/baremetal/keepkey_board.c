@@ -78,6 +78,8 @@ __attribute__((noreturn)) void __stack_chk_fail(void)
  */
 void board_reset(void)
 {
+    /* Let responses still queued for the host go out first */
+    usb_tx_flush();
     scb_reset_system();
 }
 
@@ -132,9 +132,17 @@ bool flash_write_word(Allocation group, uint32_t offset, uint32_t len, uint8_t *
 
     start += offset ;
 
+    if(len == 0) {
+        goto fww_exit;
+    }
+
     /* Byte writes for flash start address not long-word aligned */
     if(start % sizeof(uint32_t)) {
         align_cnt = sizeof(uint32_t) - start % sizeof(uint32_t);
+        /* Data may end before the next long-word boundary */
+        if(align_cnt > len) {
+            align_cnt = len;
+        }
         flash_program(start, data, align_cnt);
         if(flash_chk_status() == false) {
             retval = false;
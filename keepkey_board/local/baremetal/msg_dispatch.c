@@ -42,6 +42,17 @@ static bool msg_tiny_flag = false;
 static uint8_t msg_tiny[MSG_TINY_BFR_SZ];
 static uint16_t msg_tiny_id = MSG_TINY_TYPE_ERROR; /* Default to error type */
 
+/* Report being filled by usb_write_pb() */
+static uint8_t tx_report[USB_SEGMENT_SIZE];
+static uint32_t tx_report_pos;
+
+/* Report a message is being decoded from and bytes of its frame received */
+static UsbMessage rx_report;
+static uint32_t rx_report_pos;
+static uint32_t content_pos = 0;
+
+static uint8_t decode_buffer[MAX_DECODE_SIZE] __attribute__((aligned(4)));
+
 /* === Variables =========================================================== */
 
 /* Allow mapped messages to reset message stack.  This variable by itself doesn't
@@ -104,7 +115,52 @@ static const pb_field_t *message_fields(MessageMapType type, MessageType msg_id,
 }
 
 /*
- * usb_write_pb() - Add usb frame header info to message buffer and perform usb transmission
+ * usb_report_write() - Output stream callback filling USB reports and sending
+ * each one as soon as it is full
+ *
+ * INPUT
+ *     - stream: output stream, state points to the usb tx handler
+ *     - buf: encoded bytes
+ *     - count: number of encoded bytes
+ * OUTPUT
+ *     true
+ */
+static bool usb_report_write(pb_ostream_t *stream, const uint8_t *buf, size_t count)
+{
+    usb_tx_handler_t *usb_tx_handler = (usb_tx_handler_t *)stream->state;
+    size_t chunk;
+
+    while(count > 0)
+    {
+        chunk = sizeof(tx_report) - tx_report_pos;
+
+        if(chunk > count)
+        {
+            chunk = count;
+        }
+
+        memcpy(tx_report + tx_report_pos, buf, chunk);
+        tx_report_pos += chunk;
+        buf += chunk;
+        count -= chunk;
+
+        if(tx_report_pos == sizeof(tx_report))
+        {
+            (**usb_tx_handler)(tx_report, sizeof(tx_report));
+
+            /* Keep the '?' of the report, continuation data follows it */
+            tx_report_pos = sizeof(TrezorFrameFragment);
+        }
+    }
+
+    return(true);
+}
+
+/*
+ * usb_write_pb() - Add usb frame header info to message and perform usb transmission
+ *
+ * The message is encoded straight into 64 byte reports, each of them is handed
+ * to the usb tx handler as soon as it is full.
  *
  * INPUT
  *     - fields: protocol buffer
@@ -119,57 +175,129 @@ static void usb_write_pb(const pb_field_t *fields, const void *msg, MessageType
 {
     assert(fields != NULL);
 
-    TrezorFrameBuffer framebuf;
-    memset(&framebuf, 0, sizeof(framebuf));
-    framebuf.frame.usb_header.hid_type = '?';
-    framebuf.frame.header.pre1 = '#';
-    framebuf.frame.header.pre2 = '#';
-    framebuf.frame.header.id = __builtin_bswap16(id);
+    TrezorFrame *frame = (TrezorFrame *)tx_report;
+    pb_ostream_t os =
+    {
+        .callback = &usb_report_write,
+        .state = &usb_tx_handler,
+        .max_size = MAX_FRAME_SIZE,
+        .bytes_written = 0
+    };
+    size_t len;
+
+    /* Header carries the length, so it has to be known before the first report */
+    if(!pb_get_encoded_size(&len, fields, msg) || len > MAX_FRAME_SIZE)
+    {
+        return;
+    }
+
+    frame->usb_header.hid_type = '?';
+    frame->header.pre1 = '#';
+    frame->header.pre2 = '#';
+    frame->header.id = __builtin_bswap16(id);
+    frame->header.len = __builtin_bswap32(len);
+    tx_report_pos = sizeof(TrezorFrame);
+
+    if(pb_encode(&os, fields, msg) && tx_report_pos > sizeof(TrezorFrameFragment))
+    {
+        /* Send the last, partially filled report */
+        memset(tx_report + tx_report_pos, 0, sizeof(tx_report) - tx_report_pos);
+        (*usb_tx_handler)(tx_report, sizeof(tx_report));
+    }
+}
+
+/*
+ * usb_report_read() - Input stream callback reading the frame from rx_report,
+ * taking further reports off the endpoint as it runs out
+ *
+ * INPUT
+ *     - stream: input stream
+ *     - buf: where to put the bytes
+ *     - count: number of bytes
+ * OUTPUT
+ *     true/false whether the host sent them in time
+ */
+static bool usb_report_read(pb_istream_t *stream, uint8_t *buf, size_t count)
+{
+    size_t chunk;
 
-    pb_ostream_t os = pb_ostream_from_buffer(framebuf.buffer,
-                      sizeof(framebuf.buffer));
+    (void)stream;
 
-    if(pb_encode(&os, fields, msg))
+    while(count > 0)
     {
-        framebuf.frame.header.len = __builtin_bswap32(os.bytes_written);
-        (*usb_tx_handler)((uint8_t *)&framebuf, sizeof(framebuf.frame) + os.bytes_written);
+        while(rx_report_pos >= rx_report.len)
+        {
+            if(!usb_rx_next(&rx_report, MSG_REPORT_TIMEOUT_MS))
+            {
+                rx_report.len = 0;
+                rx_report_pos = 0;
+                return(false);
+            }
+
+            /* Reports without the marker are ignored, as in usb_rx_helper() */
+            if(rx_report.len < sizeof(TrezorFrameHeaderFirst) ||
+                    rx_report.message[0] != '?')
+            {
+                rx_report.len = 0;
+                continue;
+            }
+
+            rx_report_pos = sizeof(TrezorFrameFragment);
+            content_pos += rx_report.len - rx_report_pos;
+        }
+
+        chunk = rx_report.len - rx_report_pos;
+
+        if(chunk > count)
+        {
+            chunk = count;
+        }
+
+        memcpy(buf, rx_report.message + rx_report_pos, chunk);
+        rx_report_pos += chunk;
+        buf += chunk;
+        count -= chunk;
     }
+
+    return(true);
 }
 
 /*
- * pb_parse() - Process USB message by protocol buffer
+ * pb_parse() - Process USB message by protocol buffer, decoding it from
+ * rx_report and the reports following it as they arrive
  *
  * INPUT
  *     - entry: pointer to message entry
- *     - msg: pointer to received message buffer
  *     - msg_size: size of message
  *     - buf: pointer to destination buffer
  * OUTPUT
  *     true/false whether protocol buffers were parsed successfully
  */
-static bool pb_parse(const MessagesMap_t *entry, uint8_t *msg, uint32_t msg_size,
-                     uint8_t *buf)
+static bool pb_parse(const MessagesMap_t *entry, uint32_t msg_size, uint8_t *buf)
 {
-    pb_istream_t stream = pb_istream_from_buffer(msg, msg_size);
+    pb_istream_t stream =
+    {
+        .callback = &usb_report_read,
+        .state = NULL,
+        .bytes_left = msg_size
+    };
+
     return(pb_decode(&stream, entry->fields, buf));
 }
 
 /*
- * dispatch() - Process received message and jump to corresponding process function
+ * dispatch() - Jump to process function of received message
  *
  * INPUT
  *     - entry: pointer to message entry
- *     - msg: pointer to received message buffer
- *     - msg_size: size of message
+ *     - parsed: whether the message was parsed into decode_buffer
  * OUTPUT
  *     none
  *
  */
-static void dispatch(const MessagesMap_t *entry, uint8_t *msg, uint32_t msg_size)
+static void dispatch(const MessagesMap_t *entry, bool parsed)
 {
-    static uint8_t decode_buffer[MAX_DECODE_SIZE] __attribute__((aligned(4)));
-
-    if(pb_parse(entry, msg, msg_size, decode_buffer))
+    if(parsed)
     {
         if(entry->process_func)
         {
@@ -192,17 +320,14 @@ static void dispatch(const MessagesMap_t *entry, uint8_t *msg, uint32_t msg_size
  *
  * INPUT
  *     - entry: pointer to message entry
- *     - msg: pointer to received message buffer
- *     - msg_size: size of message
+ *     - parsed: whether the message was parsed into msg_tiny
  * OUTPUT
  *     none
  *
  */
-static void tiny_dispatch(const MessagesMap_t *entry, uint8_t *msg, uint32_t msg_size)
+static void tiny_dispatch(const MessagesMap_t *entry, bool parsed)
 {
-    bool status = pb_parse(entry, msg, msg_size, msg_tiny);
-
-    if(status)
+    if(parsed)
     {
         msg_tiny_id = entry->msg_id;
     }
@@ -241,6 +366,9 @@ static void raw_dispatch(const MessagesMap_t *entry, uint8_t *msg, uint32_t msg_
 /*
  * usb_rx_helper() - Common helper that handles USB messages from host
  *
+ * Parsable messages are decoded straight from the reports while they arrive,
+ * raw messages are handed to their handler a report at a time.
+ *
  * INPUT
  *     - msg: pointer to message received from host
  *     - type: message map type (normal or debug)
@@ -250,15 +378,14 @@ static void raw_dispatch(const MessagesMap_t *entry, uint8_t *msg, uint32_t msg_
 static void usb_rx_helper(UsbMessage *msg, MessageMapType type)
 {
     static TrezorFrameHeaderFirst last_frame_header = { .id = 0xffff, .len = 0 };
-    static uint8_t content_buf[MAX_FRAME_SIZE];
-    static uint32_t content_pos = 0, content_size = 0;
     static bool mid_frame = false;
 
     const MessagesMap_t *entry;
     TrezorFrame *frame = (TrezorFrame *)(msg->message);
     TrezorFrameFragment *frame_fragment  = (TrezorFrameFragment *)(msg->message);
 
-    bool last_segment;
+    bool first_segment, parsed;
+    uint32_t content_size;
     uint8_t *contents;
 
     assert(msg != NULL);
@@ -279,69 +406,69 @@ static void usb_rx_helper(UsbMessage *msg, MessageMapType type)
         contents = frame->contents;
 
         /* Init content pos and size */
-        content_pos = msg->len - 9;
-        content_size = content_pos;
-
+        content_size = msg->len - sizeof(TrezorFrame);
+        content_pos = content_size;
+        first_segment = true;
     }
     else if(mid_frame)
     {
         contents = frame_fragment->contents;
-        content_pos += msg->len - 1;
-        content_size = msg->len - 1;
+        content_size = msg->len - sizeof(TrezorFrameFragment);
+        content_pos += content_size;
+        first_segment = false;
     }
     else
     {
         goto done_handling;
     }
 
-    last_segment = content_pos >= last_frame_header.len;
-    mid_frame = !last_segment;
-
     /* Determine callback handler and message map type */
     entry = message_map_entry(type, last_frame_header.id, IN_MSG);
 
     if(entry && entry->dispatch == RAW)
     {
+        mid_frame = content_pos < last_frame_header.len;
+
+        /* The last report is padded, the padding is not part of the message */
+        if(content_pos > last_frame_header.len)
+        {
+            content_size -= content_pos - last_frame_header.len;
+        }
+
         /* Call dispatch for every segment since we are not buffering and parsing, and
          * assume the raw dispatched callbacks will handle their own state and
          * buffering internally
          */
         raw_dispatch(entry, contents, content_size, last_frame_header.len);
     }
-    else if(entry)
+    else if(entry && first_segment)
     {
-        /* Copy content to frame buffer */
-        if(sizeof(content_buf) >= content_pos)
-        {
-            if(content_size == content_pos)
-            {
-                memcpy(content_buf, contents, content_pos);
-            }
-            else
-            {
-                memcpy(content_buf + (content_pos - (msg->len - 1)), contents,
-                       msg->len - 1);
-            }
-        }
-    }
+        /* Decode while the rest of the message comes in */
+        memcpy(&rx_report, msg, sizeof(rx_report));
+        rx_report_pos = sizeof(TrezorFrame);
+
+        parsed = pb_parse(entry, last_frame_header.len,
+                          msg_tiny_flag ? msg_tiny : decode_buffer);
+
+        /* Whatever the decoder left of the message is skipped as it arrives */
+        mid_frame = content_pos < last_frame_header.len;
 
-    /*
-     * Only parse and message map if all segments have been buffered
-     * and this message type is parsable
-     */
-    if(last_segment && !entry)
-    {
-        (*msg_failure)(FailureType_Failure_UnexpectedMessage, "Unknown message");
-    }
-    else if(last_segment && entry->dispatch != RAW)
-    {
         if(msg_tiny_flag)
         {
-            tiny_dispatch(entry, content_buf, last_frame_header.len);
+            tiny_dispatch(entry, parsed);
         }
         else
         {
-            dispatch(entry, content_buf, last_frame_header.len);
+            dispatch(entry, parsed);
+        }
+    }
+    else
+    {
+        mid_frame = content_pos < last_frame_header.len;
+
+        if(!mid_frame && !entry)
+        {
+            (*msg_failure)(FailureType_Failure_UnexpectedMessage, "Unknown message");
         }
     }
 
@@ -412,6 +539,45 @@ static MessageType tiny_msg_poll_and_buffer(bool block, uint8_t *buf)
     return(msg_tiny_id);
 }
 
+/*
+ * raw_field_varint() - Read a key or length of a raw field walk, which may be
+ * split over reports
+ *
+ * INPUT
+ *     - stream: field walk
+ *     - msg: rest of report
+ * OUTPUT
+ *     true/false whether the varint is complete
+ */
+static bool raw_field_varint(RawFieldStream *stream, RawMessage *msg)
+{
+    uint8_t byte;
+
+    while(msg->length > 0)
+    {
+        byte = *msg->buffer++;
+        msg->length--;
+        stream->pos++;
+
+        /* Keys and lengths have to fit in 32 bits */
+        if(stream->shift > 28 || (stream->shift == 28 && (byte & 0x70)))
+        {
+            stream->step = RAW_FIELD_INVALID;
+            return(false);
+        }
+
+        stream->varint |= (uint32_t)(byte & 0x7f) << stream->shift;
+        stream->shift += 7;
+
+        if(!(byte & 0x80))
+        {
+            return(true);
+        }
+    }
+
+    return(false);
+}
+
 /* === Functions =========================================================== */
 
 /*
@@ -587,37 +753,212 @@ MessageType check_for_tiny_msg(uint8_t *buf)
 }
 
 /*
- * parse_pb_varint() - Parses varints off of raw messages
+ * raw_field_init() - Start walking the fields of a raw message
  *
  * INPUT
- *     - msg: pointer to raw message
- *     - varint_count: how many varints to remove
+ *     - stream: field walk
  * OUTPUT
- *     bytes that were skipped
+ *     none
+ */
+void raw_field_init(RawFieldStream *stream)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->step = RAW_FIELD_KEY;
+}
+
+/*
+ * raw_field_next() - Walk a report of a raw message to the next part of a
+ * length delimited field
+ *
+ * Every length delimited field is announced with an empty part at offset 0
+ * once its length is known, its bytes follow as they arrive and point into the
+ * report.  Varint and fixed size fields are skipped.
+ *
+ * INPUT
+ *     - stream: field walk
+ *     - msg: rest of report, advanced past the returned part
+ *     - field: where to put the part
+ * OUTPUT
+ *     true/false whether there is a part, false once the report is used up or
+ *     the message turns out to be malformed
+ */
+bool raw_field_next(RawFieldStream *stream, RawMessage *msg, RawField *field)
+{
+    uint32_t len;
+
+    while(msg->length > 0)
+    {
+        switch(stream->step)
+        {
+            case RAW_FIELD_KEY:
+                /* Leave embedded messages that have been walked */
+                while(stream->shift == 0 && stream->depth > 0 &&
+                        stream->pos >= stream->end[stream->depth - 1])
+                {
+                    stream->depth--;
+                }
+
+                if(!raw_field_varint(stream, msg))
+                {
+                    break;
+                }
+
+                stream->number = stream->varint >> 3;
+
+                switch(stream->varint & 7)
+                {
+                    case PB_WT_VARINT:
+                        stream->step = RAW_FIELD_VARINT;
+                        break;
+
+                    case PB_WT_64BIT:
+                        stream->left = 8;
+                        stream->step = RAW_FIELD_SKIP;
+                        break;
+
+                    case PB_WT_STRING:
+                        stream->step = RAW_FIELD_LENGTH;
+                        break;
+
+                    case PB_WT_32BIT:
+                        stream->left = 4;
+                        stream->step = RAW_FIELD_SKIP;
+                        break;
+
+                    default:
+                        stream->step = RAW_FIELD_INVALID;
+                        break;
+                }
+
+                if(stream->number == 0)
+                {
+                    stream->step = RAW_FIELD_INVALID;
+                }
+
+                stream->varint = 0;
+                stream->shift = 0;
+                break;
+
+            case RAW_FIELD_LENGTH:
+                if(!raw_field_varint(stream, msg))
+                {
+                    break;
+                }
+
+                stream->size = stream->left = stream->varint;
+                stream->varint = 0;
+                stream->shift = 0;
+
+                /* Fields may not run past the message they are embedded in */
+                if(stream->depth > 0 &&
+                        stream->size > stream->end[stream->depth - 1] - stream->pos)
+                {
+                    stream->step = RAW_FIELD_INVALID;
+                    break;
+                }
+
+                stream->step = RAW_FIELD_BYTES;
+
+                field->number = stream->number;
+                field->depth = stream->depth;
+                field->size = stream->size;
+                field->offset = 0;
+                field->data = msg->buffer;
+                field->len = 0;
+                return(true);
+
+            case RAW_FIELD_VARINT:
+                if(!(*msg->buffer & 0x80))
+                {
+                    stream->step = RAW_FIELD_KEY;
+                }
+
+                msg->buffer++;
+                msg->length--;
+                stream->pos++;
+                break;
+
+            case RAW_FIELD_SKIP:
+                len = stream->left < msg->length ? stream->left : msg->length;
+
+                msg->buffer += len;
+                msg->length -= len;
+                stream->pos += len;
+                stream->left -= len;
+
+                if(stream->left == 0)
+                {
+                    stream->step = RAW_FIELD_KEY;
+                }
+
+                break;
+
+            case RAW_FIELD_BYTES:
+                if(stream->left == 0)
+                {
+                    stream->step = RAW_FIELD_KEY;
+                    break;
+                }
+
+                len = stream->left < msg->length ? stream->left : msg->length;
+
+                field->number = stream->number;
+                field->depth = stream->depth;
+                field->size = stream->size;
+                field->offset = stream->size - stream->left;
+                field->data = msg->buffer;
+                field->len = len;
+
+                msg->buffer += len;
+                msg->length -= len;
+                stream->pos += len;
+                stream->left -= len;
+                return(true);
+
+            case RAW_FIELD_INVALID:
+            default:
+                return(false);
+        }
+    }
+
+    return(false);
+}
+
+/*
+ * raw_field_enter() - Walk the field that was just announced as an embedded
+ * message instead of handing out its bytes
+ *
+ * INPUT
+ *     - stream: field walk
+ * OUTPUT
+ *     none
  */
-uint32_t parse_pb_varint(RawMessage *msg, uint8_t varint_count)
+void raw_field_enter(RawFieldStream *stream)
 {
-    uint32_t skip;
-    uint8_t i;
-    uint64_t pb_varint;
-    pb_istream_t stream;
-
-    /*
-     * Parse varints
-     */
-    stream = pb_istream_from_buffer(msg->buffer, msg->length);
-    skip = stream.bytes_left;
-    for(i = 0; i < varint_count; ++i)
+    if(stream->step != RAW_FIELD_BYTES || stream->left != stream->size)
+    {
+        return;
+    }
+
+    if(stream->depth >= RAW_FIELD_MAX_DEPTH)
     {
-        pb_decode_varint(&stream, &pb_varint);
+        stream->step = RAW_FIELD_INVALID;
+        return;
     }
-    skip = skip - stream.bytes_left;
 
-    /*
-     * Increment skip over message
-     */
-    msg->length -= skip;
-    msg->buffer = (uint8_t *)(msg->buffer + skip);
+    stream->end[stream->depth++] = stream->pos + stream->size;
+    stream->step = RAW_FIELD_KEY;
+}
 
-    return skip;
-}
\ No newline at end of file
+/*
+ * raw_field_failed() - Whether a raw field walk ran into a malformed message
+ *
+ * INPUT
+ *     - stream: field walk
+ * OUTPUT
+ *     true/false whether the message is malformed
+ */
+bool raw_field_failed(const RawFieldStream *stream)
+{
+    return(stream->step == RAW_FIELD_INVALID);
+}
@@ -25,6 +25,8 @@
 #include <libopencm3/stm32/f2/nvic.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/scs.h>
+#include <libopencm3/cm3/dwt.h>
 
 #include "keepkey_leds.h"
 #include "timer.h"
@@ -32,6 +34,8 @@
 /* === Private Variables =================================================== */
 
 static volatile uint32_t remaining_delay;
+static volatile uint32_t clock_ms;
+static bool has_cycle_counter;
 static RunnableNode runnables[MAX_RUNNABLES];
 static RunnableQueue free_queue = {NULL, 0};
 static RunnableQueue active_queue = {NULL, 0};
@@ -236,6 +240,16 @@ void timer_init(void)
     nvic_enable_irq(NVIC_TIM4_IRQ);
 
     timer_enable_counter(TIM4);
+
+    /* Start the DWT cycle counter for timestamps, the 1 ms tick is the fallback */
+    SCS_DEMCR |= SCS_DEMCR_TRCENA;
+
+    if(!(DWT_CTRL & DWT_CTRL_NOCYCCNT))
+    {
+        DWT_CYCCNT = 0;
+        DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+        has_cycle_counter = true;
+    }
 }
 
 /*
@@ -312,6 +326,8 @@ void tim4_isr(void)
         remaining_delay--;
     }
 
+    clock_ms++;
+
     run_runnables();
     timer_clear_flag(TIM4, TIM_SR_UIF);
 }
@@ -409,3 +425,29 @@ void clear_runnables(void)
         runnable_node = runnable_queue_pop(&active_queue);
     }
 }
+
+/*
+ * get_timestamp() - Free running timestamp for measuring durations
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     CPU cycles, or milliseconds without a cycle counter; wraps around
+ */
+uint32_t get_timestamp(void)
+{
+    return has_cycle_counter ? DWT_CYCCNT : clock_ms;
+}
+
+/*
+ * get_timestamp_hz() - Rate get_timestamp() counts at
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     timestamp ticks per second
+ */
+uint32_t get_timestamp_hz(void)
+{
+    return has_cycle_counter ? CPU_CLOCK_HZ : 1000;
+}
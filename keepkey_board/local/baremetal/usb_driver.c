@@ -29,6 +29,7 @@
 #include <libopencm3/stm32/desig.h>
 #include <libopencm3/usb/hid.h>
 #include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/f2/nvic.h>
 
 #include "keepkey_board.h"
 
@@ -45,6 +46,34 @@ static usbd_device *usbd_dev = NULL;
  */
 static bool usb_configured = false;
 
+/* Reports waiting to be sent to the host */
+static UsbTxRing tx_ring = { .endpoint = ENDPOINT_ADDRESS_IN };
+
+#if DEBUG_LINK
+static UsbTxRing debug_tx_ring = { .endpoint = ENDPOINT_ADDRESS_DEBUG_IN };
+#endif
+
+#if USB_BULK
+static UsbTxRing bulk_tx_ring = { .endpoint = ENDPOINT_ADDRESS_BULK_IN };
+#endif
+
+/* Normal responses go out on the interface the last request came in on */
+static UsbTxRing *reply_ring = &tx_ring;
+
+/* Reports waiting for usb_poll() to hand them to the user callbacks */
+static UsbRxRing rx_ring = { .endpoint = ENDPOINT_ADDRESS_OUT, .reply = &tx_ring };
+
+#if DEBUG_LINK
+static UsbRxRing debug_rx_ring = { .endpoint = ENDPOINT_ADDRESS_DEBUG_OUT };
+#endif
+
+#if USB_BULK
+static UsbRxRing bulk_rx_ring = { .endpoint = ENDPOINT_ADDRESS_BULK_OUT, .reply = &bulk_tx_ring };
+#endif
+
+/* Ring whose report the user callback is handling, usb_rx_next() reads on */
+static UsbRxRing *current_rx_ring = NULL;
+
 /* USB device descriptor */
 static const struct usb_device_descriptor dev_descr = {
 	.bLength = USB_DT_DEVICE_SIZE,
@@ -209,6 +238,41 @@ static const struct usb_interface_descriptor hid_iface_debug[] = {{
 }};
 #endif
 
+#if USB_BULK
+static const struct usb_endpoint_descriptor bulk_endpoints[] = {{
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = ENDPOINT_ADDRESS_BULK_IN,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = USB_SEGMENT_SIZE,
+	.bInterval = 0,
+}, {
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = ENDPOINT_ADDRESS_BULK_OUT,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = USB_SEGMENT_SIZE,
+	.bInterval = 0,
+}};
+
+static const struct usb_interface_descriptor bulk_iface[] = {{
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+#if DEBUG_LINK
+	.bInterfaceNumber = 2,
+#else
+	.bInterfaceNumber = 1,
+#endif
+	.bAlternateSetting = 0,
+	.bNumEndpoints = 2,
+	.bInterfaceClass = USB_CLASS_VENDOR,
+	.bInterfaceSubClass = 0,
+	.bInterfaceProtocol = 0,
+	.iInterface = 0,
+	.endpoint = bulk_endpoints,
+}};
+#endif
+
 static const struct usb_interface ifaces[] = {{
 	.num_altsetting = 1,
 	.altsetting = hid_iface,
@@ -217,17 +281,18 @@ static const struct usb_interface ifaces[] = {{
 	.num_altsetting = 1,
 	.altsetting = hid_iface_debug,
 #endif
+#if USB_BULK
+}, {
+	.num_altsetting = 1,
+	.altsetting = bulk_iface,
+#endif
 }};
 
 static const struct usb_config_descriptor config = {
 	.bLength = USB_DT_CONFIGURATION_SIZE,
 	.bDescriptorType = USB_DT_CONFIGURATION,
 	.wTotalLength = 0,
-#if DEBUG_LINK
-	.bNumInterfaces = 2,
-#else
-	.bNumInterfaces = 1,
-#endif
+	.bNumInterfaces = sizeof(ifaces) / sizeof(ifaces[0]),
 	.bConfigurationValue = 1,
 	.iConfiguration = 0,
 	.bmAttributes = 0x80,
@@ -269,6 +334,201 @@ static int hid_control_request(usbd_device *dev, struct usb_setup_data *req, uin
 	return 1;
 }
 
+/*
+ * usb_irq_lock() - Keep the OTG_FS interrupt off the core and the rings
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+static void usb_irq_lock(void)
+{
+#if USB_RX_IRQ
+    nvic_disable_irq(NVIC_OTG_FS_IRQ);
+#endif
+}
+
+/*
+ * usb_irq_unlock() - Let the OTG_FS interrupt in again
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+static void usb_irq_unlock(void)
+{
+#if USB_RX_IRQ
+    nvic_enable_irq(NVIC_OTG_FS_IRQ);
+#endif
+}
+
+/*
+ * tx_ring_kick() - Hand the oldest queued report to its IN endpoint if the
+ * endpoint is idle.  Runs from the OTG_FS interrupt or with it masked.
+ *
+ * INPUT
+ *     - ring: ring of the endpoint
+ * OUTPUT
+ *     none
+ */
+static void tx_ring_kick(UsbTxRing *ring)
+{
+    if(ring->tail != ring->head &&
+            usbd_ep_write_packet(usbd_dev, ring->endpoint,
+                                 ring->packets[ring->tail & (USB_TX_RING_SIZE - 1)],
+                                 USB_SEGMENT_SIZE) != 0)
+    {
+        ring->tail++;
+    }
+}
+
+/*
+ * tx_ring_kick_locked() - Hand the oldest queued report to its IN endpoint
+ * from the main loop
+ *
+ * INPUT
+ *     - ring: ring of the endpoint
+ * OUTPUT
+ *     none
+ */
+static void tx_ring_kick_locked(UsbTxRing *ring)
+{
+    usb_irq_lock();
+    tx_ring_kick(ring);
+    usb_irq_unlock();
+}
+
+/*
+ * tx_ring_flush() - Wait until every queued report was handed to the endpoint
+ *
+ * INPUT
+ *     - ring: ring of the endpoint
+ * OUTPUT
+ *     none
+ */
+static void tx_ring_flush(UsbTxRing *ring)
+{
+    while(ring->tail != ring->head)
+    {
+        tx_ring_kick_locked(ring);
+    }
+}
+
+/*
+ * rx_ring_push() - Queue the received packet of an OUT endpoint, called from
+ * usbd_poll()
+ *
+ * INPUT
+ *     - dev: pointer to USB device handler
+ *     - ring: ring of the endpoint
+ * OUTPUT
+ *     none
+ */
+static void rx_ring_push(usbd_device *dev, UsbRxRing *ring)
+{
+    uint32_t head = ring->head;
+    UsbMessage *m;
+
+    /* Endpoint is NAKing already, usbd_poll() discards anything left over */
+    if(head - ring->tail >= USB_RX_RING_SIZE)
+    {
+        return;
+    }
+
+    /*
+     * Taking the last free slot, so have the endpoint re-enabled NAKing the
+     * host until usb_poll() makes room again.
+     */
+    if(head - ring->tail == USB_RX_RING_SIZE - 1)
+    {
+        ring->nak = true;
+        usbd_ep_nak_set(dev, ring->endpoint, 1);
+    }
+
+    m = &ring->packets[head & (USB_RX_RING_SIZE - 1)];
+    m->len = usbd_ep_read_packet(dev, ring->endpoint, m->message, USB_SEGMENT_SIZE);
+
+    if(m->len)
+    {
+        /* Report has to be complete before usb_poll() can see it */
+        __asm__ __volatile__("" ::: "memory");
+        ring->head = head + 1;
+    }
+}
+
+/*
+ * rx_ring_pop() - Take the oldest queued report of an OUT endpoint
+ *
+ * INPUT
+ *     - ring: ring of the endpoint
+ *     - msg: where to put the report
+ * OUTPUT
+ *     true/false whether there was a report
+ */
+static bool rx_ring_pop(UsbRxRing *ring, UsbMessage *msg)
+{
+    if(ring->tail == ring->head)
+    {
+        return(false);
+    }
+
+    memcpy(msg, &ring->packets[ring->tail & (USB_RX_RING_SIZE - 1)], sizeof(*msg));
+    __asm__ __volatile__("" ::: "memory");
+    ring->tail++;
+
+    if(ring->nak)
+    {
+        /* The interrupt may have filled the ring up again meanwhile */
+        usb_irq_lock();
+
+        if(ring->head - ring->tail < USB_RX_RING_SIZE)
+        {
+            ring->nak = false;
+            usbd_ep_nak_set(usbd_dev, ring->endpoint, 0);
+        }
+
+        usb_irq_unlock();
+    }
+
+    return(true);
+}
+
+/*
+ * rx_ring_drain() - Hand queued reports of an OUT endpoint to its callback
+ *
+ * INPUT
+ *     - ring: ring of the endpoint
+ *     - callback: user receive callback
+ * OUTPUT
+ *     none
+ */
+static void rx_ring_drain(UsbRxRing *ring, usb_rx_callback_t callback)
+{
+    UsbRxRing *outer_rx_ring = current_rx_ring;
+    UsbMessage m;
+
+    /*
+     * The report is copied out and its slot freed before the callback runs, the
+     * callback may call usb_poll() again while waiting for a reply.
+     */
+    while(rx_ring_pop(ring, &m))
+    {
+        if(ring->reply != NULL)
+        {
+            reply_ring = ring->reply;
+        }
+
+        if(callback)
+        {
+            current_rx_ring = ring;
+            callback(&m);
+            current_rx_ring = outer_rx_ring;
+        }
+    }
+}
+
 /*
  * hid_rx_callback() - Callback function to process received packet from USB host
  *
@@ -283,18 +543,7 @@ static void hid_rx_callback(usbd_device *dev, uint8_t ep)
 {
     (void)ep;
 
-    /* Receive into the message buffer. */
-    UsbMessage m;
-    uint16_t rx = usbd_ep_read_packet(dev, 
-                                      ENDPOINT_ADDRESS_OUT, 
-                                      m.message, 
-                                      USB_SEGMENT_SIZE);
-
-    if(rx && user_rx_callback)
-    {
-        m.len = rx;
-        user_rx_callback(&m);
-    }
+    rx_ring_push(dev, &rx_ring);
 }
 
 /*
@@ -312,18 +561,79 @@ static void hid_debug_rx_callback(usbd_device *dev, uint8_t ep)
 {
     (void)ep;
 
-    /* Receive into the message buffer. */
-    UsbMessage m;
-    uint16_t rx = usbd_ep_read_packet(dev,
-                                      ENDPOINT_ADDRESS_DEBUG_OUT,
-                                      m.message,
-                                      USB_SEGMENT_SIZE);
+    rx_ring_push(dev, &debug_rx_ring);
+}
+#endif
 
-    if(rx && user_debug_rx_callback)
-    {
-        m.len = rx;
-        user_debug_rx_callback(&m);
-    }
+/*
+ * hid_tx_callback() - Callback function for a report taken by the USB host
+ *
+ * INPUT
+ *     - dev: unused
+ *     - ep: unused
+ * OUTPUT
+ *     none
+ */
+static void hid_tx_callback(usbd_device *dev, uint8_t ep)
+{
+    (void)dev;
+    (void)ep;
+
+    tx_ring_kick(&tx_ring);
+}
+
+/*
+ * hid_debug_tx_callback() - Callback function for a report taken by the USB host on debug endpoint
+ *
+ * INPUT
+ *     - dev: unused
+ *     - ep: unused
+ * OUTPUT
+ *     none
+ */
+#if DEBUG_LINK
+static void hid_debug_tx_callback(usbd_device *dev, uint8_t ep)
+{
+    (void)dev;
+    (void)ep;
+
+    tx_ring_kick(&debug_tx_ring);
+}
+#endif
+
+#if USB_BULK
+/*
+ * bulk_rx_callback() - Callback function to process received packet from USB host on bulk endpoint
+ *
+ * INPUT
+ *     - dev: pointer to USB device handler
+ *     - ep: unused
+ * OUTPUT
+ *     none
+ *
+ */
+static void bulk_rx_callback(usbd_device *dev, uint8_t ep)
+{
+    (void)ep;
+
+    rx_ring_push(dev, &bulk_rx_ring);
+}
+
+/*
+ * bulk_tx_callback() - Callback function for a report taken by the USB host on bulk endpoint
+ *
+ * INPUT
+ *     - dev: unused
+ *     - ep: unused
+ * OUTPUT
+ *     none
+ */
+static void bulk_tx_callback(usbd_device *dev, uint8_t ep)
+{
+    (void)dev;
+    (void)ep;
+
+    tx_ring_kick(&bulk_tx_ring);
 }
 #endif
 
@@ -340,12 +650,21 @@ static void hid_set_config_callback(usbd_device *dev, uint16_t wValue)
 {
 	(void)wValue;
 
-	usbd_ep_setup(dev, ENDPOINT_ADDRESS_IN,  USB_ENDPOINT_ATTR_INTERRUPT, USB_SEGMENT_SIZE, 0);
+	/* Reports queued for an earlier configuration are of no use anymore */
+	tx_ring.tail = tx_ring.head;
+	reply_ring = &tx_ring;
+	usbd_ep_setup(dev, ENDPOINT_ADDRESS_IN,  USB_ENDPOINT_ATTR_INTERRUPT, USB_SEGMENT_SIZE, hid_tx_callback);
 	usbd_ep_setup(dev, ENDPOINT_ADDRESS_OUT, USB_ENDPOINT_ATTR_INTERRUPT, USB_SEGMENT_SIZE, hid_rx_callback);
 #if DEBUG_LINK
-	usbd_ep_setup(dev, ENDPOINT_ADDRESS_DEBUG_IN,  USB_ENDPOINT_ATTR_INTERRUPT, USB_SEGMENT_SIZE, 0);
+	debug_tx_ring.tail = debug_tx_ring.head;
+	usbd_ep_setup(dev, ENDPOINT_ADDRESS_DEBUG_IN,  USB_ENDPOINT_ATTR_INTERRUPT, USB_SEGMENT_SIZE, hid_debug_tx_callback);
 	usbd_ep_setup(dev, ENDPOINT_ADDRESS_DEBUG_OUT, USB_ENDPOINT_ATTR_INTERRUPT, USB_SEGMENT_SIZE, hid_debug_rx_callback);
 #endif
+#if USB_BULK
+	bulk_tx_ring.tail = bulk_tx_ring.head;
+	usbd_ep_setup(dev, ENDPOINT_ADDRESS_BULK_IN,  USB_ENDPOINT_ATTR_BULK, USB_SEGMENT_SIZE, bulk_tx_callback);
+	usbd_ep_setup(dev, ENDPOINT_ADDRESS_BULK_OUT, USB_ENDPOINT_ATTR_BULK, USB_SEGMENT_SIZE, bulk_rx_callback);
+#endif
 
 	usbd_register_control_callback(
 		dev,
@@ -359,30 +678,51 @@ static void hid_set_config_callback(usbd_device *dev, uint16_t wValue)
 /*
  * usb_tx_helper() - Common way to transmit USB message to host 
  *
+ * Reports are queued and go out from the transfer complete interrupt, so this
+ * only waits when the queue is full.  When polling, nothing drains the queue
+ * in the background and the whole message is sent before returning.
+ *
  * INPUT
  *     - message: pointer message buffer
  *     - len: length of message
- *     - endpoint: endpoint for transmission
+ *     - ring: ring of endpoint for transmission
  * OUTPUT
  *     true/false
  */
-static bool usb_tx_helper(uint8_t *message, uint32_t len, uint8_t endpoint)
+static bool usb_tx_helper(uint8_t *message, uint32_t len, UsbTxRing *ring)
 {
-    uint32_t pos = 1;
+    uint32_t pos = 1, chunk;
+    uint8_t *packet;
 
     /* Chunk out message */
     while(pos < len)
     {
-        uint8_t tmp_buffer[USB_SEGMENT_SIZE] = { 0 };
+        /* Queue full, wait for the host to take reports */
+        while(ring->head - ring->tail >= USB_TX_RING_SIZE)
+        {
+            tx_ring_kick_locked(ring);
+        }
 
-        tmp_buffer[0] = '?';
-        memcpy(tmp_buffer + 1, message + pos, USB_SEGMENT_SIZE - 1);
+        chunk = len - pos < USB_SEGMENT_SIZE - 1 ? len - pos : USB_SEGMENT_SIZE - 1;
+        packet = ring->packets[ring->head & (USB_TX_RING_SIZE - 1)];
+        packet[0] = '?';
+        memcpy(packet + 1, message + pos, chunk);
+        memset(packet + 1 + chunk, 0, USB_SEGMENT_SIZE - 1 - chunk);
 
-        while(usbd_ep_write_packet(usbd_dev, endpoint, tmp_buffer, USB_SEGMENT_SIZE) == 0) {};
+        /* Report has to be complete before the interrupt can see it */
+        __asm__ __volatile__("" ::: "memory");
+        ring->head++;
 
         pos += USB_SEGMENT_SIZE - 1;
     }
 
+    /* Start the endpoint if it went idle */
+    tx_ring_kick_locked(ring);
+
+#if !USB_RX_IRQ
+    tx_ring_flush(ring);
+#endif
+
     return(true);
 }
 
@@ -417,6 +757,11 @@ bool usb_init(void)
                          sizeof(usbd_control_buffer));
         if(usbd_dev != NULL) {
             usbd_register_set_config_callback(usbd_dev, hid_set_config_callback);
+#if USB_RX_IRQ
+            /* Below the timer so USB traffic does not stretch the tick */
+            nvic_set_priority(NVIC_OTG_FS_IRQ, 16 * 3);
+            nvic_enable_irq(NVIC_OTG_FS_IRQ);
+#endif
         } else {
             /* error: unable init usbd_dev */
             ret_stat = false;
@@ -428,7 +773,10 @@ bool usb_init(void)
 
 /*
  * usb_poll() - Poll USB port for message
- *  
+ *
+ * Hands queued reports to the receive callbacks.  Without USB_RX_IRQ the port
+ * is serviced here first, otherwise the OTG_FS interrupt does that.
+ *
  * INPUT
  *     none
  * OUTPUT
@@ -436,11 +784,74 @@ bool usb_init(void)
  */
 void usb_poll(void)
 {
+#if !USB_RX_IRQ
     usbd_poll(usbd_dev);
+#endif
+
+    rx_ring_drain(&rx_ring, user_rx_callback);
+#if DEBUG_LINK
+    rx_ring_drain(&debug_rx_ring, user_debug_rx_callback);
+#endif
+#if USB_BULK
+    rx_ring_drain(&bulk_rx_ring, user_rx_callback);
+#endif
 }
 
 /*
- * usb_tx() - Transmit USB message to host via normal endpoint
+ * usb_rx_next() - Wait for the next report on the endpoint whose report the
+ * receive callback is handling, so a message can be consumed while it arrives
+ *
+ * Reports of other endpoints stay queued for usb_poll().
+ *
+ * INPUT
+ *     - msg: where to put the report
+ *     - timeout_ms: how long to wait for the host
+ * OUTPUT
+ *     true/false whether a report arrived in time
+ */
+bool usb_rx_next(UsbMessage *msg, uint32_t timeout_ms)
+{
+    uint32_t start = get_timestamp();
+    uint64_t timeout = (uint64_t)get_timestamp_hz() * timeout_ms / 1000;
+
+    if(current_rx_ring == NULL)
+    {
+        return(false);
+    }
+
+    while(!rx_ring_pop(current_rx_ring, msg))
+    {
+        if(get_timestamp() - start > timeout)
+        {
+            return(false);
+        }
+
+#if !USB_RX_IRQ
+        usbd_poll(usbd_dev);
+#endif
+    }
+
+    return(true);
+}
+
+/*
+ * otg_fs_isr() - USB OTG_FS interrupt service routine
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+#if USB_RX_IRQ
+void otg_fs_isr(void)
+{
+    usbd_poll(usbd_dev);
+}
+#endif
+
+/*
+ * usb_tx() - Transmit USB message to host via normal endpoint, HID or bulk
+ * depending on where the last request came in
  *
  * INPUT
  *     - message: pointer message buffer
@@ -450,7 +861,7 @@ void usb_poll(void)
  */
 bool usb_tx(uint8_t *message, uint32_t len)
 {
-    return usb_tx_helper(message, len, ENDPOINT_ADDRESS_IN);
+    return usb_tx_helper(message, len, reply_ring);
 }
 
 /*
@@ -465,10 +876,30 @@ bool usb_tx(uint8_t *message, uint32_t len)
 #if DEBUG_LINK
 bool usb_debug_tx(uint8_t *message, uint32_t len)
 {
-    return usb_tx_helper(message, len, ENDPOINT_ADDRESS_DEBUG_IN);
+    return usb_tx_helper(message, len, &debug_tx_ring);
 }
 #endif
 
+/*
+ * usb_tx_flush() - Wait until all queued reports were handed to the endpoints,
+ * e.g. before a reset
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+void usb_tx_flush(void)
+{
+    tx_ring_flush(&tx_ring);
+#if DEBUG_LINK
+    tx_ring_flush(&debug_tx_ring);
+#endif
+#if USB_BULK
+    tx_ring_flush(&bulk_tx_ring);
+#endif
+}
+
 /*
  * usb_set_rx_callback() - Setup USB receive callback function pointer
  *
@@ -72,6 +72,9 @@ typedef struct
 typedef void (*layout_notification_t)(const char *str1, const char *str2,
                                       NotificationType type);
 
+/* Short unit of work to run while a confirmation waits for the user */
+typedef void (*confirm_idle_handler_t)(void);
+
 /* === Functions =========================================================== */
 
 bool confirm(ButtonRequestType type, const char *request_title, const char *request_body,
@@ -85,5 +88,6 @@ bool review(ButtonRequestType type, const char *request_title, const char *reque
             ...);
 bool review_without_button_request(const char *request_title, const char *request_body,
                                    ...);
+void set_confirm_idle_handler(confirm_idle_handler_t idle_func);
 
 #endif
@@ -37,7 +37,7 @@
  Sector  2 | 0x08008000 - 0x0800BFFF |  16 KiB | empty (Read/Write)
  Sector  3 | 0x0800C000 - 0x0800FFFF |  16 KiB | storage/config (Read/Write)
 -----------+-------------------------+---------+------------------
- Sector  4 | 0x08010000 - 0x0801FFFF |  64 KiB | empty (Read/Write)
+ Sector  4 | 0x08010000 - 0x0801FFFF |  64 KiB | account node cache (Read/Write)
  Sector  5 | 0x08020000 - 0x0803FFFF | 128 KiB | bootloader code (Read Only)
  Sector  6 | 0x08040000 - 0x0805FFFF | 128 KiB | bootloader code (Read Only)
  Sector  7 | 0x08060000 - 0x0807FFFF | 128 KiB | application code(Read/Write)
@@ -80,7 +80,7 @@
 
 #define BSTRP_FLASH_SECT_LEN    0x4000
 #define STOR_FLASH_SECT_LEN     0x4000
-#define UNUSED_FLASH_SECT0_LEN  0x10000 
+#define NODE_CACHE_FLASH_SECT_LEN 0x10000
 #define BLDR_FLASH_SECT_LEN     0x20000
 #define APP_FLASH_SECT_LEN      0x20000
 
@@ -100,7 +100,9 @@
 
 #define FLASH_STORAGE_LEN       (0x4000)
 
-/*<  0x801_0000 - 0x801_FFFF is empty  >*/
+/* Account Node Cache Partition */
+#define FLASH_NODE_CACHE_START  (0x08010000)                          //0x0801_0000 - 0x0801_FFFF
+#define FLASH_NODE_CACHE_LEN    (0x10000)
 
 /* Boot Loader Partition */
 #define FLASH_BOOT_START        (0x08020000)                          //0x0802_0000 - 0x0805_FFFF
@@ -167,7 +169,7 @@ typedef enum
     FLASH_STORAGE1,
     FLASH_STORAGE2,
     FLASH_STORAGE3,
-    FLASH_UNUSED0,
+    FLASH_NODE_CACHE,
     FLASH_BOOTLOADER,
     FLASH_APP
 } Allocation;
@@ -190,7 +192,7 @@ static const FlashSector flash_sector_map[] =
     { 1,  0x08004000, STOR_FLASH_SECT_LEN,  FLASH_STORAGE1  }, 
     { 2,  0x08008000, STOR_FLASH_SECT_LEN,  FLASH_STORAGE2  }, 
     { 3,  0x0800C000, STOR_FLASH_SECT_LEN,  FLASH_STORAGE3  },
-    { 4,  0x08010000, UNUSED_FLASH_SECT0_LEN, FLASH_UNUSED0 },
+    { 4,  0x08010000, NODE_CACHE_FLASH_SECT_LEN, FLASH_NODE_CACHE },
     { 5,  0x08020000, BLDR_FLASH_SECT_LEN,  FLASH_BOOTLOADER },
     { 6,  0x08040000, BLDR_FLASH_SECT_LEN,  FLASH_BOOTLOADER },
     { 7,  0x08060000, APP_FLASH_SECT_LEN,   FLASH_APP },
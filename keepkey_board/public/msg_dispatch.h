@@ -32,6 +32,12 @@
 #define MSG_TINY_BFR_SZ     64
 #define MSG_TINY_TYPE_ERROR 0xFFFF
 
+/* How long decoding waits for the host to send the rest of a message */
+#define MSG_REPORT_TIMEOUT_MS 1000
+
+/* Embedded messages a raw field walk can enter */
+#define RAW_FIELD_MAX_DEPTH 2
+
 #define MSG_IN(ID, FIELDS, PROCESS_FUNC) [ID].msg_id = ID, [ID].type = NORMAL_MSG, [ID].dir = IN_MSG, [ID].fields = FIELDS, [ID].dispatch = PARSABLE, [ID].process_func = PROCESS_FUNC,
 #define MSG_OUT(ID, FIELDS, PROCESS_FUNC) [ID].msg_id = ID, [ID].type = NORMAL_MSG, [ID].dir = OUT_MSG, [ID].fields = FIELDS, [ID].dispatch = PARSABLE, [ID].process_func = PROCESS_FUNC,
 #define RAW_IN(ID, FIELDS, PROCESS_FUNC) [ID].msg_id = ID, [ID].type = NORMAL_MSG, [ID].dir = IN_MSG, [ID].fields = FIELDS, [ID].dispatch = RAW, [ID].process_func = PROCESS_FUNC,
@@ -95,6 +101,41 @@ typedef enum
 
 typedef void (*raw_msg_handler_t)(RawMessage *msg, uint32_t frame_length);
 
+typedef enum
+{
+    RAW_FIELD_KEY,
+    RAW_FIELD_LENGTH,
+    RAW_FIELD_VARINT,
+    RAW_FIELD_SKIP,
+    RAW_FIELD_BYTES,
+    RAW_FIELD_INVALID
+} RawFieldStep;
+
+/* Walk over the fields of a raw message that arrives a report at a time */
+typedef struct
+{
+    RawFieldStep step;
+    uint32_t varint;            /* key or length being read */
+    uint8_t shift;
+    uint32_t number;            /* field being walked */
+    uint32_t size;              /* length of field */
+    uint32_t left;              /* bytes of field still to come */
+    uint32_t pos;               /* bytes of message walked */
+    uint8_t depth;              /* embedded messages entered */
+    uint32_t end[RAW_FIELD_MAX_DEPTH];
+} RawFieldStream;
+
+/* Part of a length delimited field, pointing into the raw message */
+typedef struct
+{
+    uint32_t number;
+    uint8_t depth;
+    uint32_t size;              /* length of whole field */
+    uint32_t offset;            /* where data starts within the field */
+    uint8_t *data;
+    uint32_t len;
+} RawField;
+
 /* === Functions =========================================================== */
 
 bool msg_write(MessageType msg_id, const void *msg);
@@ -118,6 +159,9 @@ void msg_init(void);
 MessageType wait_for_tiny_msg(uint8_t *buf);
 MessageType check_for_tiny_msg(uint8_t *buf);
 
-uint32_t parse_pb_varint(RawMessage *msg, uint8_t varint_count);
+void raw_field_init(RawFieldStream *stream);
+bool raw_field_next(RawFieldStream *stream, RawMessage *msg, RawField *field);
+void raw_field_enter(RawFieldStream *stream);
+bool raw_field_failed(const RawFieldStream *stream);
 
 #endif
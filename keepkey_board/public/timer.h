@@ -30,6 +30,7 @@
 #define ONE_SEC         1100    /* Count for 1 second  */
 #define HALF_SEC        500     /* Count for 0.5 second */
 #define MAX_RUNNABLES   3       /* Max number of queue for task manager */
+#define CPU_CLOCK_HZ    120000000   /* Core clock set up by the bootloader */
 
 /* === Typedefs ============================================================ */
 
@@ -65,5 +66,7 @@ void post_periodic(Runnable runnable, void *context, uint32_t period_ms,
                    uint32_t delay_ms);
 void remove_runnable(Runnable runnable);
 void clear_runnables(void);
+uint32_t get_timestamp(void);
+uint32_t get_timestamp_hz(void);
 
 #endif
\ No newline at end of file
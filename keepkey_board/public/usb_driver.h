@@ -47,10 +47,41 @@
 #define ENDPOINT_ADDRESS_DEBUG_OUT  (0x02)
 #endif
 
+/*
+ * Vendor class interface with bulk endpoints carrying the same framing as the
+ * HID interface.  Hosts that can claim it get several reports per frame
+ * instead of one per millisecond, others keep using HID.  Off by default:
+ * with it the device is composite and there is no MS OS 2.0 descriptor, so
+ * Windows hosts do not bind WinUSB to it.  Build with usb_bulk=1 to add it.
+ */
+#ifndef USB_BULK
+#define USB_BULK 0
+#endif
+
+#if USB_BULK
+#define ENDPOINT_ADDRESS_BULK_IN    (0x83)
+#define ENDPOINT_ADDRESS_BULK_OUT   (0x03)
+#endif
+
 /* Control buffer for use by the USB stack.  We just allocate the 
    space for it.  */
 #define USBD_CONTROL_BUFFER_SIZE 128
 
+/*
+ * Service the OTG_FS core from its interrupt, received reports are queued for
+ * usb_poll() either way.  Build with usb_irq=0 to service the core from
+ * usb_poll() only.
+ */
+#ifndef USB_RX_IRQ
+#define USB_RX_IRQ 1
+#endif
+
+/* Received reports queued per OUT endpoint, must be a power of two */
+#define USB_RX_RING_SIZE 8
+
+/* Reports queued for transmission per IN endpoint, must be a power of two */
+#define USB_TX_RING_SIZE 16
+
 /* === Typedefs ============================================================ */
 
 typedef struct
@@ -61,13 +92,42 @@ typedef struct
 
 typedef void (*usb_rx_callback_t)(UsbMessage* msg);
 
+/*
+ * Reports waiting for an IN endpoint.  usb_tx() advances head, tail advances
+ * as reports are handed to the endpoint from its transfer complete callback or
+ * with the OTG_FS interrupt masked.
+ */
+typedef struct
+{
+    uint8_t packets[USB_TX_RING_SIZE][USB_SEGMENT_SIZE] __attribute__((aligned(4)));
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint8_t endpoint;
+} UsbTxRing;
+
+/*
+ * Reports received by usbd_poll().  Only usbd_poll() advances head and only the
+ * main loop advances tail, so neither side needs a lock.
+ */
+typedef struct
+{
+    UsbMessage packets[USB_RX_RING_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile bool nak;          /* endpoint NAKs until a report is taken */
+    uint8_t endpoint;
+    UsbTxRing *reply;           /* where responses go, NULL for debug link */
+} UsbRxRing;
+
 /* === Functions =========================================================== */
 
 void usb_set_rx_callback(usb_rx_callback_t callback);
 bool usb_init(void);
 void usb_poll(void);
+bool usb_rx_next(UsbMessage *msg, uint32_t timeout_ms);
 usbd_device *get_usb_init_stat(void);
 bool usb_tx(uint8_t *message, uint32_t len);
+void usb_tx_flush(void);
 #if DEBUG_LINK
 bool usb_debug_tx(uint8_t *message, uint32_t len);
 void usb_set_debug_rx_callback(usb_rx_callback_t callback);
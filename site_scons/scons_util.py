@@ -149,8 +149,10 @@ def expand_deps(deplist):
 # @param env Scons environment
 # @param deps List of project dependencies
 # @param libs List of non-project dependencies (-lboost, -ljsoncpp, for example)
+# @param sources List of source files of other projects, relative to the product root, to build into
+#        this project's library
 #
-def init_project(env, deps=None, libs=None, project_defines=None):
+def init_project(env, deps=None, libs=None, project_defines=None, sources=None):
     project_path = Dir('.').srcnode().abspath
     project_name = os.path.basename(project_path)
     bindir = os.path.join(env['VARIANT_BASE_DIR'], 'bin')
@@ -170,7 +172,10 @@ def init_project(env, deps=None, libs=None, project_defines=None):
     flavor_map = get_flavors()
 
     linkflags = []
-    if project_name == 'bootstrap':
+    if build_os != 'baremetal':
+        # host tools link with the native toolchain defaults
+        linkflags = env.get('LINKFLAGS', [])
+    elif project_name == 'bootstrap':
         linkflags = env['LINKFLAGS'] + ['-T' + Dir('#').abspath + '/memory_bootstrap.ld']
     elif project_name == 'bootloader':
         linkflags = env['LINKFLAGS'] + ['-T' + Dir('#').abspath + '/memory_bootloader.ld']
@@ -201,6 +206,17 @@ def init_project(env, deps=None, libs=None, project_defines=None):
         for d in deps:
             dep_include_paths.append(dep_includes(d, env))
 
+    #
+    # Sources borrowed from other projects are built with this project's include paths and flags
+    #
+    if sources != None:
+        for s in sources:
+            obj = os.path.join(env['VARIANT_BASE_DIR'], '.obj', project_name, 'ext',
+                               os.path.splitext(os.path.basename(s))[0])
+            support_files += env.Object(obj, '#' + s,
+                                        CPPPATH=include_paths + dep_include_paths,
+                                        CPATH=include_paths + dep_include_paths)
+
     # 
     # Build support project library
     #
@@ -299,6 +315,10 @@ def init_product():
     env = DefaultEnvironment()
     
     init_platform(env)
+
+    if env['os'] != 'baremetal':
+        # host builds share the device's nanopb field descriptors
+        env.Append(CCFLAGS=['-DPB_FIELD_16BIT=1'])
     env.Append(CPPDEFINES={'PRODUCT_NAME' : current_project_name()})
 
     #
@@ -0,0 +1,1477 @@
+/*
+ * This file is part of the KeepKey project.
+ *
+ * Copyright (C) 2016 KeepKey LLC
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host load generator for transaction signing.
+ *
+ * Synthesizes transactions and plays the host side of the SignTx, TxRequest
+ * and TxAck exchange against the firmware's signing code, built for the host
+ * with the device stand-ins in signing_emu.c.  Previous transactions are
+ * answered piece by piece, or streamed as RawTxAck in report sized chunks.
+ *
+ * Every run's signatures are verified against sighashes computed here and
+ * its serialized transaction is compared with one built from them, so a run
+ * that signs the wrong data fails instead of being reported.
+ *
+ * Each shape reports the round trips, the encoded bytes and 64 byte reports
+ * in either direction, the CPU time of the run and the signing telemetry of
+ * DebugLinkSigningStats.  In that telemetry the *_wait entries are the time
+ * the host took to answer, which here is the time to synthesize the answer.
+ *
+ * Without shape options the built-in corpus is run, so optimizations can be
+ * compared on the same transactions.
+ */
+
+/* === Includes ============================================================ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <pb_encode.h>
+#include <bip32.h>
+#include <base58.h>
+#include <ecdsa.h>
+#include <secp256k1.h>
+#include <sha2.h>
+
+#include <coins.h>
+#include <crypto.h>
+#include <signing.h>
+#include <transaction.h>
+
+#include "signing_emu.h"
+
+/* === Defines ============================================================= */
+
+#define MAX_INPUTS              2000
+#define MAX_OUTPUTS             2000
+#define MAX_PREV_OUTPUTS        20000
+#define MAX_COSIGNERS           15
+#define INPUT_AMOUNT            10000000
+#define FEE_PER_INPUT           1000
+#define PREV_SCRIPT_SIG_LEN     107
+#define PREV_SCRIPT_PUBKEY_LEN  25
+#define SCRIPT_PUBKEY_LEN       25
+#define MAX_DER_SIG_LEN         72
+
+/* OP_0, one signature and the pushed 15 key redeem script */
+#define MAX_SCRIPT_SIG_LEN      (1 + 1 + MAX_DER_SIG_LEN + 1 + 3 + 3 + 34 * MAX_COSIGNERS)
+#define MAX_WITNESS_LEN         (1 + 1 + MAX_DER_SIG_LEN + 1 + 1 + 33)
+#define MAX_SERIALIZED_TX       (4 + 2 + 5 + \
+                                 MAX_INPUTS * (36 + 3 + MAX_SCRIPT_SIG_LEN + 4 + MAX_WITNESS_LEN) + \
+                                 5 + MAX_OUTPUTS * (8 + 1 + SCRIPT_PUBKEY_LEN) + 4)
+
+/* === Typedefs ============================================================ */
+
+typedef struct
+{
+    const char *coin;
+    uint32_t inputs;
+    uint32_t outputs;
+    uint32_t prev_outputs;      /* outputs of each previous transaction */
+    InputScriptType script_type;
+    uint32_t m, n;              /* SPENDMULTISIG only */
+    bool raw;                   /* previous transactions as RawTxAck */
+} BenchShape;
+
+/* === Private Variables =================================================== */
+
+static const BenchShape corpus[] =
+{
+    { "Bitcoin",    1,   2,   2, InputScriptType_SPENDADDRESS,     0, 0, false },
+    { "Bitcoin",   10,  10,   2, InputScriptType_SPENDADDRESS,     0, 0, false },
+    { "Bitcoin",   50,   2,   2, InputScriptType_SPENDADDRESS,     0, 0, false },
+    { "Bitcoin",  100,   2,   2, InputScriptType_SPENDADDRESS,     0, 0, false },
+    { "Bitcoin",    2,  50,   2, InputScriptType_SPENDADDRESS,     0, 0, false },
+    { "Bitcoin",   10,   2, 100, InputScriptType_SPENDADDRESS,     0, 0, false },
+    { "Bitcoin",   10,   2, 100, InputScriptType_SPENDADDRESS,     0, 0, true  },
+    { "Bitcoin",   10,   2,   2, InputScriptType_SPENDWITNESS,     0, 0, false },
+    { "Bitcoin",  100,   2,   2, InputScriptType_SPENDWITNESS,     0, 0, false },
+    { "Bitcoin",   10,   2,   2, InputScriptType_SPENDP2SHWITNESS, 0, 0, false },
+    { "Bitcoin",   10,   2,   2, InputScriptType_SPENDMULTISIG,    2, 3, false },
+    { "Bitcoin",   10,   2,   2, InputScriptType_SPENDMULTISIG,   11, 15, false },
+    { "Testnet",   10,   2,   2, InputScriptType_SPENDADDRESS,     0, 0, false },
+    { "Litecoin",  10,   2,   2, InputScriptType_SPENDADDRESS,     0, 0, false },
+};
+
+static HDNode root;
+static HDNode cosigners[MAX_COSIGNERS];
+static const CoinType *coin;
+static BenchShape shape;
+static uint64_t spend_total;
+static uint8_t prev_hashes[MAX_INPUTS][32];
+static uint8_t raw_tx[4 + 1 + 32 + 4 + 1 + PREV_SCRIPT_SIG_LEN + 4 + 5 +
+                      MAX_PREV_OUTPUTS * (8 + 1 + PREV_SCRIPT_PUBKEY_LEN) + 4];
+static TxAck ack;
+static TxInputType check_input;
+static TxOutputType check_output;
+static uint8_t pubkeys[MAX_INPUTS][33];
+static uint8_t signatures[MAX_INPUTS][MAX_DER_SIG_LEN];
+static uint32_t signature_lens[MAX_INPUTS];
+static uint8_t serialized[MAX_SERIALIZED_TX], expected[MAX_SERIALIZED_TX];
+static uint32_t serialized_len;
+static DebugLinkSigningStats stats;
+static uint32_t batch_max = 0xFFFFFFFF, idle_calls, rounds = 1;
+static bool quiet;
+
+/* === Private Functions =================================================== */
+
+/*
+ * input_amount() - Amount spent by an input
+ *
+ * INPUT
+ *     - index: input index
+ * OUTPUT
+ *     amount in satoshi
+ */
+static uint64_t input_amount(uint32_t index)
+{
+    return INPUT_AMOUNT + index;
+}
+
+/*
+ * prev_output_amount() - Amount of an output of a previous transaction
+ *
+ * INPUT
+ *     - index: index of input the previous transaction is spent by
+ *     - output: output index in previous transaction
+ * OUTPUT
+ *     amount in satoshi
+ */
+static uint64_t prev_output_amount(uint32_t index, uint32_t output)
+{
+    return output == index % shape.prev_outputs ? input_amount(index) : 1000 + output;
+}
+
+/*
+ * prev_script_pubkey() - P2PKH script of an output of a previous transaction
+ *
+ * INPUT
+ *     - output: output index in previous transaction
+ *     - script: buffer for the 25 byte script
+ * OUTPUT
+ *     none
+ */
+static void prev_script_pubkey(uint32_t output, uint8_t *script)
+{
+    script[0] = 0x76;           /* OP_DUP */
+    script[1] = 0xA9;           /* OP_HASH160 */
+    script[2] = 20;
+    memset(script + 3, output & 0xFF, 20);
+    script[23] = 0x88;          /* OP_EQUALVERIFY */
+    script[24] = 0xAC;          /* OP_CHECKSIG */
+}
+
+/*
+ * write_varint() - Serialize a Bitcoin compact size
+ *
+ * INPUT
+ *     - value: value to serialize
+ *     - out: output buffer
+ * OUTPUT
+ *     number of bytes written
+ */
+static uint32_t write_varint(uint32_t value, uint8_t *out)
+{
+    if(value < 253)
+    {
+        out[0] = value;
+        return 1;
+    }
+
+    if(value < 0x10000)
+    {
+        out[0] = 253;
+        out[1] = value & 0xFF;
+        out[2] = value >> 8;
+        return 3;
+    }
+
+    out[0] = 254;
+    memcpy(out + 1, &value, 4);
+    return 5;
+}
+
+/*
+ * serialize_prev_tx() - Serialize the previous transaction of an input
+ *
+ * Its single input spends output index of a transaction whose hash is
+ * index + 1 in every byte, so byte order does not matter.
+ *
+ * INPUT
+ *     - index: input index
+ *     - out: output buffer
+ * OUTPUT
+ *     length of transaction
+ */
+static uint32_t serialize_prev_tx(uint32_t index, uint8_t *out)
+{
+    uint32_t r = 0, version = 1, sequence = 0xFFFFFFFF, lock_time = 0;
+    uint64_t amount;
+
+    memcpy(out + r, &version, 4); r += 4;
+
+    r += write_varint(1, out + r);
+    memset(out + r, (index + 1) & 0xFF, 32); r += 32;
+    memcpy(out + r, &index, 4); r += 4;
+    r += write_varint(PREV_SCRIPT_SIG_LEN, out + r);
+    memset(out + r, 0x51, PREV_SCRIPT_SIG_LEN); r += PREV_SCRIPT_SIG_LEN;
+    memcpy(out + r, &sequence, 4); r += 4;
+
+    r += write_varint(shape.prev_outputs, out + r);
+
+    for(uint32_t k = 0; k < shape.prev_outputs; k++)
+    {
+        amount = prev_output_amount(index, k);
+        memcpy(out + r, &amount, 8); r += 8;
+        r += write_varint(PREV_SCRIPT_PUBKEY_LEN, out + r);
+        prev_script_pubkey(k, out + r); r += PREV_SCRIPT_PUBKEY_LEN;
+    }
+
+    memcpy(out + r, &lock_time, 4); r += 4;
+    return r;
+}
+
+/*
+ * prepare_shape() - Compute the hashes of all previous transactions and the
+ * amount left for the outputs after the fee
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+static void prepare_shape(void)
+{
+    uint8_t h[32];
+    uint32_t len;
+
+    spend_total = 0;
+
+    for(uint32_t i = 0; i < shape.inputs; i++)
+    {
+        spend_total += input_amount(i) - FEE_PER_INPUT;
+
+        len = serialize_prev_tx(i, raw_tx);
+        sha256_Raw(raw_tx, len, h);
+        sha256_Raw(h, 32, h);
+
+        /* Displayed byte order, as in TxInputType.prev_hash */
+        for(uint32_t k = 0; k < 32; k++)
+        {
+            prev_hashes[i][k] = h[31 - k];
+        }
+    }
+}
+
+/*
+ * find_prev_tx() - Input whose previous transaction has a hash
+ *
+ * INPUT
+ *     - hash: requested transaction hash
+ *     - index: where to put the input index
+ * OUTPUT
+ *     true/false whether transaction is known
+ */
+static bool find_prev_tx(const uint8_t *hash, uint32_t *index)
+{
+    for(uint32_t i = 0; i < shape.inputs; i++)
+    {
+        if(memcmp(prev_hashes[i], hash, 32) == 0)
+        {
+            *index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * fill_multisig() - Redeem script of an input among the cosigners
+ *
+ * INPUT
+ *     - index: input index
+ *     - multisig: where to put the redeem script
+ * OUTPUT
+ *     none
+ */
+static void fill_multisig(uint32_t index, MultisigRedeemScriptType *multisig)
+{
+    multisig->has_m = true;
+    multisig->m = shape.m;
+    multisig->pubkeys_count = shape.n;
+    multisig->signatures_count = shape.n;
+
+    for(uint32_t k = 0; k < shape.n; k++)
+    {
+        HDNodePathType *path = &multisig->pubkeys[k];
+
+        path->node.depth = cosigners[k].depth;
+        path->node.fingerprint = cosigners[k].fingerprint;
+        path->node.child_num = cosigners[k].child_num;
+        path->node.chain_code.size = 32;
+        memcpy(path->node.chain_code.bytes, cosigners[k].chain_code, 32);
+        path->node.has_public_key = true;
+        path->node.public_key.size = 33;
+        memcpy(path->node.public_key.bytes, cosigners[k].public_key, 33);
+        path->address_n_count = 2;
+        path->address_n[0] = 0;
+        path->address_n[1] = index;
+    }
+}
+
+/*
+ * fill_input() - Input of the transaction being signed
+ *
+ * INPUT
+ *     - index: input index
+ *     - input: where to put the input
+ * OUTPUT
+ *     none
+ */
+static void fill_input(uint32_t index, TxInputType *input)
+{
+    uint32_t purpose;
+
+    switch(shape.script_type)
+    {
+        case InputScriptType_SPENDMULTISIG:
+            purpose = 45;
+            break;
+
+        case InputScriptType_SPENDWITNESS:
+            purpose = 84;
+            break;
+
+        case InputScriptType_SPENDP2SHWITNESS:
+            purpose = 49;
+            break;
+
+        default:
+            purpose = 44;
+            break;
+    }
+
+    if(shape.script_type == InputScriptType_SPENDMULTISIG)
+    {
+        input->address_n_count = 3;
+        input->address_n[0] = 0x80000000 | purpose;
+        input->address_n[1] = 0;
+        input->address_n[2] = index;
+        input->has_multisig = true;
+        fill_multisig(index, &input->multisig);
+    }
+    else
+    {
+        input->address_n_count = 5;
+        input->address_n[0] = 0x80000000 | purpose;
+        input->address_n[1] = 0x80000000;
+        input->address_n[2] = 0x80000000;
+        input->address_n[3] = 0;
+        input->address_n[4] = index;
+    }
+
+    input->prev_hash.size = 32;
+    memcpy(input->prev_hash.bytes, prev_hashes[index], 32);
+    input->prev_index = index % shape.prev_outputs;
+    input->has_sequence = true;
+    input->sequence = 0xFFFFFFFF;
+    input->has_script_type = true;
+    input->script_type = shape.script_type;
+
+    if(shape.script_type == InputScriptType_SPENDWITNESS ||
+            shape.script_type == InputScriptType_SPENDP2SHWITNESS)
+    {
+        input->has_amount = true;
+        input->amount = input_amount(index);
+    }
+}
+
+/*
+ * output_pubkeyhash() - Hash of the key an output of the signed transaction
+ * pays to
+ *
+ * INPUT
+ *     - index: output index
+ *     - h: buffer for the hash, of which the first 20 bytes are used
+ * OUTPUT
+ *     none
+ */
+static void output_pubkeyhash(uint32_t index, uint8_t *h)
+{
+    sha256_Raw((const uint8_t *)&index, sizeof(index), h);
+}
+
+/*
+ * fill_output() - Output of the transaction being signed
+ *
+ * INPUT
+ *     - index: output index
+ *     - output: where to put the output
+ * OUTPUT
+ *     none
+ */
+static void fill_output(uint32_t index, TxOutputType *output)
+{
+    uint8_t raw[21], h[32];
+
+    output_pubkeyhash(index, h);
+    raw[0] = coin->address_type;
+    memcpy(raw + 1, h, 20);
+
+    output->has_address = true;
+    base58_encode_check(raw, sizeof(raw), output->address, sizeof(output->address));
+    output->script_type = OutputScriptType_PAYTOADDRESS;
+    output->amount = spend_total / shape.outputs;
+
+    if(index == shape.outputs - 1)
+    {
+        output->amount += spend_total % shape.outputs;
+    }
+}
+
+/*
+ * fill_prev_tx() - Piece of a previous transaction
+ *
+ * INPUT
+ *     - index: input the previous transaction is spent by
+ *     - type: requested piece
+ *     - first: first requested input or output
+ *     - count: number of inputs or outputs to send
+ *     - tx: where to put the answer
+ * OUTPUT
+ *     none
+ */
+static void fill_prev_tx(uint32_t index, RequestType type, uint32_t first, uint32_t count,
+                         TransactionType *tx)
+{
+    switch(type)
+    {
+        case RequestType_TXMETA:
+            tx->has_version = true;
+            tx->version = 1;
+            tx->has_lock_time = true;
+            tx->lock_time = 0;
+            tx->has_inputs_cnt = true;
+            tx->inputs_cnt = 1;
+            tx->has_outputs_cnt = true;
+            tx->outputs_cnt = shape.prev_outputs;
+            break;
+
+        case RequestType_TXINPUT:
+            tx->inputs_count = 1;
+            tx->inputs[0].prev_hash.size = 32;
+            memset(tx->inputs[0].prev_hash.bytes, (index + 1) & 0xFF, 32);
+            tx->inputs[0].prev_index = index;
+            tx->inputs[0].has_script_sig = true;
+            tx->inputs[0].script_sig.size = PREV_SCRIPT_SIG_LEN;
+            memset(tx->inputs[0].script_sig.bytes, 0x51, PREV_SCRIPT_SIG_LEN);
+            tx->inputs[0].has_sequence = true;
+            tx->inputs[0].sequence = 0xFFFFFFFF;
+            break;
+
+        case RequestType_TXOUTPUT:
+            tx->bin_outputs_count = count;
+
+            for(uint32_t k = 0; k < count; k++)
+            {
+                tx->bin_outputs[k].amount = prev_output_amount(index, first + k);
+                tx->bin_outputs[k].script_pubkey.size = PREV_SCRIPT_PUBKEY_LEN;
+                prev_script_pubkey(first + k, tx->bin_outputs[k].script_pubkey.bytes);
+            }
+
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*
+ * varint_size() - Size of a protobuf varint
+ *
+ * INPUT
+ *     - value: encoded value
+ * OUTPUT
+ *     number of bytes
+ */
+static uint32_t varint_size(uint32_t value)
+{
+    uint32_t size = 1;
+
+    while(value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+
+    return size;
+}
+
+/*
+ * stream_prev_tx() - Send a previous transaction as RawTxAck, chunked the way
+ * the device receives it from the USB reports
+ *
+ * INPUT
+ *     - index: input the previous transaction is spent by
+ * OUTPUT
+ *     none
+ */
+static void stream_prev_tx(uint32_t index)
+{
+    uint32_t len = serialize_prev_tx(index, raw_tx);
+    uint32_t payload = 1 + varint_size(len) + len;
+    uint32_t header = 1 + varint_size(payload) + payload - len;
+    uint32_t pos = 0, chunk = EMU_FIRST_PAYLOAD - header;
+
+    signing_emu_host_message(header + len);
+
+    while(pos < len)
+    {
+        if(chunk > len - pos)
+        {
+            chunk = len - pos;
+        }
+
+        parse_raw_txack(raw_tx + pos, chunk);
+        pos += chunk;
+        chunk = EMU_NEXT_PAYLOAD;
+    }
+}
+
+/*
+ * answer_request() - Play the host's part for one TxRequest
+ *
+ * INPUT
+ *     - request: request of the device
+ * OUTPUT
+ *     true/false whether request could be answered
+ */
+static bool answer_request(const TxRequest *request)
+{
+    RequestType type = request->request_type;
+    uint32_t first = request->details.request_index, count = 1, index = 0, cap;
+    bool prev = request->details.has_tx_hash;
+    TransactionType *tx = &ack.tx;
+    pb_ostream_t stream = PB_OSTREAM_SIZING;
+
+    if(prev && !find_prev_tx(request->details.tx_hash.bytes, &index))
+    {
+        fprintf(stderr, "device requested an unknown transaction\n");
+        return false;
+    }
+
+    if(request->details.has_request_count)
+    {
+        count = request->details.request_count;
+    }
+
+    cap = type == RequestType_TXINPUT ? sizeof(tx->inputs) / sizeof(tx->inputs[0]) :
+          prev ? sizeof(tx->bin_outputs) / sizeof(tx->bin_outputs[0]) :
+          sizeof(tx->outputs) / sizeof(tx->outputs[0]);
+
+    if(count > cap)
+    {
+        count = cap;
+    }
+
+    if(count > batch_max)
+    {
+        count = batch_max;
+    }
+
+    signing_emu_request_done();
+
+    if(prev && type == RequestType_TXMETA && shape.raw)
+    {
+        stream_prev_tx(index);
+        return true;
+    }
+
+    memset(&ack, 0, sizeof(ack));
+    ack.has_tx = true;
+
+    if(prev)
+    {
+        fill_prev_tx(index, type, first, count, tx);
+    }
+    else if(type == RequestType_TXINPUT)
+    {
+        tx->inputs_count = count;
+
+        for(uint32_t k = 0; k < count; k++)
+        {
+            fill_input(first + k, &tx->inputs[k]);
+        }
+    }
+    else if(type == RequestType_TXOUTPUT)
+    {
+        tx->outputs_count = count;
+
+        for(uint32_t k = 0; k < count; k++)
+        {
+            fill_output(first + k, &tx->outputs[k]);
+        }
+    }
+    else
+    {
+        fprintf(stderr, "unexpected request type %d\n", type);
+        return false;
+    }
+
+    pb_encode(&stream, TxAck_fields, &ack);
+    signing_emu_host_message(stream.bytes_written);
+
+    signing_txack(tx);
+    return true;
+}
+
+/*
+ * cpu_time() - Process CPU time
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     seconds
+ */
+static double cpu_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * collect_response() - Keep the signature and serialized data a TxRequest
+ * carries
+ *
+ * INPUT
+ *     - request: request of the device
+ * OUTPUT
+ *     true/false whether response fits and signs a new input
+ */
+static bool collect_response(const TxRequest *request)
+{
+    const TxRequestSerializedType *ser = &request->serialized;
+
+    if(!request->has_serialized)
+    {
+        return true;
+    }
+
+    if(ser->has_signature)
+    {
+        if(!ser->has_signature_index || ser->signature_index >= shape.inputs ||
+                signature_lens[ser->signature_index] != 0 ||
+                ser->signature.size == 0 || ser->signature.size > MAX_DER_SIG_LEN)
+        {
+            fprintf(stderr, "unexpected signature\n");
+            return false;
+        }
+
+        memcpy(signatures[ser->signature_index], ser->signature.bytes, ser->signature.size);
+        signature_lens[ser->signature_index] = ser->signature.size;
+    }
+
+    if(ser->has_serialized_tx)
+    {
+        if(ser->serialized_tx.size > sizeof(serialized) - serialized_len)
+        {
+            fprintf(stderr, "serialized transaction too long\n");
+            return false;
+        }
+
+        memcpy(serialized + serialized_len, ser->serialized_tx.bytes, ser->serialized_tx.size);
+        serialized_len += ser->serialized_tx.size;
+    }
+
+    return true;
+}
+
+/*
+ * der_to_sig() - Parse a DER signature into r and s
+ *
+ * INPUT
+ *     - der: DER encoded signature
+ *     - der_len: length of signature
+ *     - sig: buffer for 64 byte r and s
+ * OUTPUT
+ *     true/false whether signature is well formed
+ */
+static bool der_to_sig(const uint8_t *der, uint32_t der_len, uint8_t *sig)
+{
+    uint32_t pos = 2, len;
+
+    if(der_len < 8 || der[0] != 0x30 || der[1] != der_len - 2)
+    {
+        return false;
+    }
+
+    memset(sig, 0, 64);
+
+    for(uint32_t k = 0; k < 2; k++)
+    {
+        if(pos + 2 > der_len || der[pos] != 0x02)
+        {
+            return false;
+        }
+
+        len = der[pos + 1];
+        pos += 2;
+
+        if(len == 0 || pos + len > der_len)
+        {
+            return false;
+        }
+
+        /* Leading zero keeps the integer positive */
+        if(len == 33 && der[pos] == 0)
+        {
+            pos++;
+            len--;
+        }
+
+        if(len > 32)
+        {
+            return false;
+        }
+
+        memcpy(sig + k * 32 + 32 - len, der + pos, len);
+        pos += len;
+    }
+
+    return pos == der_len;
+}
+
+/*
+ * serialize_outpoint() - Previous output an input spends, as serialized
+ *
+ * INPUT
+ *     - index: input index
+ *     - out: buffer for 36 bytes
+ * OUTPUT
+ *     none
+ */
+static void serialize_outpoint(uint32_t index, uint8_t *out)
+{
+    uint32_t prev_index = index % shape.prev_outputs;
+
+    for(uint32_t k = 0; k < 32; k++)
+    {
+        out[k] = prev_hashes[index][31 - k];
+    }
+
+    memcpy(out + 32, &prev_index, 4);
+}
+
+/*
+ * serialize_outputs() - Outputs of the signed transaction, as serialized
+ *
+ * INPUT
+ *     - out: output buffer
+ * OUTPUT
+ *     length of outputs with their count
+ */
+static uint32_t serialize_outputs(uint8_t *out)
+{
+    uint32_t r = write_varint(shape.outputs, out);
+    uint8_t h[32];
+
+    for(uint32_t k = 0; k < shape.outputs; k++)
+    {
+        memset(&check_output, 0, sizeof(check_output));
+        fill_output(k, &check_output);
+        output_pubkeyhash(k, h);
+
+        memcpy(out + r, &check_output.amount, 8); r += 8;
+        r += write_varint(SCRIPT_PUBKEY_LEN, out + r);
+        out[r++] = 0x76;        /* OP_DUP */
+        out[r++] = 0xA9;        /* OP_HASH160 */
+        out[r++] = 20;
+        memcpy(out + r, h, 20); r += 20;
+        out[r++] = 0x88;        /* OP_EQUALVERIFY */
+        out[r++] = 0xAC;        /* OP_CHECKSIG */
+    }
+
+    return r;
+}
+
+/*
+ * script_code() - Script an input's signature commits to
+ *
+ * INPUT
+ *     - index: input index
+ *     - out: output buffer
+ * OUTPUT
+ *     length of script
+ */
+static uint32_t script_code(uint32_t index, uint8_t *out)
+{
+    if(shape.script_type == InputScriptType_SPENDMULTISIG)
+    {
+        return compile_script_multisig(&check_input.multisig, out);
+    }
+
+    out[0] = 0x76;
+    out[1] = 0xA9;
+    out[2] = 20;
+    ecdsa_get_pubkeyhash(pubkeys[index], out + 3);
+    out[23] = 0x88;
+    out[24] = 0xAC;
+    return 25;
+}
+
+/*
+ * legacy_sighash() - Pre-segwit SIGHASH_ALL digest of an input
+ *
+ * INPUT
+ *     - index: input index
+ *     - outputs: serialized outputs
+ *     - outputs_len: length of outputs
+ *     - digest: buffer for the digest
+ * OUTPUT
+ *     none
+ */
+static void legacy_sighash(uint32_t index, const uint8_t *outputs, uint32_t outputs_len,
+                           uint8_t *digest)
+{
+    uint32_t version = 1, sequence = 0xFFFFFFFF, lock_time = 0, hash_type = 1, len;
+    uint8_t buf[MAX_SCRIPT_SIG_LEN];
+    SHA256_CTX ctx;
+
+    sha256_Init(&ctx);
+    sha256_Update(&ctx, (const uint8_t *)&version, 4);
+    sha256_Update(&ctx, buf, write_varint(shape.inputs, buf));
+
+    for(uint32_t j = 0; j < shape.inputs; j++)
+    {
+        serialize_outpoint(j, buf);
+        sha256_Update(&ctx, buf, 36);
+
+        if(j == index)
+        {
+            len = script_code(j, buf + 5);
+            sha256_Update(&ctx, buf, write_varint(len, buf));
+            sha256_Update(&ctx, buf + 5, len);
+        }
+        else
+        {
+            sha256_Update(&ctx, buf, write_varint(0, buf));
+        }
+
+        sha256_Update(&ctx, (const uint8_t *)&sequence, 4);
+    }
+
+    sha256_Update(&ctx, outputs, outputs_len);
+    sha256_Update(&ctx, (const uint8_t *)&lock_time, 4);
+    sha256_Update(&ctx, (const uint8_t *)&hash_type, 4);
+    sha256_Final(digest, &ctx);
+    sha256_Raw(digest, 32, digest);
+}
+
+/*
+ * segwit_sighash() - BIP143 SIGHASH_ALL digest of an input
+ *
+ * INPUT
+ *     - index: input index
+ *     - outputs: serialized outputs
+ *     - outputs_len: length of outputs
+ *     - digest: buffer for the digest
+ * OUTPUT
+ *     none
+ */
+static void segwit_sighash(uint32_t index, const uint8_t *outputs, uint32_t outputs_len,
+                           uint8_t *digest)
+{
+    uint32_t version = 1, sequence = 0xFFFFFFFF, lock_time = 0, hash_type = 1, len;
+    uint64_t amount = input_amount(index);
+    uint8_t buf[36], code[SCRIPT_PUBKEY_LEN], h[32];
+    SHA256_CTX ctx, part;
+
+    sha256_Init(&ctx);
+    sha256_Update(&ctx, (const uint8_t *)&version, 4);
+
+    /* hashPrevouts, hashSequence */
+    sha256_Init(&part);
+
+    for(uint32_t j = 0; j < shape.inputs; j++)
+    {
+        serialize_outpoint(j, buf);
+        sha256_Update(&part, buf, 36);
+    }
+
+    sha256_Final(h, &part);
+    sha256_Raw(h, 32, h);
+    sha256_Update(&ctx, h, 32);
+
+    sha256_Init(&part);
+
+    for(uint32_t j = 0; j < shape.inputs; j++)
+    {
+        sha256_Update(&part, (const uint8_t *)&sequence, 4);
+    }
+
+    sha256_Final(h, &part);
+    sha256_Raw(h, 32, h);
+    sha256_Update(&ctx, h, 32);
+
+    serialize_outpoint(index, buf);
+    sha256_Update(&ctx, buf, 36);
+    len = script_code(index, code);
+    sha256_Update(&ctx, buf, write_varint(len, buf));
+    sha256_Update(&ctx, code, len);
+    sha256_Update(&ctx, (const uint8_t *)&amount, 8);
+    sha256_Update(&ctx, (const uint8_t *)&sequence, 4);
+
+    /* hashOutputs, without the output count */
+    len = write_varint(shape.outputs, buf);
+    sha256_Raw(outputs + len, outputs_len - len, h);
+    sha256_Raw(h, 32, h);
+    sha256_Update(&ctx, h, 32);
+
+    sha256_Update(&ctx, (const uint8_t *)&lock_time, 4);
+    sha256_Update(&ctx, (const uint8_t *)&hash_type, 4);
+    sha256_Final(digest, &ctx);
+    sha256_Raw(digest, 32, digest);
+}
+
+/*
+ * serialize_signed_script_sig() - scriptSig of a signed input
+ *
+ * INPUT
+ *     - index: input index
+ *     - out: output buffer
+ * OUTPUT
+ *     length of scriptSig with its length
+ */
+static uint32_t serialize_signed_script_sig(uint32_t index, uint8_t *out)
+{
+    uint8_t script[MAX_SCRIPT_SIG_LEN];
+    uint32_t len = 0, sig_len = signature_lens[index];
+    int pubkey_idx;
+
+    switch(shape.script_type)
+    {
+        case InputScriptType_SPENDADDRESS:
+            script[len++] = sig_len + 1;
+            memcpy(script + len, signatures[index], sig_len); len += sig_len;
+            script[len++] = 0x01;   /* SIGHASH_ALL */
+            script[len++] = 33;
+            memcpy(script + len, pubkeys[index], 33); len += 33;
+            break;
+
+        case InputScriptType_SPENDP2SHWITNESS:
+            script[len++] = 22;
+            script[len++] = 0x00;   /* witness version */
+            script[len++] = 20;
+            ecdsa_get_pubkeyhash(pubkeys[index], script + len); len += 20;
+            break;
+
+        case InputScriptType_SPENDMULTISIG:
+            pubkey_idx = cryptoMultisigPubkeyIndex(&check_input.multisig, pubkeys[index]);
+
+            if(pubkey_idx < 0)
+            {
+                return 0;
+            }
+
+            memcpy(check_input.multisig.signatures[pubkey_idx].bytes, signatures[index], sig_len);
+            check_input.multisig.signatures[pubkey_idx].size = sig_len;
+            len = serialize_script_multisig(&check_input.multisig, script);
+            break;
+
+        default:
+            break;
+    }
+
+    if(len == 0)
+    {
+        return write_varint(0, out);
+    }
+
+    sig_len = write_varint(len, out);
+    memcpy(out + sig_len, script, len);
+    return sig_len + len;
+}
+
+/*
+ * verify_run() - Check every signature against its sighash and the
+ * serialized transaction against one built from the signatures
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     true/false whether the device signed the synthesized transaction
+ */
+static bool verify_run(void)
+{
+    static uint8_t outputs[5 + MAX_OUTPUTS * (8 + 1 + SCRIPT_PUBKEY_LEN)];
+    uint32_t outputs_len, r = 0, version = 1, sequence = 0xFFFFFFFF, lock_time = 0;
+    bool segwit = shape.script_type == InputScriptType_SPENDWITNESS ||
+                  shape.script_type == InputScriptType_SPENDP2SHWITNESS;
+    uint8_t digest[32], sig[64];
+    HDNode node;
+
+    outputs_len = serialize_outputs(outputs);
+
+    for(uint32_t i = 0; i < shape.inputs; i++)
+    {
+        memset(&check_input, 0, sizeof(check_input));
+        fill_input(i, &check_input);
+
+        memcpy(&node, &root, sizeof(HDNode));
+
+        for(uint32_t k = 0; k < check_input.address_n_count; k++)
+        {
+            hdnode_private_ckd(&node, check_input.address_n[k]);
+        }
+
+        hdnode_fill_public_key(&node);
+        memcpy(pubkeys[i], node.public_key, 33);
+
+        if(segwit)
+        {
+            segwit_sighash(i, outputs, outputs_len, digest);
+        }
+        else
+        {
+            legacy_sighash(i, outputs, outputs_len, digest);
+        }
+
+        if(!der_to_sig(signatures[i], signature_lens[i], sig) ||
+                ecdsa_verify_digest(&secp256k1, pubkeys[i], sig, digest) != 0)
+        {
+            fprintf(stderr, "signature of input %" PRIu32 " does not verify\n", i);
+            return false;
+        }
+    }
+
+    memcpy(expected + r, &version, 4); r += 4;
+
+    if(segwit)
+    {
+        expected[r++] = 0x00;   /* marker */
+        expected[r++] = 0x01;   /* flag */
+    }
+
+    r += write_varint(shape.inputs, expected + r);
+
+    for(uint32_t i = 0; i < shape.inputs; i++)
+    {
+        memset(&check_input, 0, sizeof(check_input));
+        fill_input(i, &check_input);
+
+        serialize_outpoint(i, expected + r); r += 36;
+        r += serialize_signed_script_sig(i, expected + r);
+        memcpy(expected + r, &sequence, 4); r += 4;
+    }
+
+    memcpy(expected + r, outputs, outputs_len); r += outputs_len;
+
+    for(uint32_t i = 0; i < shape.inputs && segwit; i++)
+    {
+        expected[r++] = 2;
+        expected[r++] = signature_lens[i] + 1;
+        memcpy(expected + r, signatures[i], signature_lens[i]); r += signature_lens[i];
+        expected[r++] = 0x01;   /* SIGHASH_ALL */
+        expected[r++] = 33;
+        memcpy(expected + r, pubkeys[i], 33); r += 33;
+    }
+
+    memcpy(expected + r, &lock_time, 4); r += 4;
+
+    if(r != serialized_len || memcmp(expected, serialized, r) != 0)
+    {
+        fprintf(stderr, "serialized transaction differs from the signed one\n");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * run_shape() - Sign a synthesized transaction rounds times and report
+ *
+ * INPUT
+ *     - bench: transaction shape
+ * OUTPUT
+ *     true/false whether every run finished with a valid signed transaction
+ */
+static bool run_shape(const BenchShape *bench)
+{
+    static const char *const script_names[] =
+    {
+        [InputScriptType_SPENDADDRESS] = "address",
+        [InputScriptType_SPENDWITNESS] = "witness",
+        [InputScriptType_SPENDP2SHWITNESS] = "p2sh-witness",
+    };
+    const TxRequest *request;
+    const EmuTraffic *traffic;
+    char script[24];
+    double start, cpu = 0;
+    double hz;
+
+    memcpy(&shape, bench, sizeof(shape));
+    coin = coinByName(shape.coin);
+
+    if(coin == NULL)
+    {
+        fprintf(stderr, "unknown coin %s\n", shape.coin);
+        return false;
+    }
+
+    prepare_shape();
+    signing_clear_stats();
+
+    for(uint32_t r = 0; r < rounds; r++)
+    {
+        signing_emu_reset(idle_calls);
+        signing_prevtx_cache_clear();
+        memset(signature_lens, 0, sizeof(signature_lens));
+        serialized_len = 0;
+
+        start = cpu_time();
+        signing_init(shape.inputs, shape.outputs, coin, &root);
+
+        while((request = signing_emu_request()) != NULL)
+        {
+            if(!collect_response(request))
+            {
+                signing_abort();
+                return false;
+            }
+
+            if(request->request_type == RequestType_TXFINISHED)
+            {
+                break;
+            }
+
+            if(!answer_request(request))
+            {
+                signing_abort();
+                return false;
+            }
+        }
+
+        cpu += cpu_time() - start;
+
+        if(signing_emu_failure() != NULL || request == NULL)
+        {
+            fprintf(stderr, "signing failed: %s\n",
+                    signing_emu_failure() != NULL ? signing_emu_failure() : "no request");
+            signing_abort();
+            return false;
+        }
+
+        if(!verify_run())
+        {
+            return false;
+        }
+    }
+
+    if(shape.script_type == InputScriptType_SPENDMULTISIG)
+    {
+        snprintf(script, sizeof(script), "%" PRIu32 "-of-%" PRIu32, shape.m, shape.n);
+    }
+    else
+    {
+        snprintf(script, sizeof(script), "%s", script_names[shape.script_type]);
+    }
+
+    traffic = signing_emu_traffic();
+    printf("%-9s in %4" PRIu32 " out %4" PRIu32 " prev %5" PRIu32 " %-12s %-6s "
+           "%6" PRIu32 " round trips, to host %8" PRIu64 " B %6" PRIu64 " reports, "
+           "to device %9" PRIu64 " B %7" PRIu64 " reports, %9.3f ms\n",
+           shape.coin, shape.inputs, shape.outputs, shape.prev_outputs, script,
+           shape.raw ? "raw" : "pieces", traffic->requests, traffic->device_bytes,
+           traffic->device_reports, traffic->host_bytes, traffic->host_reports,
+           cpu * 1000 / rounds);
+
+    if(quiet)
+    {
+        return true;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    signing_get_stats(&stats);
+    hz = stats.clock_hz / 1000.0;
+
+    for(uint32_t i = 0; i < stats.stats_count; i++)
+    {
+        const SigningStatType *stat = &stats.stats[i];
+
+        if(stat->count == 0)
+        {
+            continue;
+        }
+
+        printf("    %-24s %8" PRIu32 " x %10.3f ms, max %8.3f ms\n", stat->name,
+               stat->count / rounds, stat->total / hz / rounds, stat->max / hz);
+    }
+
+    return true;
+}
+
+/*
+ * parse_u32() - Parse a decimal command line argument
+ *
+ * INPUT
+ *     - str: argument string
+ *     - value: where to put parsed value
+ * OUTPUT
+ *     true/false whether argument is a valid 32 bit value
+ */
+static bool parse_u32(const char *str, uint32_t *value)
+{
+    char *end;
+    unsigned long long v;
+
+    errno = 0;
+    v = strtoull(str, &end, 10);
+
+    if(errno != 0 || end == str || *end != '\0' || v > 0xFFFFFFFFULL)
+    {
+        return false;
+    }
+
+    *value = (uint32_t)v;
+    return true;
+}
+
+/*
+ * parse_script() - Parse the script type argument
+ *
+ * INPUT
+ *     - str: argument string
+ *     - bench: shape to set script type of
+ * OUTPUT
+ *     true/false whether argument names a script type
+ */
+static bool parse_script(const char *str, BenchShape *bench)
+{
+    char *dash;
+
+    if(strcmp(str, "address") == 0)
+    {
+        bench->script_type = InputScriptType_SPENDADDRESS;
+    }
+    else if(strcmp(str, "witness") == 0)
+    {
+        bench->script_type = InputScriptType_SPENDWITNESS;
+    }
+    else if(strcmp(str, "p2sh-witness") == 0)
+    {
+        bench->script_type = InputScriptType_SPENDP2SHWITNESS;
+    }
+    else if((dash = strstr(str, "-of-")) != NULL)
+    {
+        *dash = '\0';
+
+        if(!parse_u32(str, &bench->m) || !parse_u32(dash + 4, &bench->n) ||
+                bench->m == 0 || bench->m > bench->n || bench->n > MAX_COSIGNERS)
+        {
+            return false;
+        }
+
+        bench->script_type = InputScriptType_SPENDMULTISIG;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * usage() - Print command line help
+ *
+ * INPUT
+ *     - name: program name
+ * OUTPUT
+ *     none
+ */
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-c coin] [-i inputs] [-o outputs] [-p prev outputs] [-s script] [-r]\n"
+            "       [-b batch] [-w idle] [-n rounds] [-q]\n"
+            "  -c coin         coin name, defaults to Bitcoin\n"
+            "  -i inputs       inputs of the signed transaction, up to %d\n"
+            "  -o outputs      outputs of the signed transaction, up to %d\n"
+            "  -p prev outputs outputs of every previous transaction, up to %d\n"
+            "  -s script       address, witness, p2sh-witness or M-of-N multisig\n"
+            "  -r              send previous transactions as RawTxAck\n"
+            "  -b batch        answer at most this many items per TxAck\n"
+            "  -w idle         confirm idle handler calls per confirmation screen\n"
+            "  -n rounds       sign every transaction this many times\n"
+            "  -q              only print one line per transaction\n"
+            "Without -c, -i, -o, -p, -s or -r the built-in corpus is run.\n",
+            name, MAX_INPUTS, MAX_OUTPUTS, MAX_PREV_OUTPUTS);
+}
+
+/* === Functions =========================================================== */
+
+int main(int argc, char *argv[])
+{
+    BenchShape single = { "Bitcoin", 1, 2, 2, InputScriptType_SPENDADDRESS, 0, 0, false };
+    bool has_shape = false, ok = true;
+    uint8_t seed[64];
+    int opt;
+
+    while((opt = getopt(argc, argv, "c:i:o:p:s:rb:w:n:q")) != -1)
+    {
+        switch(opt)
+        {
+            case 'c':
+                single.coin = optarg;
+                has_shape = true;
+                break;
+
+            case 'i':
+                if(!parse_u32(optarg, &single.inputs) || single.inputs == 0 ||
+                        single.inputs > MAX_INPUTS)
+                {
+                    fprintf(stderr, "inputs must be 1 to %d\n", MAX_INPUTS);
+                    return 1;
+                }
+
+                has_shape = true;
+                break;
+
+            case 'o':
+                if(!parse_u32(optarg, &single.outputs) || single.outputs == 0 ||
+                        single.outputs > MAX_OUTPUTS)
+                {
+                    fprintf(stderr, "outputs must be 1 to %d\n", MAX_OUTPUTS);
+                    return 1;
+                }
+
+                has_shape = true;
+                break;
+
+            case 'p':
+                if(!parse_u32(optarg, &single.prev_outputs) || single.prev_outputs == 0 ||
+                        single.prev_outputs > MAX_PREV_OUTPUTS)
+                {
+                    fprintf(stderr, "previous outputs must be 1 to %d\n", MAX_PREV_OUTPUTS);
+                    return 1;
+                }
+
+                has_shape = true;
+                break;
+
+            case 's':
+                if(!parse_script(optarg, &single))
+                {
+                    fprintf(stderr, "script must be address, witness, p2sh-witness or "
+                            "M-of-N with N up to %d\n", MAX_COSIGNERS);
+                    return 1;
+                }
+
+                has_shape = true;
+                break;
+
+            case 'r':
+                single.raw = true;
+                has_shape = true;
+                break;
+
+            case 'b':
+                if(!parse_u32(optarg, &batch_max) || batch_max == 0)
+                {
+                    fprintf(stderr, "batch must be at least 1\n");
+                    return 1;
+                }
+
+                break;
+
+            case 'w':
+                if(!parse_u32(optarg, &idle_calls))
+                {
+                    fprintf(stderr, "invalid idle call count\n");
+                    return 1;
+                }
+
+                break;
+
+            case 'n':
+                if(!parse_u32(optarg, &rounds) || rounds == 0)
+                {
+                    fprintf(stderr, "rounds must be at least 1\n");
+                    return 1;
+                }
+
+                break;
+
+            case 'q':
+                quiet = true;
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(optind != argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Fixed seed, so every run signs the same transactions */
+    memset(seed, 0x42, sizeof(seed));
+    hdnode_from_seed(seed, sizeof(seed), &root);
+
+    /* Cosigner 0 is the device's own m/45' account */
+    memcpy(&cosigners[0], &root, sizeof(HDNode));
+    hdnode_private_ckd(&cosigners[0], 0x80000000 | 45);
+
+    for(uint32_t k = 1; k < MAX_COSIGNERS; k++)
+    {
+        memset(seed, k, sizeof(seed));
+        hdnode_from_seed(seed, sizeof(seed), &cosigners[k]);
+        hdnode_private_ckd(&cosigners[k], 0x80000000 | 45);
+    }
+
+    for(uint32_t k = 0; k < MAX_COSIGNERS; k++)
+    {
+        hdnode_fill_public_key(&cosigners[k]);
+    }
+
+    if(has_shape)
+    {
+        return run_shape(&single) ? 0 : 1;
+    }
+
+    for(size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]) && ok; i++)
+    {
+        ok = run_shape(&corpus[i]);
+    }
+
+    return ok ? 0 : 1;
+}
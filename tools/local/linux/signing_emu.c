@@ -0,0 +1,290 @@
+/*
+ * This file is part of the KeepKey project.
+ *
+ * Copyright (C) 2016 KeepKey LLC
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Stand-ins for the parts of the device the signing code talks to, so
+ * signing.c, transaction.c and crypto.c run unmodified on the host.
+ *
+ * Messages written by the device are captured and measured instead of sent,
+ * confirmations are accepted right away after running the confirm idle
+ * handler a configurable number of times, and timestamps are process CPU
+ * time in microseconds.  Each idle handler call is followed by a screen pass
+ * taking as long as the call, so the handler's own pacing lets it work on
+ * every call.
+ */
+
+/* === Includes ============================================================ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <pb_encode.h>
+#include <layout.h>
+#include <confirm_sm.h>
+#include <msg_dispatch.h>
+#include <timer.h>
+
+#include <app_confirm.h>
+#include <fsm.h>
+#include <home_sm.h>
+
+#include "signing_emu.h"
+
+/* === Private Variables =================================================== */
+
+static TxRequest request;
+static bool request_pending;
+static char failure[64];
+static EmuTraffic traffic;
+static confirm_idle_handler_t idle_handler;
+static uint32_t idle_count;
+static uint64_t screen_us;     /* screen passes added to the CPU time */
+
+/* === Private Functions =================================================== */
+
+/*
+ * device_message() - Account for a message sent by the device
+ *
+ * INPUT
+ *     - fields: nanopb fields of message
+ *     - msg: message
+ * OUTPUT
+ *     none
+ */
+static void device_message(const pb_field_t *fields, const void *msg)
+{
+    pb_ostream_t stream = PB_OSTREAM_SIZING;
+
+    pb_encode(&stream, fields, msg);
+    traffic.device_bytes += stream.bytes_written;
+    traffic.device_reports += signing_emu_reports(stream.bytes_written);
+}
+
+/*
+ * user_confirms() - Let the device work in the background while the user
+ * looks at a confirmation screen
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     true, the user confirms everything
+ */
+static bool user_confirms(void)
+{
+    traffic.confirms++;
+
+    uint32_t start;
+
+    for(uint32_t i = 0; i < idle_count && idle_handler != NULL; i++)
+    {
+        start = get_timestamp();
+        idle_handler();
+        screen_us += get_timestamp() - start;
+    }
+
+    return true;
+}
+
+/* === Functions =========================================================== */
+
+/*
+ * signing_emu_reset() - Start a new signing run
+ *
+ * INPUT
+ *     - idle_calls: confirm idle handler calls per confirmation screen
+ * OUTPUT
+ *     none
+ */
+void signing_emu_reset(uint32_t idle_calls)
+{
+    memset(&traffic, 0, sizeof(traffic));
+    memset(&request, 0, sizeof(request));
+    request_pending = false;
+    failure[0] = '\0';
+    idle_count = idle_calls;
+}
+
+/*
+ * signing_emu_request() - TxRequest the device waits to have answered
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     pending request or NULL if there is none
+ */
+const TxRequest *signing_emu_request(void)
+{
+    return request_pending ? &request : NULL;
+}
+
+/*
+ * signing_emu_request_done() - Mark the pending request as being answered
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     none
+ */
+void signing_emu_request_done(void)
+{
+    request_pending = false;
+}
+
+/*
+ * signing_emu_failure() - Failure sent by the device
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     failure text or NULL if there was none
+ */
+const char *signing_emu_failure(void)
+{
+    return failure[0] != '\0' ? failure : NULL;
+}
+
+/*
+ * signing_emu_host_message() - Account for a message sent by the host
+ *
+ * INPUT
+ *     - len: encoded size of message
+ * OUTPUT
+ *     none
+ */
+void signing_emu_host_message(uint32_t len)
+{
+    traffic.acks++;
+    traffic.host_bytes += len;
+    traffic.host_reports += signing_emu_reports(len);
+}
+
+/*
+ * signing_emu_traffic() - Traffic of the current run
+ *
+ * INPUT
+ *     none
+ * OUTPUT
+ *     traffic counters
+ */
+const EmuTraffic *signing_emu_traffic(void)
+{
+    return &traffic;
+}
+
+/*
+ * signing_emu_reports() - USB reports needed for a message
+ *
+ * INPUT
+ *     - len: encoded size of message
+ * OUTPUT
+ *     number of 64 byte reports
+ */
+uint32_t signing_emu_reports(uint32_t len)
+{
+    if(len <= EMU_FIRST_PAYLOAD)
+    {
+        return 1;
+    }
+
+    return 1 + (len - EMU_FIRST_PAYLOAD + EMU_NEXT_PAYLOAD - 1) / EMU_NEXT_PAYLOAD;
+}
+
+/* === Device Stand-ins ==================================================== */
+
+bool msg_write(MessageType msg_id, const void *msg)
+{
+    if(msg_id == MessageType_MessageType_TxRequest)
+    {
+        memcpy(&request, msg, sizeof(request));
+        request_pending = true;
+        traffic.requests++;
+        device_message(TxRequest_fields, msg);
+    }
+
+    return true;
+}
+
+void fsm_sendFailure(FailureType code, const char *text)
+{
+    Failure resp;
+
+    memset(&resp, 0, sizeof(resp));
+    resp.has_code = true;
+    resp.code = code;
+    resp.has_message = true;
+    snprintf(resp.message, sizeof(resp.message), "%s", text);
+    device_message(Failure_fields, &resp);
+
+    snprintf(failure, sizeof(failure), "%s", text);
+}
+
+void go_home(void)
+{
+}
+
+void layout_simple_message(const char *str)
+{
+    (void)str;
+}
+
+void animating_progress_handler(void)
+{
+}
+
+void set_confirm_idle_handler(confirm_idle_handler_t idle_func)
+{
+    idle_handler = idle_func;
+}
+
+bool confirm(ButtonRequestType type, const char *request_title, const char *request_body, ...)
+{
+    (void)type;
+    (void)request_title;
+    (void)request_body;
+    return user_confirms();
+}
+
+bool confirm_transaction_output(ButtonRequestType bt_request, const char *amount, const char *to)
+{
+    (void)bt_request;
+    (void)amount;
+    (void)to;
+    return user_confirms();
+}
+
+bool confirm_transaction(const char *total_amount, const char *fee)
+{
+    (void)total_amount;
+    (void)fee;
+    return user_confirms();
+}
+
+uint32_t get_timestamp(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (uint32_t)(now.tv_sec * 1000000ULL + now.tv_nsec / 1000 + screen_us);
+}
+
+uint32_t get_timestamp_hz(void)
+{
+    return 1000000;
+}
@@ -0,0 +1,367 @@
+/*
+ * This file is part of the KeepKey project.
+ *
+ * Copyright (C) 2016 KeepKey LLC
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tool deriving watch-only addresses from an xpub.
+ *
+ * For every child index in the requested range, the P2PKH address and, where
+ * the coin has a P2SH version, the P2SH address of the 1-of-1 multisig script
+ * are printed for each coin in coins.c.  Those are the addresses the device
+ * shows for GetAddress without and with a single-key multisig redeem script.
+ *
+ * Indices are handed out to the worker threads in blocks, so output lines are
+ * grouped per block but not globally ordered.  Throughput goes to stderr.
+ */
+
+/* === Includes ============================================================ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <bip32.h>
+#include <ecdsa.h>
+#include <base58.h>
+#include <ripemd160.h>
+#include <sha2.h>
+
+#include <coins.h>
+
+/* === Defines ============================================================= */
+
+#define BLOCK_INDICES       256
+#define MAX_THREADS         256
+#define ADDRESS_LEN         36
+#define LINE_LEN            (17 + 1 + 5 + 1 + 10 + 1 + ADDRESS_LEN + 1)
+
+/* === Private Variables =================================================== */
+
+static HDNode parent;
+static uint32_t first_index, end_index;
+static bool quiet;
+
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t next_index;
+static uint64_t total_addresses;
+static bool failed;
+
+/* === Private Functions =================================================== */
+
+/*
+ * get_p2sh_address() - Get P2SH address of a 1-of-1 multisig script
+ *
+ * INPUT
+ *     - pub_key: 33 byte compressed public key
+ *     - version: P2SH address version of coin
+ *     - addr: buffer for address
+ *     - addrsize: size of address buffer
+ * OUTPUT
+ *     none
+ */
+static void get_p2sh_address(const uint8_t *pub_key, uint8_t version, char *addr, int addrsize)
+{
+    uint8_t script[1 + 1 + 33 + 1 + 1], h[32], raw[21];
+
+    script[0] = 0x51;           /* OP_1 */
+    script[1] = 33;
+    memcpy(script + 2, pub_key, 33);
+    script[35] = 0x51;          /* OP_1 */
+    script[36] = 0xAE;          /* OP_CHECKMULTISIG */
+
+    sha256_Raw(script, sizeof(script), h);
+    raw[0] = version;
+    ripemd160(h, sizeof(h), raw + 1);
+    base58_encode_check(raw, sizeof(raw), addr, addrsize);
+}
+
+/*
+ * take_block() - Claim the next block of indices
+ *
+ * INPUT
+ *     - start: first index of claimed block
+ *     - end: one past the last index of claimed block
+ * OUTPUT
+ *     true/false whether a block was claimed
+ */
+static bool take_block(uint32_t *start, uint32_t *end)
+{
+    bool claimed = false;
+
+    pthread_mutex_lock(&next_lock);
+
+    if(!failed && next_index < end_index)
+    {
+        *start = next_index;
+        next_index += BLOCK_INDICES;
+
+        if(next_index > end_index)
+        {
+            next_index = end_index;
+        }
+
+        *end = next_index;
+        claimed = true;
+    }
+
+    pthread_mutex_unlock(&next_lock);
+    return claimed;
+}
+
+/*
+ * worker() - Derive addresses for blocks of indices until the range is done
+ *
+ * INPUT
+ *     - arg: unused
+ * OUTPUT
+ *     NULL
+ */
+static void *worker(void *arg)
+{
+    static const size_t out_len = BLOCK_INDICES * COINS_COUNT * 2 * LINE_LEN;
+    char *out = malloc(out_len), address[ADDRESS_LEN];
+    uint64_t addresses = 0;
+    uint32_t start, end, index;
+    size_t used;
+    HDNode child;
+    int c;
+
+    (void)arg;
+
+    if(out == NULL)
+    {
+        pthread_mutex_lock(&next_lock);
+        failed = true;
+        pthread_mutex_unlock(&next_lock);
+        return NULL;
+    }
+
+    while(take_block(&start, &end))
+    {
+        used = 0;
+
+        for(index = start; index < end; index++)
+        {
+            memcpy(&child, &parent, sizeof(HDNode));
+
+            if(hdnode_public_ckd(&child, index) == 0)
+            {
+                fprintf(stderr, "index %" PRIu32 " is not a valid child, skipped\n", index);
+                continue;
+            }
+
+            for(c = 0; c < COINS_COUNT; c++)
+            {
+                ecdsa_get_address(child.public_key, coins[c].address_type, address,
+                                  sizeof(address));
+                used += snprintf(out + used, out_len - used, "%s\tp2pkh\t%" PRIu32 "\t%s\n",
+                                 coins[c].coin_name, index, address);
+                addresses++;
+
+                if(coins[c].has_address_type_p2sh)
+                {
+                    get_p2sh_address(child.public_key, coins[c].address_type_p2sh, address,
+                                     sizeof(address));
+                    used += snprintf(out + used, out_len - used, "%s\tp2sh\t%" PRIu32 "\t%s\n",
+                                     coins[c].coin_name, index, address);
+                    addresses++;
+                }
+            }
+        }
+
+        if(!quiet)
+        {
+            pthread_mutex_lock(&output_lock);
+            fwrite(out, 1, used, stdout);
+            pthread_mutex_unlock(&output_lock);
+        }
+    }
+
+    pthread_mutex_lock(&next_lock);
+    total_addresses += addresses;
+    pthread_mutex_unlock(&next_lock);
+
+    free(out);
+    return NULL;
+}
+
+/*
+ * parse_u32() - Parse a decimal command line argument
+ *
+ * INPUT
+ *     - str: argument string
+ *     - value: where to put parsed value
+ * OUTPUT
+ *     true/false whether argument is a valid 32 bit value
+ */
+static bool parse_u32(const char *str, uint32_t *value)
+{
+    char *end;
+    unsigned long long v;
+
+    errno = 0;
+    v = strtoull(str, &end, 10);
+
+    if(errno != 0 || end == str || *end != '\0' || v > 0xFFFFFFFFULL)
+    {
+        return false;
+    }
+
+    *value = (uint32_t)v;
+    return true;
+}
+
+/*
+ * usage() - Print command line help
+ *
+ * INPUT
+ *     - name: program name
+ * OUTPUT
+ *     none
+ */
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-t threads] [-c chain] [-q] <xpub> <first index> <count>\n"
+            "  -t threads  worker threads, defaults to the number of online CPUs\n"
+            "  -c chain    derive this non-hardened child of xpub first, e.g. 0 for receive\n"
+            "  -q          only report throughput, for benchmarking\n", name);
+}
+
+/* === Functions =========================================================== */
+
+int main(int argc, char *argv[])
+{
+    pthread_t threads[MAX_THREADS];
+    struct timespec start, stop;
+    uint32_t thread_count, chain, count;
+    bool has_chain = false;
+    long cpus;
+    double seconds;
+    int opt;
+    uint32_t t;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cpus > 0 ? (uint32_t)cpus : 1;
+
+    while((opt = getopt(argc, argv, "t:c:q")) != -1)
+    {
+        switch(opt)
+        {
+            case 't':
+                if(!parse_u32(optarg, &thread_count) || thread_count == 0 ||
+                        thread_count > MAX_THREADS)
+                {
+                    fprintf(stderr, "thread count must be 1 to %d\n", MAX_THREADS);
+                    return 1;
+                }
+
+                break;
+
+            case 'c':
+                if(!parse_u32(optarg, &chain) || (chain & 0x80000000))
+                {
+                    fprintf(stderr, "chain must be a non-hardened index\n");
+                    return 1;
+                }
+
+                has_chain = true;
+                break;
+
+            case 'q':
+                quiet = true;
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(argc - optind != 3 || !parse_u32(argv[optind + 1], &first_index) ||
+            !parse_u32(argv[optind + 2], &count) || count == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Public derivation only reaches the non-hardened children */
+    if((first_index & 0x80000000) || first_index + (uint64_t)count > 0x80000000ULL)
+    {
+        fprintf(stderr, "index range must stay below 0x80000000\n");
+        return 1;
+    }
+
+    if(hdnode_deserialize(argv[optind], &parent) != 0)
+    {
+        fprintf(stderr, "invalid xpub\n");
+        return 1;
+    }
+
+    /* Never derive from private material, even if an xprv was passed in */
+    memset(parent.private_key, 0, sizeof(parent.private_key));
+
+    if(has_chain && hdnode_public_ckd(&parent, chain) == 0)
+    {
+        fprintf(stderr, "chain %" PRIu32 " is not a valid child\n", chain);
+        return 1;
+    }
+
+    end_index = first_index + count;
+    next_index = first_index;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(t = 0; t < thread_count; t++)
+    {
+        if(pthread_create(&threads[t], NULL, worker, NULL) != 0)
+        {
+            fprintf(stderr, "could not start worker thread\n");
+            thread_count = t;
+            pthread_mutex_lock(&next_lock);
+            failed = true;
+            pthread_mutex_unlock(&next_lock);
+            break;
+        }
+    }
+
+    for(t = 0; t < thread_count; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    if(failed)
+    {
+        return 1;
+    }
+
+    seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%" PRIu64 " addresses for %" PRIu32 " indices in %.3f s with %" PRIu32
+            " threads, %.0f addresses/s\n", total_addresses, count, seconds, thread_count,
+            seconds > 0 ? total_addresses / seconds : 0.0);
+
+    return 0;
+}
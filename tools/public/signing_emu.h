@@ -0,0 +1,61 @@
+/*
+ * This file is part of the KeepKey project.
+ *
+ * Copyright (C) 2016 KeepKey LLC
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIGNING_EMU_H
+#define SIGNING_EMU_H
+
+/* === Includes ============================================================ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <interface.h>
+
+/* === Defines ============================================================= */
+
+/* Trezor framing: "?##", message id and length in the first report */
+#define EMU_REPORT_SIZE         64
+#define EMU_FIRST_PAYLOAD       (EMU_REPORT_SIZE - 9)
+#define EMU_NEXT_PAYLOAD        (EMU_REPORT_SIZE - 1)
+
+/* === Typedefs ============================================================ */
+
+/* Traffic between host and emulated device during one signing run */
+typedef struct
+{
+    uint32_t requests;          /* TxRequests sent by the device */
+    uint32_t acks;              /* TxAck and RawTxAck messages sent by the host */
+    uint64_t device_bytes;      /* encoded size of the device's messages */
+    uint64_t device_reports;
+    uint64_t host_bytes;        /* encoded size of the host's messages */
+    uint64_t host_reports;
+    uint32_t confirms;          /* screens the user had to confirm */
+} EmuTraffic;
+
+/* === Functions =========================================================== */
+
+void signing_emu_reset(uint32_t idle_calls);
+const TxRequest *signing_emu_request(void);
+void signing_emu_request_done(void);
+const char *signing_emu_failure(void);
+void signing_emu_host_message(uint32_t len);
+const EmuTraffic *signing_emu_traffic(void);
+uint32_t signing_emu_reports(uint32_t len);
+
+#endif